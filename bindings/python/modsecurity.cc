@@ -0,0 +1,838 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+/*
+ * Python bindings: the ModSecurity, RulesSet and Transaction classes, plus
+ * scan_many() to evaluate a list of requests on C++ worker threads.
+ *
+ * Bodies are taken through the buffer protocol (bytes, bytearray,
+ * memoryview, mmap, ...) and read in place. The GIL is released while the
+ * rules are evaluated, so Python threads using different transactions do
+ * run in parallel.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/intervention.h"
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/transaction_batch.h"
+
+
+namespace {
+
+PyObject *Error = NULL;
+PyTypeObject *ModSecurityType = NULL;
+PyTypeObject *RulesSetType = NULL;
+PyTypeObject *TransactionType = NULL;
+
+
+typedef struct {
+    PyObject_HEAD
+    modsecurity::ModSecurity *ms;
+} ModSecurityObject;
+
+
+typedef struct {
+    PyObject_HEAD
+    modsecurity::RulesSet *rules;
+} RulesSetObject;
+
+
+typedef struct {
+    PyObject_HEAD
+    modsecurity::Transaction *t;
+    /* Kept alive as long as the transaction. */
+    PyObject *ms;
+    PyObject *rules;
+    /* Set, with the GIL held, while a thread is in the transaction. */
+    int busy;
+    /* Ids of the rules matched so far, filled by collectMatch(). */
+    std::vector<long long> *matched;
+} TransactionObject;
+
+
+void dealloc(PyObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    freefunc tp_free = reinterpret_cast<freefunc>(
+        PyType_GetSlot(type, Py_tp_free));
+    tp_free(self);
+    Py_DECREF(type);
+}
+
+
+/* A str (as UTF-8) or a bytes-like object. */
+bool toString(PyObject *o, std::string *out) {
+    if (PyUnicode_Check(o)) {
+        Py_ssize_t size;
+        const char *s = PyUnicode_AsUTF8AndSize(o, &size);
+        if (s == NULL) {
+            return false;
+        }
+        out->assign(s, size);
+        return true;
+    }
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(o, &view, PyBUF_SIMPLE) != 0) {
+        return false;
+    }
+    out->assign(static_cast<const char *>(view.buf), view.len);
+    PyBuffer_Release(&view);
+    return true;
+}
+
+
+PyObject *interventionToDict(const modsecurity::ModSecurityIntervention &it,
+    const std::vector<long long> *rules, const std::string *id) {
+    PyObject *d = Py_BuildValue("{s:O,s:i,s:s,s:s}",
+        "disruptive", it.disruptive ? Py_True : Py_False,
+        "status", it.status,
+        "url", it.url,
+        "log", it.log);
+    if (d == NULL) {
+        return NULL;
+    }
+
+    if (rules != NULL) {
+        PyObject *list = PyList_New(rules->size());
+        if (list == NULL) {
+            Py_DECREF(d);
+            return NULL;
+        }
+        for (size_t i = 0; i < rules->size(); i++) {
+            PyList_SET_ITEM(list, i, PyLong_FromLongLong((*rules)[i]));
+        }
+        PyDict_SetItemString(d, "rules", list);
+        Py_DECREF(list);
+    }
+    if (id != NULL) {
+        PyObject *s = PyUnicode_FromStringAndSize(id->c_str(), id->size());
+        if (s != NULL) {
+            PyDict_SetItemString(d, "id", s);
+            Py_DECREF(s);
+        }
+    }
+    return d;
+}
+
+
+/*
+ * ModSecurity
+ */
+
+/*
+ * Every transaction hands the vector its matches go to as its log
+ * callback data. Matches are reported through the rules of a
+ * Transaction and the results of scan_many(), not logged.
+ */
+void collectMatch(void *data, long long ruleId, int phase) {
+    if (data != NULL) {
+        static_cast<std::vector<long long> *>(data)->push_back(ruleId);
+    }
+}
+
+
+PyObject *ModSecurity_new(PyTypeObject *type, PyObject *args,
+    PyObject *kwds) {
+    static const char *kwlist[] = { "connector", NULL };
+    const char *connector = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s",
+        const_cast<char **>(kwlist), &connector)) {
+        return NULL;
+    }
+
+    ModSecurityObject *self = reinterpret_cast<ModSecurityObject *>(
+        type->tp_alloc(type, 0));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->ms = new modsecurity::ModSecurity();
+    self->ms->setRuleMatchCb(collectMatch);
+    if (connector != NULL) {
+        self->ms->setConnectorInformation(connector);
+    }
+    return reinterpret_cast<PyObject *>(self);
+}
+
+
+void ModSecurity_dealloc(PyObject *o) {
+    ModSecurityObject *self = reinterpret_cast<ModSecurityObject *>(o);
+    delete self->ms;
+    dealloc(o);
+}
+
+
+PyObject *ModSecurity_who_am_i(PyObject *o, PyObject *) {
+    ModSecurityObject *self = reinterpret_cast<ModSecurityObject *>(o);
+    return PyUnicode_FromString(self->ms->whoAmI().c_str());
+}
+
+
+PyMethodDef ModSecurity_methods[] = {
+    { "who_am_i", ModSecurity_who_am_i, METH_NOARGS,
+        "Version of the library, and the connector information." },
+    { NULL, NULL, 0, NULL }
+};
+
+
+PyType_Slot ModSecurity_slots[] = {
+    { Py_tp_doc, const_cast<char *>("ModSecurity([connector])\n\n"
+        "An engine instance; persistent collections are per instance.") },
+    { Py_tp_new, reinterpret_cast<void *>(ModSecurity_new) },
+    { Py_tp_dealloc, reinterpret_cast<void *>(ModSecurity_dealloc) },
+    { Py_tp_methods, ModSecurity_methods },
+    { 0, NULL }
+};
+
+
+PyType_Spec ModSecurity_spec = {
+    "modsecurity.ModSecurity", sizeof(ModSecurityObject), 0,
+    Py_TPFLAGS_DEFAULT, ModSecurity_slots
+};
+
+
+/*
+ * RulesSet
+ */
+
+PyObject *RulesSet_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    if (!PyArg_ParseTuple(args, "")) {
+        return NULL;
+    }
+    RulesSetObject *self = reinterpret_cast<RulesSetObject *>(
+        type->tp_alloc(type, 0));
+    if (self == NULL) {
+        return NULL;
+    }
+    self->rules = new modsecurity::RulesSet();
+    return reinterpret_cast<PyObject *>(self);
+}
+
+
+void RulesSet_dealloc(PyObject *o) {
+    RulesSetObject *self = reinterpret_cast<RulesSetObject *>(o);
+    delete self->rules;
+    dealloc(o);
+}
+
+
+PyObject *loaded(RulesSetObject *self, int rules) {
+    if (rules < 0) {
+        PyErr_SetString(Error, self->rules->getParserError().c_str());
+        return NULL;
+    }
+    return PyLong_FromLong(rules);
+}
+
+
+PyObject *RulesSet_load(PyObject *o, PyObject *args) {
+    RulesSetObject *self = reinterpret_cast<RulesSetObject *>(o);
+    const char *rules;
+    int r;
+
+    if (!PyArg_ParseTuple(args, "s", &rules)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = self->rules->load(rules);
+    Py_END_ALLOW_THREADS
+    return loaded(self, r);
+}
+
+
+PyObject *RulesSet_load_from_uri(PyObject *o, PyObject *args) {
+    RulesSetObject *self = reinterpret_cast<RulesSetObject *>(o);
+    const char *uri;
+    int r;
+
+    if (!PyArg_ParseTuple(args, "s", &uri)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = self->rules->loadFromUri(uri);
+    Py_END_ALLOW_THREADS
+    return loaded(self, r);
+}
+
+
+PyMethodDef RulesSet_methods[] = {
+    { "load", RulesSet_load, METH_VARARGS,
+        "load(rules) -> int\n\nAdds rules given as text; returns how many "
+        "were added. Raises modsecurity.Error on parser errors." },
+    { "load_from_uri", RulesSet_load_from_uri, METH_VARARGS,
+        "load_from_uri(path) -> int\n\nAdds the rules of a file." },
+    { NULL, NULL, 0, NULL }
+};
+
+
+PyType_Slot RulesSet_slots[] = {
+    { Py_tp_doc, const_cast<char *>("RulesSet()\n\nRules, shared by every "
+        "transaction (and thread) evaluating them.") },
+    { Py_tp_new, reinterpret_cast<void *>(RulesSet_new) },
+    { Py_tp_dealloc, reinterpret_cast<void *>(RulesSet_dealloc) },
+    { Py_tp_methods, RulesSet_methods },
+    { 0, NULL }
+};
+
+
+PyType_Spec RulesSet_spec = {
+    "modsecurity.RulesSet", sizeof(RulesSetObject), 0,
+    Py_TPFLAGS_DEFAULT, RulesSet_slots
+};
+
+
+/*
+ * Transaction
+ */
+
+PyObject *Transaction_new(PyTypeObject *type, PyObject *args,
+    PyObject *kwds) {
+    static const char *kwlist[] = { "modsecurity", "rules", NULL };
+    PyObject *ms;
+    PyObject *rules;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!",
+        const_cast<char **>(kwlist), ModSecurityType, &ms, RulesSetType,
+        &rules)) {
+        return NULL;
+    }
+
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(
+        type->tp_alloc(type, 0));
+    if (self == NULL) {
+        return NULL;
+    }
+    Py_INCREF(ms);
+    Py_INCREF(rules);
+    self->ms = ms;
+    self->rules = rules;
+    self->matched = new std::vector<long long>();
+    self->t = new modsecurity::Transaction(
+        reinterpret_cast<ModSecurityObject *>(ms)->ms,
+        reinterpret_cast<RulesSetObject *>(rules)->rules, self->matched);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+
+void Transaction_dealloc(PyObject *o) {
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(o);
+    delete self->t;
+    delete self->matched;
+    Py_XDECREF(self->ms);
+    Py_XDECREF(self->rules);
+    dealloc(o);
+}
+
+
+/*
+ * Runs `f' on the transaction without the GIL. Returns a bool, the result
+ * of `f'.
+ */
+template <typename F>
+PyObject *call(PyObject *o, F f) {
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(o);
+    int r;
+
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+            "the transaction is in use by another thread");
+        return NULL;
+    }
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    r = f(self->t);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    return PyBool_FromLong(r);
+}
+
+
+PyObject *Transaction_process_connection(PyObject *o, PyObject *args) {
+    const char *client;
+    int clientPort;
+    const char *server;
+    int serverPort;
+
+    if (!PyArg_ParseTuple(args, "sisi", &client, &clientPort, &server,
+        &serverPort)) {
+        return NULL;
+    }
+    return call(o, [&] (modsecurity::Transaction *t) {
+        return t->processConnection(client, clientPort, server, serverPort);
+    });
+}
+
+
+PyObject *Transaction_process_uri(PyObject *o, PyObject *args) {
+    const char *uri;
+    const char *method = "GET";
+    const char *version = "1.1";
+
+    if (!PyArg_ParseTuple(args, "s|ss", &uri, &method, &version)) {
+        return NULL;
+    }
+    return call(o, [&] (modsecurity::Transaction *t) {
+        return t->processURI(uri, method, version);
+    });
+}
+
+
+PyObject *addHeader(PyObject *o, PyObject *args, bool response) {
+    PyObject *k;
+    PyObject *v;
+    std::string key;
+    std::string value;
+
+    if (!PyArg_ParseTuple(args, "OO", &k, &v)
+        || !toString(k, &key) || !toString(v, &value)) {
+        return NULL;
+    }
+    return call(o, [&] (modsecurity::Transaction *t) {
+        return response ? t->addResponseHeader(key, value)
+            : t->addRequestHeader(key, value);
+    });
+}
+
+
+PyObject *Transaction_add_request_header(PyObject *o, PyObject *args) {
+    return addHeader(o, args, false);
+}
+
+
+PyObject *Transaction_add_response_header(PyObject *o, PyObject *args) {
+    return addHeader(o, args, true);
+}
+
+
+PyObject *appendBody(PyObject *o, PyObject *args, bool response) {
+    Py_buffer body;
+
+    if (!PyArg_ParseTuple(args, "y*", &body)) {
+        return NULL;
+    }
+    const unsigned char *data = static_cast<const unsigned char *>(body.buf);
+    size_t size = body.len;
+    PyObject *r = call(o, [&] (modsecurity::Transaction *t) {
+        return response ? t->appendResponseBody(data, size)
+            : t->appendRequestBody(data, size);
+    });
+    PyBuffer_Release(&body);
+    return r;
+}
+
+
+PyObject *Transaction_append_request_body(PyObject *o, PyObject *args) {
+    return appendBody(o, args, false);
+}
+
+
+PyObject *Transaction_append_response_body(PyObject *o, PyObject *args) {
+    return appendBody(o, args, true);
+}
+
+
+PyObject *Transaction_process_request_headers(PyObject *o, PyObject *) {
+    return call(o, [] (modsecurity::Transaction *t) {
+        return t->processRequestHeaders();
+    });
+}
+
+
+PyObject *Transaction_process_request_body(PyObject *o, PyObject *) {
+    return call(o, [] (modsecurity::Transaction *t) {
+        return t->processRequestBody();
+    });
+}
+
+
+PyObject *Transaction_process_response_headers(PyObject *o,
+    PyObject *args) {
+    int status;
+    const char *protocol = "HTTP 1.1";
+
+    if (!PyArg_ParseTuple(args, "i|s", &status, &protocol)) {
+        return NULL;
+    }
+    std::string p(protocol);
+    return call(o, [&] (modsecurity::Transaction *t) {
+        return t->processResponseHeaders(status, p);
+    });
+}
+
+
+PyObject *Transaction_process_response_body(PyObject *o, PyObject *) {
+    return call(o, [] (modsecurity::Transaction *t) {
+        return t->processResponseBody();
+    });
+}
+
+
+PyObject *Transaction_process_logging(PyObject *o, PyObject *) {
+    return call(o, [] (modsecurity::Transaction *t) {
+        return t->processLogging();
+    });
+}
+
+
+PyObject *Transaction_intervention(PyObject *o, PyObject *) {
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(o);
+    modsecurity::ModSecurityIntervention it;
+
+    modsecurity::intervention::clean(&it);
+    if (!self->t->intervention(&it)) {
+        modsecurity::intervention::free(&it);
+        Py_RETURN_NONE;
+    }
+    PyObject *d = interventionToDict(it, NULL, NULL);
+    modsecurity::intervention::free(&it);
+    return d;
+}
+
+
+PyObject *Transaction_get_id(PyObject *o, void *) {
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(o);
+    return PyUnicode_FromString(self->t->m_id->c_str());
+}
+
+
+PyMethodDef Transaction_methods[] = {
+    { "process_connection", Transaction_process_connection, METH_VARARGS,
+        "process_connection(client_ip, client_port, server_ip, "
+        "server_port)" },
+    { "process_uri", Transaction_process_uri, METH_VARARGS,
+        "process_uri(uri, method='GET', http_version='1.1')" },
+    { "add_request_header", Transaction_add_request_header, METH_VARARGS,
+        "add_request_header(key, value)" },
+    { "process_request_headers", Transaction_process_request_headers,
+        METH_NOARGS, "Evaluates phase 1." },
+    { "append_request_body", Transaction_append_request_body, METH_VARARGS,
+        "append_request_body(buffer)\n\nAny bytes-like object, not copied "
+        "on the way in." },
+    { "process_request_body", Transaction_process_request_body,
+        METH_NOARGS, "Evaluates phase 2." },
+    { "add_response_header", Transaction_add_response_header, METH_VARARGS,
+        "add_response_header(key, value)" },
+    { "process_response_headers", Transaction_process_response_headers,
+        METH_VARARGS, "process_response_headers(status, "
+        "protocol='HTTP 1.1')\n\nEvaluates phase 3." },
+    { "append_response_body", Transaction_append_response_body,
+        METH_VARARGS, "append_response_body(buffer)" },
+    { "process_response_body", Transaction_process_response_body,
+        METH_NOARGS, "Evaluates phase 4." },
+    { "process_logging", Transaction_process_logging, METH_NOARGS,
+        "Evaluates phase 5." },
+    { "intervention", Transaction_intervention, METH_NOARGS,
+        "intervention() -> dict or None\n\nThe pending intervention, if "
+        "any: disruptive, status, url and log." },
+    { NULL, NULL, 0, NULL }
+};
+
+
+PyObject *Transaction_get_rules(PyObject *o, void *) {
+    TransactionObject *self = reinterpret_cast<TransactionObject *>(o);
+
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+            "the transaction is in use by another thread");
+        return NULL;
+    }
+    PyObject *list = PyList_New(self->matched->size());
+    if (list == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < self->matched->size(); i++) {
+        PyList_SET_ITEM(list, i, PyLong_FromLongLong((*self->matched)[i]));
+    }
+    return list;
+}
+
+
+PyGetSetDef Transaction_getset[] = {
+    { const_cast<char *>("id"), Transaction_get_id, NULL,
+        const_cast<char *>("Unique id of the transaction."), NULL },
+    { const_cast<char *>("rules"), Transaction_get_rules, NULL,
+        const_cast<char *>("Ids of the rules matched so far, in order, "
+        "including the ones that do not log."), NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+
+PyType_Slot Transaction_slots[] = {
+    { Py_tp_doc, const_cast<char *>("Transaction(modsecurity, rules)\n\n"
+        "One HTTP exchange, driven phase by phase, starting with "
+        "process_connection(). Not to be used by two threads at once.") },
+    { Py_tp_new, reinterpret_cast<void *>(Transaction_new) },
+    { Py_tp_dealloc, reinterpret_cast<void *>(Transaction_dealloc) },
+    { Py_tp_methods, Transaction_methods },
+    { Py_tp_getset, Transaction_getset },
+    { 0, NULL }
+};
+
+
+PyType_Spec Transaction_spec = {
+    "modsecurity.Transaction", sizeof(TransactionObject), 0,
+    Py_TPFLAGS_DEFAULT, Transaction_slots
+};
+
+
+/*
+ * scan_many
+ */
+
+/* Reads `key' of the request dict, if there; false on a Python error. */
+bool item(PyObject *request, const char *key, std::string *out) {
+    PyObject *o = PyDict_GetItemString(request, key);
+    return o == NULL || toString(o, out);
+}
+
+
+bool item(PyObject *request, const char *key, int *out) {
+    PyObject *o = PyDict_GetItemString(request, key);
+    if (o == NULL) {
+        return true;
+    }
+    *out = PyLong_AsLong(o);
+    return !PyErr_Occurred();
+}
+
+
+bool headers(PyObject *request, const char *key,
+    std::vector<std::pair<std::string, std::string>> *out) {
+    PyObject *o = PyDict_GetItemString(request, key);
+    if (o == NULL) {
+        return true;
+    }
+
+    PyObject *items = PyDict_Check(o) ? PyDict_Items(o)
+        : PySequence_List(o);
+    if (items == NULL) {
+        return false;
+    }
+    bool ok = true;
+    for (Py_ssize_t i = 0; ok && i < PyList_GET_SIZE(items); i++) {
+        PyObject *h = PyList_GET_ITEM(items, i);
+        std::pair<std::string, std::string> p;
+        ok = PySequence_Check(h) && PySequence_Size(h) == 2;
+        if (ok) {
+            PyObject *k = PySequence_GetItem(h, 0);
+            PyObject *v = PySequence_GetItem(h, 1);
+            ok = k != NULL && v != NULL && toString(k, &p.first)
+                && toString(v, &p.second);
+            Py_XDECREF(k);
+            Py_XDECREF(v);
+        }
+        if (ok) {
+            out->push_back(std::move(p));
+        } else if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_TypeError,
+                "headers are expected as (key, value) pairs");
+        }
+    }
+    Py_DECREF(items);
+    return ok;
+}
+
+
+/* Takes the buffer of a body; it is released with the others, later. */
+bool body(PyObject *request, const char *key,
+    std::vector<Py_buffer> *views, const char **data, size_t *size) {
+    PyObject *o = PyDict_GetItemString(request, key);
+    if (o == NULL) {
+        return true;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(o, &view, PyBUF_SIMPLE) != 0) {
+        return false;
+    }
+    views->push_back(view);
+    *data = static_cast<const char *>(view.buf);
+    *size = view.len;
+    return true;
+}
+
+
+struct Result {
+    Result() : id() {
+        modsecurity::intervention::clean(&it);
+    }
+
+    modsecurity::ModSecurityIntervention it;
+    std::vector<long long> rules;
+    std::string id;
+};
+
+
+PyObject *scan_many(PyObject *, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = { "modsecurity", "rules", "requests",
+        "workers", NULL };
+    PyObject *ms;
+    PyObject *rules;
+    PyObject *list;
+    int workers = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O|i",
+        const_cast<char **>(kwlist), ModSecurityType, &ms, RulesSetType,
+        &rules, &list, &workers)) {
+        return NULL;
+    }
+
+    PyObject *seq = PySequence_Fast(list, "requests must be a sequence");
+    if (seq == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    std::vector<modsecurity::BatchRequest> requests(n);
+    std::vector<Py_buffer> views;
+    bool ok = true;
+
+    for (Py_ssize_t i = 0; ok && i < n; i++) {
+        PyObject *r = PySequence_Fast_GET_ITEM(seq, i);
+        modsecurity::BatchRequest &b = requests[i];
+        if (!PyDict_Check(r)) {
+            PyErr_SetString(PyExc_TypeError, "requests must be dicts");
+            ok = false;
+            break;
+        }
+        ok = item(r, "client_ip", &b.m_clientIp)
+            && item(r, "client_port", &b.m_clientPort)
+            && item(r, "server_ip", &b.m_serverIp)
+            && item(r, "server_port", &b.m_serverPort)
+            && item(r, "uri", &b.m_uri)
+            && item(r, "method", &b.m_method)
+            && item(r, "http_version", &b.m_httpVersion)
+            && headers(r, "headers", &b.m_requestHeaders)
+            && body(r, "body", &views, &b.m_requestBodyData,
+                &b.m_requestBodySize)
+            && item(r, "response_status", &b.m_responseStatus)
+            && item(r, "response_protocol", &b.m_responseProtocol)
+            && headers(r, "response_headers", &b.m_responseHeaders)
+            && body(r, "response_body", &views, &b.m_responseBodyData,
+                &b.m_responseBodySize);
+    }
+
+    std::vector<Result> results(ok ? n : 0);
+    for (size_t i = 0; i < results.size(); i++) {
+        requests[i].m_logCbData = &results[i].rules;
+    }
+    if (ok) {
+        modsecurity::ModSecurity *m =
+            reinterpret_cast<ModSecurityObject *>(ms)->ms;
+        modsecurity::RulesSet *s =
+            reinterpret_cast<RulesSetObject *>(rules)->rules;
+        Py_BEGIN_ALLOW_THREADS
+        modsecurity::TransactionBatch batch(m, s, workers);
+        batch.process(requests, [&results] (size_t i,
+            modsecurity::Transaction *t,
+            const modsecurity::ModSecurityIntervention *it) {
+            Result &r = results[i];
+            r.it.disruptive = it->disruptive;
+            r.it.status = it->status;
+            r.it.url = it->url ? strdup(it->url) : NULL;
+            r.it.log = it->log ? strdup(it->log) : NULL;
+            r.id = *t->m_id;
+        });
+        Py_END_ALLOW_THREADS
+    }
+
+    for (Py_buffer &v : views) {
+        PyBuffer_Release(&v);
+    }
+    Py_DECREF(seq);
+
+    PyObject *out = ok ? PyList_New(n) : NULL;
+    for (Py_ssize_t i = 0; i < static_cast<Py_ssize_t>(results.size());
+        i++) {
+        if (out != NULL) {
+            PyObject *d = interventionToDict(results[i].it,
+                &results[i].rules, &results[i].id);
+            if (d == NULL) {
+                Py_CLEAR(out);
+            } else {
+                PyList_SET_ITEM(out, i, d);
+            }
+        }
+        modsecurity::intervention::free(&results[i].it);
+    }
+    return out;
+}
+
+
+PyMethodDef module_methods[] = {
+    { "scan_many", reinterpret_cast<PyCFunction>(
+        reinterpret_cast<void (*)(void)>(scan_many)),
+        METH_VARARGS | METH_KEYWORDS,
+        "scan_many(modsecurity, rules, requests, workers=-1) -> list\n\n"
+        "Evaluates every request (a dict with the optional keys client_ip, "
+        "client_port, server_ip, server_port, uri, method, http_version, "
+        "headers, body, response_status, response_protocol, "
+        "response_headers and response_body) on `workers' C++ threads, "
+        "one per CPU by default, without the GIL. Bodies are bytes-like "
+        "objects, read in place. Response phases are only evaluated with "
+        "a response_status. Returns, for each request, a dict with "
+        "disruptive, status, url, log, rules (ids of the matched rules) "
+        "and id." },
+    { NULL, NULL, 0, NULL }
+};
+
+
+PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "modsecurity",
+    "ModSecurity, a web application firewall engine.", -1, module_methods,
+    NULL, NULL, NULL, NULL
+};
+
+
+bool addType(PyObject *m, PyType_Spec *spec, PyTypeObject **type) {
+    *type = reinterpret_cast<PyTypeObject *>(PyType_FromSpec(spec));
+    if (*type == NULL) {
+        return false;
+    }
+    Py_INCREF(*type);
+    const char *name = strrchr(spec->name, '.') + 1;
+    return PyModule_AddObject(m, name,
+        reinterpret_cast<PyObject *>(*type)) == 0;
+}
+
+}  // namespace
+
+
+PyMODINIT_FUNC PyInit_modsecurity(void) {
+    PyObject *m = PyModule_Create(&module);
+    if (m == NULL) {
+        return NULL;
+    }
+
+    Error = PyErr_NewException("modsecurity.Error", NULL, NULL);
+    Py_XINCREF(Error);
+    if (Error == NULL || PyModule_AddObject(m, "Error", Error) != 0
+        || !addType(m, &ModSecurity_spec, &ModSecurityType)
+        || !addType(m, &RulesSet_spec, &RulesSetType)
+        || !addType(m, &Transaction_spec, &TransactionType)) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+# ModSecurity, http://www.modsecurity.org/
+# Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+#
+# You may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# If any of the files related to licensing are missing or if you have any
+# other questions related to licensing please contact Trustwave Holdings, Inc.
+# directly using the email address security@modsecurity.org.
+#
+#
+# Builds the `modsecurity' extension against an installed libmodsecurity
+# (found with pkg-config), or against this source tree once it was built:
+#
+#   python3 setup.py build_ext --inplace
+#
+
+import os
+import subprocess
+
+from setuptools import Extension, setup
+
+
+def pkgconfig(flag):
+    try:
+        out = subprocess.check_output(['pkg-config', flag, 'modsecurity'],
+                                      stderr=subprocess.DEVNULL)
+    except (OSError, subprocess.CalledProcessError):
+        return None
+    return out.decode().split()
+
+
+top = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+cflags = pkgconfig('--cflags')
+libs = pkgconfig('--libs')
+if cflags is None or libs is None:
+    cflags = ['-I' + os.path.join(top, 'headers')]
+    libs = ['-L' + os.path.join(top, 'src', '.libs'),
+            '-Wl,-rpath,' + os.path.join(top, 'src', '.libs'),
+            '-lmodsecurity']
+
+setup(
+    name='modsecurity',
+    version='3.0',
+    description='Python bindings for libmodsecurity',
+    ext_modules=[
+        Extension(
+            'modsecurity',
+            sources=['modsecurity.cc'],
+            language='c++',
+            extra_compile_args=['-std=c++11'] + cflags,
+            extra_link_args=libs,
+        ),
+    ],
+)
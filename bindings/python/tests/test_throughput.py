@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+#
+# ModSecurity, http://www.modsecurity.org/
+# Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+#
+# You may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# If any of the files related to licensing are missing or if you have any
+# other questions related to licensing please contact Trustwave Holdings, Inc.
+# directly using the email address security@modsecurity.org.
+#
+#
+# Checks that scan_many() gives the same verdicts as the Transaction API,
+# and prints the throughput of both. Run from bindings/python, after
+# `python3 setup.py build_ext --inplace':
+#
+#   python3 -m unittest tests/test_throughput.py
+#
+
+import os
+import sys
+import threading
+import time
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+import modsecurity  # noqa: E402
+
+
+RULES = '''
+SecRuleEngine On
+SecRequestBodyAccess On
+SecRule ARGS "@rx (?i)union\\s+select" "id:1,phase:2,deny,status:403,log"
+SecRule REQUEST_HEADERS:User-Agent "@pm sqlmap nikto" \\
+    "id:2,phase:1,deny,status:406,log"
+SecRule REQUEST_BODY "@contains <script>" "id:3,phase:2,deny,status:400,log"
+SecRule REQUEST_FILENAME "@streq /search" "id:4,phase:1,pass,nolog"
+'''
+
+AMOUNT = 2000
+
+
+def build_requests():
+    requests = []
+    for i in range(AMOUNT):
+        r = {
+            'client_ip': '10.0.%d.%d' % (i // 250 % 250, i % 250),
+            'client_port': 40000 + i % 1000,
+            'uri': '/search?q=item%d' % i,
+            'headers': {'Host': 'example.com', 'User-Agent': 'curl/8.0'},
+        }
+        kind = i % 4
+        if kind == 1:
+            r['uri'] = '/search?q=1+union+select+pass&i=%d' % i
+        elif kind == 2:
+            r['headers'] = [('Host', 'example.com'),
+                            ('User-Agent', 'sqlmap/1.7')]
+        elif kind == 3:
+            r['method'] = 'POST'
+            r['headers'] = {'Host': 'example.com',
+                            'Content-Type': 'text/plain'}
+            r['body'] = memoryview(b'x' * 1024 + b'<script>' + b'y' * 1024)
+        requests.append(r)
+    return requests
+
+
+def scan_one(ms, rules, r):
+    t = modsecurity.Transaction(ms, rules)
+    t.process_connection(r['client_ip'], r['client_port'], '127.0.0.1', 80)
+    t.process_uri(r['uri'], r.get('method', 'GET'), '1.1')
+    headers = r['headers']
+    for k, v in (headers.items() if isinstance(headers, dict) else headers):
+        t.add_request_header(k, v)
+    t.process_request_headers()
+    it = t.intervention()
+    if it is None:
+        if 'body' in r:
+            t.append_request_body(r['body'])
+        t.process_request_body()
+        it = t.intervention()
+    t.process_logging()
+    return it['status'] if it else 200
+
+
+class ThroughputTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.ms = modsecurity.ModSecurity('ModSecurity-python-test')
+        cls.rules = modsecurity.RulesSet()
+        cls.rules.load(RULES)
+        cls.requests = build_requests()
+
+    def test_parser_error(self):
+        with self.assertRaises(modsecurity.Error):
+            modsecurity.RulesSet().load('SecRule ARGS "@rx" "id:1,deny')
+
+    def test_rules(self):
+        # Rules that do not log are reported as well.
+        t = modsecurity.Transaction(self.ms, self.rules)
+        t.process_connection('10.0.0.1', 40000, '127.0.0.1', 80)
+        t.process_uri('/search?q=1+union+select+pass', 'GET', '1.1')
+        t.process_request_headers()
+        self.assertEqual(t.rules, [4])
+        t.process_request_body()
+        self.assertEqual(t.rules, [4, 1])
+
+    def test_scan_many(self):
+        start = time.perf_counter()
+        serial = [scan_one(self.ms, self.rules, r) for r in self.requests]
+        serial_time = time.perf_counter() - start
+
+        # Four Python threads on the Transaction API: the GIL is released
+        # while the rules run.
+        threaded = [None] * AMOUNT
+
+        def worker(first):
+            for i in range(first, AMOUNT, 4):
+                threaded[i] = scan_one(self.ms, self.rules, self.requests[i])
+
+        start = time.perf_counter()
+        threads = [threading.Thread(target=worker, args=(n,))
+                   for n in range(4)]
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        threaded_time = time.perf_counter() - start
+
+        start = time.perf_counter()
+        results = modsecurity.scan_many(self.ms, self.rules, self.requests)
+        batch_time = time.perf_counter() - start
+
+        self.assertEqual(len(results), AMOUNT)
+        self.assertEqual(serial, threaded)
+        self.assertEqual(serial,
+                         [r['status'] if r['disruptive'] else 200
+                          for r in results])
+        self.assertEqual(serial[:4], [200, 403, 406, 400])
+        self.assertEqual(len(set(r['id'] for r in results)), AMOUNT)
+        self.assertEqual(results[0]['rules'], [4])
+        self.assertEqual(results[1]['rules'], [4, 1])
+
+        for name, elapsed in (('transaction API', serial_time),
+                              ('transaction API, 4 threads', threaded_time),
+                              ('scan_many', batch_time)):
+            sys.stderr.write('\n%-28s %8.0f requests/s' %
+                             (name, AMOUNT / elapsed))
+        sys.stderr.write('\n')
+
+
+if __name__ == '__main__':
+    unittest.main()
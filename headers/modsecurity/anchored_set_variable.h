@@ -91,10 +91,10 @@ class AnchoredSetVariable : public std::unordered_multimap<std::string,
     void resolve(const std::string &key,
         std::vector<const VariableValue *> *l);
 
-    void resolveRegularExpression(Utils::Regex *r,
+    void resolveRegularExpression(const Utils::Regex *r,
         std::vector<const VariableValue *> *l);
 
-    void resolveRegularExpression(Utils::Regex *r,
+    void resolveRegularExpression(const Utils::Regex *r,
         std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke);
 
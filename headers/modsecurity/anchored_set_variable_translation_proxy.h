@@ -78,13 +78,13 @@ class AnchoredSetVariableTranslationProxy {
         m_translate(&m_name, l);
     };
 
-    void resolveRegularExpression(Utils::Regex *r,
+    void resolveRegularExpression(const Utils::Regex *r,
         std::vector<const VariableValue *> *l) {
         m_fount->resolveRegularExpression(r, l);
         m_translate(&m_name, l);
     };
 
-    void resolveRegularExpression(Utils::Regex *r,
+    void resolveRegularExpression(const Utils::Regex *r,
         std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) {
         m_fount->resolveRegularExpression(r, l, ke);
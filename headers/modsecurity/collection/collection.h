@@ -21,6 +21,8 @@
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <memory>
 #endif
 
@@ -37,6 +39,9 @@ typedef struct Variable_t Variables;
 
 #ifdef __cplusplus
 namespace modsecurity {
+namespace Utils {
+class Regex;
+}
 namespace variables {
 class KeyExclusions;
 }
@@ -64,10 +69,58 @@ class Collection {
     virtual void resolveMultiMatches(const std::string& var,
         std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) = 0;
-    virtual void resolveRegularExpression(const std::string& var,
-        std::vector<const VariableValue *> *l,
+    /**
+     * Entries whose key starts with `prefix' and whose remainder matches
+     * `r', compiled once by the variable that asks for them.
+     */
+    virtual void resolveRegularExpression(const std::string& prefix,
+        const Utils::Regex *r, std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) = 0;
 
+    /**
+     * Amount of entries held, across every compartment, for the backends
+     * able to tell it cheaply. Used for metrics only.
+     */
+    virtual bool countEntries(size_t *entries) { return false; }
+
+    /**
+     * Counts one event against a limit of `limit' events per `period'
+     * (both times in microseconds), using the generic cell rate algorithm:
+     * the entry holds the theoretical arrival time of the next event.
+     * Returns false, leaving the entry untouched, when the event is over
+     * the limit.
+     *
+     * This default is a read followed by a write; the backends shared
+     * between threads or processes override it to do both at once.
+     */
+    virtual bool rateLimit(const std::string &key, int64_t now,
+        int64_t period, int64_t limit) {
+        std::unique_ptr<std::string> v = resolveFirst(key);
+        int64_t tat = v ? std::strtoll(v->c_str(), NULL, 10) : 0;
+        if (!rateLimitNext(&tat, now, period, limit)) {
+            return false;
+        }
+        return storeOrUpdateFirst(key, std::to_string(tat));
+    }
+
+    /**
+     * One step of the algorithm above: moves `tat' past the event, or
+     * returns false if the event is over the limit.
+     */
+    static bool rateLimitNext(int64_t *tat, int64_t now, int64_t period,
+        int64_t limit) {
+        int64_t interval = limit > 0 ? period / limit : period;
+        if (interval < 1) {
+            interval = 1;
+        }
+        int64_t t = *tat > now ? *tat : now;
+        if (t - now > period - interval) {
+            return false;
+        }
+        *tat = t + interval;
+        return true;
+    }
+
 
     /* store */
     virtual void store(std::string key, std::string compartment,
@@ -129,6 +182,15 @@ class Collection {
     }
 
 
+    /* rateLimit */
+    virtual bool rateLimit(const std::string &key, std::string compartment,
+        std::string compartment2, int64_t now, int64_t period,
+        int64_t limit) {
+        std::string nkey = compartment + "::" + compartment2 + "::" + key;
+        return rateLimit(nkey, now, period, limit);
+    }
+
+
     /* resolveFirst */
     virtual std::unique_ptr<std::string> resolveFirst(const std::string& var,
         std::string compartment) {
@@ -179,19 +241,26 @@ class Collection {
 
 
     /* resolveRegularExpression */
-    virtual void resolveRegularExpression(const std::string& var,
+    virtual void resolveRegularExpression(const Utils::Regex *r,
+        std::vector<const VariableValue *> *l,
+        variables::KeyExclusions &ke) {
+        resolveRegularExpression("", r, l, ke);
+    }
+
+
+    virtual void resolveRegularExpression(const Utils::Regex *r,
         std::string compartment, std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) {
-        std::string nkey = compartment + "::" + var;
-        resolveRegularExpression(nkey, l, ke);
+        std::string prefix = compartment + "::";
+        resolveRegularExpression(prefix, r, l, ke);
     }
 
 
-    virtual void resolveRegularExpression(const std::string& var,
+    virtual void resolveRegularExpression(const Utils::Regex *r,
         std::string compartment, std::string compartment2,
         std::vector<const VariableValue *> *l, variables::KeyExclusions &ke) {
-        std::string nkey = compartment + "::" + compartment2 + "::" + var;
-        resolveRegularExpression(nkey, l, ke);
+        std::string prefix = compartment + "::" + compartment2 + "::";
+        resolveRegularExpression(prefix, r, l, ke);
     }
 
     std::string m_name;
@@ -0,0 +1,112 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <memory>
+#include <string>
+#endif
+
+#include <stddef.h>
+
+
+#ifndef HEADERS_MODSECURITY_DATA_PROVIDER_H_
+#define HEADERS_MODSECURITY_DATA_PROVIDER_H_
+
+
+#ifdef __cplusplus
+namespace modsecurity {
+extern "C" {
+#endif
+
+/*
+ * @name    ModSecDataReleaseCb
+ * @brief   Called once the bytes registered with msc_data_register are not
+ *          used anymore, so the host can free them.
+ *
+ */
+typedef void (*ModSecDataReleaseCb) (void *, const void *, size_t);
+
+#ifdef __cplusplus
+}
+
+
+/**
+ * Contents of a data file (@pmFromFile, @ipMatchFromFile, @fuzzyHash,
+ * SecUnicodeMapFile), read in place. Whoever provided the bytes keeps
+ * them until the span is destroyed; the operators only read them while
+ * they are being compiled.
+ */
+class DataSpan {
+ public:
+    DataSpan(const char *data, size_t size) : m_data(data), m_size(size) { }
+    virtual ~DataSpan() { }
+
+    DataSpan(const DataSpan &d) = delete;
+    DataSpan& operator= (const DataSpan &d) = delete;
+
+    /**
+     * Same as std::getline, starting at `*offset': the next line, without
+     * its '\n', goes to `line'. Returns false past the last line.
+     */
+    bool getline(size_t *offset, std::string *line) const;
+
+    const char *m_data;
+    size_t m_size;
+};
+
+
+/** @ingroup ModSecurity_CPP_API */
+/**
+ * Where the rules find their data files.
+ *
+ * The default provider first looks at the files the host registered
+ * (msc_data_register, or the map given to wasm_data::register_data_map),
+ * and, on native builds, maps the file from the disk otherwise.
+ *
+ */
+class DataProvider {
+ public:
+    virtual ~DataProvider() { }
+
+    /**
+     * Returns the contents of `name', as written in the rule loaded from
+     * `config', or nullptr and why in `error'.
+     */
+    virtual std::shared_ptr<DataSpan> get(const std::string &name,
+        const std::string &config, std::string *error) = 0;
+
+    static std::shared_ptr<DataProvider> current();
+    /* Replaces the default provider; nullptr restores it. */
+    static void set(std::shared_ptr<DataProvider> provider);
+};
+
+
+extern "C" {
+#endif
+
+/** @ingroup ModSecurity_C_API */
+int msc_data_register(const char *name, const void *data, size_t size,
+    ModSecDataReleaseCb cb, void *cb_data);
+/** @ingroup ModSecurity_C_API */
+void msc_data_release(void);
+
+#ifdef __cplusplus
+}
+}  // namespace modsecurity
+#endif
+
+
+#endif  // HEADERS_MODSECURITY_DATA_PROVIDER_H_
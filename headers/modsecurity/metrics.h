@@ -0,0 +1,153 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#endif
+
+
+#ifndef HEADERS_MODSECURITY_METRICS_H_
+#define HEADERS_MODSECURITY_METRICS_H_
+
+
+#ifdef __cplusplus
+namespace modsecurity {
+extern "C" {
+#endif
+
+/**
+ *
+ * Formats understood by msc_metrics_dump.
+ *
+ */
+typedef enum MetricsFormat {
+    /**
+     * Prometheus text exposition format.
+     *
+     */
+    MetricsPrometheusFormat = 0,
+    /**
+     * A single JSON object.
+     *
+     */
+    MetricsJsonFormat = 1,
+} MetricsFormat;
+
+#ifdef __cplusplus
+}
+
+
+/** @ingroup ModSecurity_CPP_API */
+/**
+ * Counters and latency histograms of a ModSecurity instance, shared by
+ * all of its transactions.
+ *
+ * Every value is spread over a few shards, a thread always writing to the
+ * same one with relaxed atomic increments: recording takes no lock and
+ * seldom shares a cache line with another thread. Shards are only summed
+ * up when the metrics are dumped.
+ *
+ * Counters keyed by rule id or by status code live in fixed size, open
+ * addressing tables; keys that do not fit are counted as dropped.
+ *
+ */
+class Metrics {
+ public:
+    enum Cache {
+        NegativeCache,
+        GeoCache,
+        RblCache,
+        NUMBER_OF_CACHES
+    };
+
+    Metrics();
+    ~Metrics();
+
+    Metrics(const Metrics &m) = delete;
+    Metrics& operator= (const Metrics &m) = delete;
+
+    void setEnabled(bool enabled) {
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+    bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void transaction();
+    void intervention(int status);
+    void ruleMatched(int64_t id);
+    void phaseDuration(int phase, uint64_t nanoseconds);
+    void bodyBytes(bool response, size_t bytes);
+    void bodyParserError();
+    void cacheLookup(Cache cache, bool hit);
+
+    /**
+     * Renders every metric, plus the given collection sizes, in one of
+     * the MetricsFormat formats.
+     */
+    std::string dump(int format,
+        const std::vector<std::pair<std::string, size_t>> &collections)
+        const;
+
+    /**
+     * Records how long a phase took, from its construction up to its
+     * destruction.
+     */
+    class PhaseTimer {
+     public:
+        PhaseTimer(Metrics *metrics, int phase)
+            : m_metrics(metrics && metrics->isEnabled() ? metrics : nullptr),
+            m_phase(phase) {
+            if (m_metrics) {
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~PhaseTimer() {
+            if (m_metrics) {
+                m_metrics->phaseDuration(m_phase,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - m_start).count());
+            }
+        }
+
+     private:
+        Metrics *m_metrics;
+        int m_phase;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+ private:
+    struct Shard;
+
+    Shard *shard() const;
+
+    std::atomic<bool> m_enabled;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+
+}  // namespace modsecurity
+#endif
+
+
+#endif  // HEADERS_MODSECURITY_METRICS_H_
@@ -74,6 +74,7 @@
 
 
 #ifdef __cplusplus
+#include <cstdint>
 #include <ctime>
 #include <iostream>
 #include <string>
@@ -172,6 +173,8 @@ namespace modsecurity {
 
 
 #include "modsecurity/intervention.h"
+#include "modsecurity/metrics.h"
+#include "modsecurity/shadow.h"
 #include "modsecurity/transaction.h"
 #include "modsecurity/debug_log.h"
 
@@ -220,6 +223,23 @@ namespace modsecurity {
  */
 typedef void (*ModSecLogCb) (void *, const void *);
 
+/*
+ * @name    ModSecRuleMatchCb
+ * @brief   Callback to be called every time a rule matches
+ *
+ *
+ * Unlike the log callback, it is also called for the rules that do not
+ * log (nolog, or no msg). It runs on the thread evaluating the
+ * transaction.
+ *
+ *
+ * void *     Same reference as the one handed to the log callback.
+ * long long  Id of the rule; a chain is reported under its first rule.
+ * int        Phase being evaluated, vide modsecurity::Phases.
+ *
+ */
+typedef void (*ModSecRuleMatchCb) (void *, long long, int);
+
 
 #ifdef __cplusplus
 namespace modsecurity {
@@ -229,6 +249,9 @@ namespace modsecurity {
 namespace actions {
 class Action;
 }
+namespace collection {
+class Snapshots;
+}
 class RuleWithOperator;
 
 #ifdef __cplusplus
@@ -294,6 +317,30 @@ class ModSecurity {
 
     void serverLog(void *data, std::shared_ptr<RuleMessage> rm);
 
+    /**
+     *
+     * Sets the callback told about every rule match. Once set, a missing
+     * server log callback is no longer reported on the standard error.
+     *
+     */
+    void setRuleMatchCb(ModSecRuleMatchCb cb);
+    void ruleMatched(void *data, int64_t ruleId, int phase);
+
+    /**
+     *
+     * Tunes the lookups made by @rbl. Lookups are shared by the whole
+     * process, so are these settings.
+     *
+     * timeoutMs      How long a transaction waits for an answer.
+     * unknownMatches Whether a lookup that did not complete in time, or
+     *                failed, is taken as listed.
+     * positiveTtl    Seconds a listed answer is kept.
+     * negativeTtl    Seconds a not listed answer is kept.
+     *
+     */
+    void setRblLookup(int timeoutMs, bool unknownMatches, int positiveTtl,
+        int negativeTtl);
+
     const std::string& getConnectorInformation() const;
 
     static int processContentOffset(const char *content, size_t len,
@@ -305,11 +352,62 @@ class ModSecurity {
     collection::Collection *m_session_collection;
     collection::Collection *m_user_collection;
 
+    /**
+     * Renders the metrics of this instance, plus the size of its
+     * persistent collections, in one of the MetricsFormat formats.
+     */
+    std::string dumpMetrics(int format);
+
+    /**
+     *
+     * Evaluates `rules', in DetectionOnly mode, against a sample of the
+     * transactions of this instance, on background threads (see Shadow).
+     * Must not be called while transactions are running; the rules set
+     * has to outlive the instance or be detached first.
+     *
+     * rules       The shadow rules set, NULL to detach the current one
+     *             once its queue is drained.
+     * sampleRate  Fraction of the transactions to sample, from 0 to 1.
+     * workers     Amount of shadow threads.
+     * queueSize   Sampled transactions allowed to wait for the shadow
+     *             threads; any more are dropped.
+     * cb          Called for every transaction the two sets disagree on.
+     *
+     * Returns false where threads are not available.
+     *
+     */
+    bool setShadowRules(RulesSet *rules, double sampleRate, int workers,
+        size_t queueSize, ModSecShadowCb cb, void *cbData);
+    void getShadowStats(ModSecurityShadowStats *stats) const;
+
+    /**
+     *
+     * Keeps the persistent collections held in memory in a file, so they
+     * survive a restart (see collection::Snapshots). The entries found in
+     * the file are loaded right away; the file is then written every
+     * `interval' seconds, in the background, and when the instance is
+     * destroyed.
+     *
+     * path      Snapshot file, NULL or empty to stop taking snapshots.
+     * interval  Seconds between two snapshots, 0 for the last one only.
+     * ttl       Seconds a snapshot entry stays valid, 0 for ever.
+     *
+     * Returns the amount of entries loaded, or -1 if the file is not a
+     * valid snapshot.
+     *
+     */
+    int setCollectionSnapshots(const char *path, int interval, int ttl);
+
+    Metrics m_metrics;
+    std::unique_ptr<Shadow> m_shadow;
+
  private:
+    std::unique_ptr<collection::Snapshots> m_snapshots;
     std::string m_connector;
     std::string m_whoami;
     ModSecLogCb m_logCb;
     int m_logProperties;
+    ModSecRuleMatchCb m_ruleMatchCb;
 };
 
 
@@ -328,6 +426,22 @@ void msc_set_connector_info(ModSecurity *msc, const char *connector);
 /** @ingroup ModSecurity_C_API */
 void msc_set_log_cb(ModSecurity *msc, ModSecLogCb cb);
 /** @ingroup ModSecurity_C_API */
+void msc_set_rule_match_cb(ModSecurity *msc, ModSecRuleMatchCb cb);
+/** @ingroup ModSecurity_C_API */
+void msc_set_rbl_lookup(ModSecurity *msc, int timeout_ms, int unknown_matches,
+    int positive_ttl, int negative_ttl);
+/** @ingroup ModSecurity_C_API */
+char *msc_metrics_dump(ModSecurity *msc, int format);
+/** @ingroup ModSecurity_C_API */
+int msc_set_shadow_rules(ModSecurity *msc, RulesSet *rules,
+    double sample_rate, int workers, size_t queue_size, ModSecShadowCb cb,
+    void *cb_data);
+/** @ingroup ModSecurity_C_API */
+void msc_shadow_stats(ModSecurity *msc, ModSecurityShadowStats *stats);
+/** @ingroup ModSecurity_C_API */
+int msc_set_collection_snapshots(ModSecurity *msc, const char *path,
+    int interval, int ttl);
+/** @ingroup ModSecurity_C_API */
 void msc_cleanup(ModSecurity *msc);
 
 #ifdef __cplusplus
@@ -0,0 +1,131 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#endif
+
+
+#ifndef HEADERS_MODSECURITY_RULE_EXCLUSIONS_H_
+#define HEADERS_MODSECURITY_RULE_EXCLUSIONS_H_
+
+#ifdef __cplusplus
+
+namespace modsecurity {
+class RulesSetPhases;
+class RuleWithActions;
+class Transaction;
+
+
+/**
+ * Gives every rule id of a RulesSet an ordinal: its position among the
+ * sorted ids. A range of ids therefore maps to a contiguous range of
+ * ordinals. Built when rules are merged, read only afterwards.
+ *
+ */
+class RuleIdIndex {
+ public:
+    void build(RulesSetPhases *phases);
+
+    size_t size() const { return m_ids.size(); }
+    bool ordinal(int64_t id, size_t *ordinal) const;
+    void range(int64_t from, int64_t to, size_t *first, size_t *last) const;
+
+ private:
+    std::vector<int64_t> m_ids;
+    std::unordered_map<int64_t, size_t> m_ordinals;
+};
+
+
+/**
+ * Rules and targets removed, for a single transaction, by the ctl actions
+ * ruleRemoveById, ruleRemoveByTag, ruleRemoveTargetById and
+ * ruleRemoveTargetByTag.
+ *
+ * Removed ids and id ranges are kept as a bitset over the ordinals of the
+ * rules set, removed tags and targets in hashed sets, so checking a rule
+ * does not depend on how many ctl actions were executed.
+ *
+ */
+class RuleExclusions {
+ public:
+    explicit RuleExclusions(const RuleIdIndex *index)
+        : m_index(index),
+        m_removedAny(false),
+        m_version(0) { }
+
+    void removeById(int64_t id);
+    void removeByIdRange(int64_t from, int64_t to);
+    void removeByTag(const std::string &tag);
+    void removeTargetById(int64_t id, const std::string &target);
+    void removeTargetByTag(const std::string &tag, const std::string &target);
+
+    bool isRemovedById(int64_t id) const;
+    bool isRemovedByTag(RuleWithActions *rule, Transaction *t) const;
+
+    /**
+     * Whether any rule was removed so far, by id or by tag.
+     */
+    bool removesRules() const {
+        return m_removedAny || !m_removedTags.empty();
+    }
+
+    /**
+     * Targets removed from a given rule, either by its id or by one of its
+     * tags. Tags are only resolved once, and again only when a new target
+     * is removed while the rule is still being evaluated.
+     */
+    class Targets {
+     public:
+        Targets(const RuleExclusions *exclusions, RuleWithActions *rule,
+            Transaction *t)
+            : m_exclusions(exclusions),
+            m_rule(rule),
+            m_transaction(t),
+            m_version(0) { }
+
+        bool contains(const std::string &target);
+
+     private:
+        const RuleExclusions *m_exclusions;
+        RuleWithActions *m_rule;
+        Transaction *m_transaction;
+        unsigned int m_version;
+        std::vector<const std::unordered_set<std::string> *> m_sets;
+    };
+
+ private:
+    const RuleIdIndex *m_index;
+    bool m_removedAny;
+    unsigned int m_version;
+    std::vector<bool> m_removed;
+    std::unordered_set<std::string> m_removedTags;
+    std::unordered_map<int64_t,
+        std::unordered_set<std::string>> m_targetsById;
+    std::unordered_map<std::string,
+        std::unordered_set<std::string>> m_targetsByTag;
+};
+
+
+}  // namespace modsecurity
+#endif
+
+
+#endif  // HEADERS_MODSECURITY_RULE_EXCLUSIONS_H_
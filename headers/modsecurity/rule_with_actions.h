@@ -138,6 +138,10 @@ class RuleWithActions : public Rule {
     std::vector<actions::Action *> getActionsByName(const std::string& name,
         Transaction *t);
     bool containsTag(const std::string& name, Transaction *t);
+    inline const Tags &getTags() const { return m_actionsTag; }
+    inline const Transformations &getTransformations() const {
+        return m_transformations;
+    }
     bool containsMsg(const std::string& name, Transaction *t);
 
     inline bool isChained() const { return m_isChained == true; }
@@ -154,6 +158,13 @@ class RuleWithActions : public Rule {
     inline bool hasSeverity() const { return m_severity != NULL; }
     int severity() const;
 
+    /**
+     * True when, besides logging, matching the rule does not change the
+     * transaction: no setvar, capture, block or disruptive action other
+     * than pass.
+     */
+    bool hasSideEffectFreeActions() const;
+
     std::string m_rev;
     std::string m_ver;
     int m_accuracy;
@@ -34,6 +34,7 @@
 #ifdef __cplusplus
 
 namespace modsecurity {
+class RulesSetProperties;
 
 
 class RuleWithOperator : public RuleWithActions {
@@ -62,6 +63,37 @@ class RuleWithOperator : public RuleWithActions {
         const std::string &value);
     static void cleanMatchedVars(Transaction *trasn);
 
+    /**
+     * True when the only observable effect of evaluating this rule is
+     * the match itself: no setvar, capture, ctl, skip, chain or
+     * disruptive action other than pass, and an operator and targets
+     * that do not depend on state written by other rules.
+     */
+    bool isSideEffectFree() const;
+
+    /**
+     * Checks whether the operator matches any of the targets, without
+     * writing anything to the transaction. Only meant for side effect
+     * free rules; safe to call from several threads at once.
+     */
+    bool matchesAnyTarget(Transaction *trans);
+
+    /**
+     * Leaves the transaction as evaluate() would have left it, had the
+     * rule not matched.
+     */
+    void evaluateNoMatch(Transaction *trans);
+
+    /**
+     * Whether the rule can only match when REQUEST_FILENAME,
+     * REQUEST_METHOD or SERVER_NAME, as is, equals (@streq) or starts
+     * with (@beginsWith) a constant; that is, whether it can be left out
+     * of the evaluation of the requests where it does not. Transformations
+     * and exceptions of the rules set are taken into account.
+     */
+    bool getStaticGuard(RulesSetProperties *rules, std::string *variable,
+        std::string *value, bool *prefix) const;
+
 
     std::string getOperatorName() const;
 
@@ -70,8 +102,12 @@ class RuleWithOperator : public RuleWithActions {
     }
 
  private:
+    bool isRemovedAtRuntime(Transaction *trans);
+
     modsecurity::variables::Variables *m_variables;
     operators::Operator *m_operator;
+    bool m_transactionFreeOperator:1;
+    bool m_cacheableOperator:1;
 };
 
 
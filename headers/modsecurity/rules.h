@@ -38,6 +38,11 @@
 #ifdef __cplusplus
 namespace modsecurity {
 
+/*
+ * Data files, by name, for hosts without a filesystem. Still read by the
+ * default DataProvider; msc_data_register (modsecurity/data_provider.h)
+ * registers a file without building a std::string for it.
+ */
 namespace wasm_data {
 
 void register_data_map(std::unordered_map<std::string, std::string>* map_ptr);
@@ -19,7 +19,9 @@
 #ifdef __cplusplus
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <list>
 #endif
@@ -33,14 +35,22 @@
 #include "modsecurity/transaction.h"
 #include "modsecurity/rule.h"
 #include "modsecurity/rules_set_phases.h"
+#include "modsecurity/rule_exclusions.h"
+#include "modsecurity/slow_capture.h"
 
 #ifdef __cplusplus
 
 namespace modsecurity {
 class RuleWithOperator;
+class SlowCapture;
 namespace Parser {
 class Driver;
 }
+namespace utils {
+class GuardIndex;
+class NegativeCache;
+class ThreadPool;
+}
 
 
 
@@ -79,8 +89,76 @@ class RulesSet : public RulesSetProperties {
     void debug(int level, const std::string &id, const std::string &uri,
         const std::string &msg);
 
+    /**
+     * Evaluates runs of side effect free rules ahead of time, on
+     * `workers' threads, while the matches are still applied in the
+     * original rule order. 0 (the default) keeps the evaluation serial.
+     * Not used while the debug log level is 4 or above, so the debug
+     * log keeps its order.
+     */
+    void setParallelEvaluation(int workers);
+    size_t getParallelEvaluation() const;
+
+    /**
+     * Sizes the cache of values the operator of a rule did not match,
+     * shared by all the transactions using this rules set. There is no
+     * cache until this is called; 0 entries drops it again. Values longer
+     * than maxValueLength are not cached. The cache is emptied whenever
+     * rules are merged into the set.
+     */
+    void setNegativeCache(size_t entries, size_t maxValueLength);
+    uint64_t getNegativeCacheHits() const;
+    uint64_t getNegativeCacheLookups() const;
+
+    /**
+     * Records every transaction taking at least thresholdUs microseconds,
+     * along with the time spent on each of its rules, into sink (see
+     * SlowCapture). A null sink stops the capture.
+     */
+    void setSlowCapture(uint64_t thresholdUs, size_t bodyLimit,
+        std::shared_ptr<CaptureSink> sink);
+
     RulesSetPhases m_rulesSetPhases;
+    RuleIdIndex m_ruleIds;
+    std::shared_ptr<utils::NegativeCache> m_negativeCache;
+    /* Only accessed through std::atomic_load and std::atomic_store. */
+    std::shared_ptr<SlowCapture> m_slowCapture;
  private:
+    /*
+     * Where the evaluation of a phase continues when rules are being
+     * skipped, so skipAfter and skip do not need to walk every rule in
+     * between.
+     */
+    struct JumpTable {
+        /* Positions of every SecMarker, by name. */
+        std::unordered_map<std::string, std::vector<int>> m_markers;
+        /* Positions of the rules that are not markers. */
+        std::vector<int> m_rules;
+        /* For every position, how many of those come before it. */
+        std::vector<int> m_rulesBefore;
+    };
+
+    void buildJumpTables();
+    int jump(int phase, int i, Transaction *t);
+    void findSideEffectFreeRuns();
+    void buildGuardIndexes();
+    void evaluateAhead(Rules *rules, int from, int to, Transaction *t,
+        std::vector<char> *matches);
+
+    std::shared_ptr<utils::ThreadPool> m_parallelPool;
+    /*
+     * For every rule of a phase: one past the last rule of the run of
+     * side effect free rules it belongs to, or its own index.
+     */
+    std::vector<int> m_sideEffectFreeRuns[
+        modsecurity::Phases::NUMBER_OF_PHASES];
+    JumpTable m_jumpTables[modsecurity::Phases::NUMBER_OF_PHASES];
+    /*
+     * Rules guarded by a test on REQUEST_FILENAME, REQUEST_METHOD or
+     * SERVER_NAME, for the phases that have any.
+     */
+    std::shared_ptr<utils::GuardIndex> m_guardIndexes[
+        modsecurity::Phases::NUMBER_OF_PHASES];
 #ifndef NO_LOGS
     uint8_t m_secmarker_skipped;
 #endif
@@ -100,6 +178,13 @@ int msc_rules_add_remote(RulesSet *rules, const char *key, const char *uri,
 int msc_rules_add_file(RulesSet *rules, const char *file, const char **error);
 int msc_rules_add(RulesSet *rules, const char *plain_rules, const char **error);
 int msc_rules_cleanup(RulesSet *rules);
+int msc_rules_set_parallel(RulesSet *rules, int workers);
+int msc_rules_set_negative_cache(RulesSet *rules, size_t entries,
+    size_t max_value_length);
+int msc_rules_negative_cache_stats(RulesSet *rules,
+    unsigned long long *hits, unsigned long long *lookups);
+int msc_rules_set_slow_capture(RulesSet *rules, unsigned long threshold_us,
+    size_t body_limit, const char *path);
 
 #ifdef __cplusplus
 }
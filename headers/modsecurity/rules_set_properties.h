@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <memory>
 #include <set>
 #include <cstring>
 #endif
@@ -124,19 +125,49 @@ class ConfigSet {
 };
 
 
+/**
+ * Code point (0 to 0xffff) to byte map used by urlDecodeUni.
+ *
+ * A code page only maps a few hundred code points, so the map is kept in
+ * pages of 256 bytes, allocated for the ranges that have a mapping at
+ * all. Identical maps are shared by every rules set loading them (see
+ * ConfigUnicodeMap::loadConfig).
+ */
 class UnicodeMapHolder {
  public:
-    UnicodeMapHolder() {
-        memset(m_data, -1, (sizeof(int)*65536));
-    };
+    UnicodeMapHolder() { }
+
+    UnicodeMapHolder(const UnicodeMapHolder &h) = delete;
+    UnicodeMapHolder& operator= (const UnicodeMapHolder &h) = delete;
+
+    /* The byte `index' maps to, or -1. */
+    int at(int index) const {
+        const Page *p = m_pages[(index >> 8) & 0xff].get();
+        int i = index & 0xff;
+        if (p == nullptr || ((p->m_set[i >> 6] >> (i & 63)) & 1) == 0) {
+            return -1;
+        }
+        return p->m_data[i];
+    }
 
-    int& operator[](int index) { return m_data[index]; }
-    int operator[](int index) const { return m_data[index]; }
+    void change(int i, int a) {
+        std::unique_ptr<Page> &p = m_pages[(i >> 8) & 0xff];
+        if (p == nullptr) {
+            p.reset(new Page());
+        }
+        i &= 0xff;
+        p->m_data[i] = static_cast<unsigned char>(a);
+        p->m_set[i >> 6] |= 1ULL << (i & 63);
+    }
 
-    int at(int index) const { return m_data[index]; }
-    void change(int i, int a) { m_data[i] = a; }
+ private:
+    struct Page {
+        Page() : m_data(), m_set() { }
+        unsigned char m_data[256];
+        unsigned long long m_set[4];
+    };
 
-    int m_data[65536];
+    std::unique_ptr<Page> m_pages[256];
 };
 
 
@@ -147,8 +178,13 @@ class ConfigUnicodeMap {
         m_unicodeCodePage(0),
         m_unicodeMapTable(NULL) { }
 
+    /**
+     * Loads the map of `codePage' from the unicode.mapping file `f', found
+     * through the DataProvider.
+     */
     static void loadConfig(std::string f, double codePage,
         RulesSetProperties *driver, std::string *errg);
+    static bool isAvailable(const std::string &f);
 
     void merge(ConfigUnicodeMap *from) {
         if (from->m_set == false) {
@@ -0,0 +1,207 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#endif
+
+#include <stddef.h>
+
+
+#ifndef HEADERS_MODSECURITY_SHADOW_H_
+#define HEADERS_MODSECURITY_SHADOW_H_
+
+
+#ifdef __cplusplus
+namespace modsecurity {
+extern "C" {
+#endif
+
+/**
+ *
+ * Rules matched by only one of the primary and the shadow rules sets, for
+ * one sampled transaction.
+ *
+ */
+typedef struct ModSecurityShadowDiff_t {
+    /* Id of the primary transaction. */
+    const char *id;
+    /* Ids of the rules only the primary rules set matched. */
+    const long long *primary;
+    size_t primaryCount;
+    /* Ids of the rules only the shadow rules set matched. */
+    const long long *shadow;
+    size_t shadowCount;
+} ModSecurityShadowDiff;
+
+typedef struct ModSecurityShadowStats_t {
+    /* Transactions picked to be evaluated again by the shadow set. */
+    unsigned long long sampled;
+    /* Sampled transactions left out because the queue was full. */
+    unsigned long long dropped;
+    /* Sampled transactions the shadow set is done with. */
+    unsigned long long evaluated;
+    /* Evaluated transactions where the two sets matched different rules. */
+    unsigned long long different;
+} ModSecurityShadowStats;
+
+/*
+ * @name    ModSecShadowCb
+ * @brief   Called, from a shadow worker, for every sampled transaction
+ *          where the shadow rules set did not match the same rules as the
+ *          primary one. The diff is only valid during the call.
+ *
+ */
+typedef void (*ModSecShadowCb) (void *, const ModSecurityShadowDiff *);
+
+#ifdef __cplusplus
+}
+
+class ModSecurity;
+class RulesSet;
+class Transaction;
+class BatchRequest;
+namespace utils {
+class ThreadPool;
+}
+
+
+/**
+ * Rules a transaction matched, with their phase and position in it, the
+ * phases that were evaluated and where the evaluation was intercepted.
+ * Only kept for the transactions sampled for the shadow set, and for the
+ * ones a tool asks it for, such as modsec-replay.
+ */
+class ShadowMatches {
+ public:
+    struct Match {
+        int64_t m_id;
+        int m_phase;
+        int m_index;
+    };
+
+    ShadowMatches()
+        : m_phases(0),
+        m_stoppedPhase(-1),
+        m_stoppedRule(0),
+        m_stoppedIndex(0) { }
+
+    void phase(int phase) {
+        m_phases |= 1u << phase;
+    }
+
+    void matched(int64_t id, int phase, int index) {
+        m_rules.push_back(Match{id, phase, index});
+    }
+
+    /**
+     * A disruptive action of the rule at `index' ended `phase'.
+     */
+    void stopped(int64_t id, int phase, int index) {
+        m_stoppedPhase = phase;
+        m_stoppedRule = id;
+        m_stoppedIndex = index;
+    }
+
+    std::vector<Match> m_rules;
+    unsigned int m_phases;
+    int m_stoppedPhase;
+    int64_t m_stoppedRule;
+    int m_stoppedIndex;
+};
+
+
+/** @ingroup ModSecurity_CPP_API */
+/**
+ * Evaluates a second RulesSet against a sample of the live traffic,
+ * without adding to its latency.
+ *
+ * Once a sampled transaction is released, a copy of its inputs is queued
+ * to the shadow workers, which run it through the shadow set in
+ * DetectionOnly mode. The rules matched by each set are compared, leaving
+ * out the phases the primary transaction never reached (e.g. after it was
+ * blocked).
+ *
+ * Shadow transactions have a ModSecurity instance of their own, so they
+ * neither touch the persistent collections nor the metrics of the primary
+ * one. When the queue is full the sample is dropped: the primary path
+ * never waits for the shadow workers.
+ *
+ */
+class Shadow {
+ public:
+    Shadow(ModSecurity *primary, RulesSet *rules, double sampleRate,
+        int workers, size_t queueSize, ModSecShadowCb cb, void *cbData);
+    ~Shadow();
+
+    Shadow(const Shadow &s) = delete;
+    Shadow& operator= (const Shadow &s) = delete;
+
+    /**
+     * Whether the transaction being created goes to the shadow set.
+     */
+    bool sample();
+
+    /**
+     * Queues a copy of a sampled transaction, called as it is released.
+     */
+    void submit(Transaction *t);
+
+    void stats(ModSecurityShadowStats *stats) const;
+
+    /**
+     * Blocks until every queued transaction was evaluated.
+     */
+    void drain();
+
+ private:
+    void evaluate(const BatchRequest &request,
+        const ShadowMatches &primary, const std::string &id);
+    void done();
+
+    std::unique_ptr<ModSecurity> m_ms;
+    RulesSet *m_rules;
+    double m_sampleRate;
+    size_t m_queueSize;
+    ModSecShadowCb m_cb;
+    void *m_cbData;
+
+    std::atomic<uint64_t> m_seen;
+    std::atomic<uint64_t> m_sampled;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_evaluated;
+    std::atomic<uint64_t> m_different;
+    std::atomic<size_t> m_pending;
+    std::mutex m_lock;
+    std::condition_variable m_idle;
+
+    /* Last, so the workers are gone before anything they use. */
+    std::unique_ptr<utils::ThreadPool> m_pool;
+};
+
+
+}  // namespace modsecurity
+#endif
+
+
+#endif  // HEADERS_MODSECURITY_SHADOW_H_
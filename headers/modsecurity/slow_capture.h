@@ -0,0 +1,216 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#endif
+
+
+#ifndef HEADERS_MODSECURITY_SLOW_CAPTURE_H_
+#define HEADERS_MODSECURITY_SLOW_CAPTURE_H_
+
+#ifdef __cplusplus
+
+namespace modsecurity {
+class Transaction;
+
+
+/** @ingroup ModSecurity_CPP_API */
+/**
+ * Receives the records of slow transactions, one JSON object each.
+ * Called from whichever thread completed the transaction.
+ */
+class CaptureSink {
+ public:
+    virtual ~CaptureSink() { }
+    virtual void write(const std::string &record) = 0;
+};
+
+
+/**
+ * Appends every record to a file, one per line.
+ *
+ * The records are queued and written by a thread of its own, so the
+ * thread completing a transaction never waits on the file. Past
+ * kMaxQueued pending records, new ones are dropped. The file is opened
+ * up front, see good(); records that could not be written later on are
+ * counted, see errors().
+ */
+class FileCaptureSink : public CaptureSink {
+ public:
+    explicit FileCaptureSink(const std::string &path);
+    ~FileCaptureSink();
+
+    FileCaptureSink(const FileCaptureSink &s) = delete;
+    FileCaptureSink& operator= (const FileCaptureSink &s) = delete;
+
+    void write(const std::string &record) override;
+
+    /**
+     * Blocks until every queued record was written.
+     */
+    void flush();
+
+    /** Whether the file could be opened. */
+    bool good() const { return m_good; }
+    /** Records lost to an I/O error. */
+    uint64_t errors() const { return m_errors; }
+    /** Records dropped as the queue was full. */
+    uint64_t dropped() const { return m_dropped; }
+
+    static const size_t kMaxQueued = 1024;
+
+ private:
+    void run();
+    void append(const std::string &record);
+
+    std::string m_path;
+    std::ofstream m_file;
+    bool m_good;
+    std::atomic<uint64_t> m_errors;
+    std::atomic<uint64_t> m_dropped;
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::condition_variable m_idle;
+    std::deque<std::string> m_queue;
+    bool m_writing;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+
+/**
+ * Time spent by a transaction inside its process* calls, and inside every
+ * rule evaluated. Only kept while a SlowCapture is set on the rules set.
+ */
+class CaptureTimings {
+ public:
+    struct Rule {
+        int64_t m_id;
+        int m_phase;
+        uint64_t m_nanoseconds;
+    };
+
+    CaptureTimings() : m_status(0) {
+        for (int i = 0; i < kPhases; i++) {
+            m_phases[i] = 0;
+        }
+    }
+
+    void rule(int64_t id, int phase, uint64_t nanoseconds) {
+        m_rules.push_back({id, phase, nanoseconds});
+    }
+
+    uint64_t total() const {
+        uint64_t t = 0;
+        for (int i = 0; i < kPhases; i++) {
+            t += m_phases[i];
+        }
+        return t;
+    }
+
+    /**
+     * Adds the time from its construction up to its destruction to a
+     * phase.
+     */
+    class Clock {
+     public:
+        Clock(CaptureTimings *timings, int phase)
+            : m_timings(timings),
+            m_phase(phase) {
+            if (m_timings) {
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Clock() {
+            if (m_timings) {
+                m_timings->m_phases[m_phase] +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - m_start).count();
+            }
+        }
+
+     private:
+        CaptureTimings *m_timings;
+        int m_phase;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    /* One per modsecurity::Phases. */
+    static const int kPhases = 7;
+
+    uint64_t m_phases[kPhases];
+    std::vector<Rule> m_rules;
+    /* Status of the last disruptive intervention, if any. */
+    int m_status;
+};
+
+
+/**
+ * Snapshots the transactions that took at least a given time, summed over
+ * their process* calls, so they can be reproduced offline.
+ *
+ * A record is an exchange in the JSONL format of modsec-replay
+ * (tools/replay): the connection, the request and the response, with the
+ * bodies cut at a given length and base64 encoded ("encoding": "base64").
+ * Its "capture" member adds what the replay does not need: the id of the
+ * transaction, the rule engine state, the time spent per phase and the
+ * slowest rules of the run. Strings are written byte by byte: every byte
+ * above 0x7f is escaped as \u00XX.
+ *
+ */
+class SlowCapture {
+ public:
+    SlowCapture(uint64_t thresholdUs, size_t bodyLimit,
+        std::shared_ptr<CaptureSink> sink)
+        : m_thresholdUs(thresholdUs),
+        m_bodyLimit(bodyLimit),
+        m_sink(sink) { }
+
+    uint64_t getThreshold() const { return m_thresholdUs; }
+
+    /**
+     * Writes a record of the transaction to the sink if it was slow.
+     * Called when the transaction is destroyed, once every phase it went
+     * through was timed.
+     */
+    bool capture(Transaction *t) const;
+    std::string record(Transaction *t) const;
+
+ private:
+    uint64_t m_thresholdUs;
+    size_t m_bodyLimit;
+    std::shared_ptr<CaptureSink> m_sink;
+};
+
+
+}  // namespace modsecurity
+#endif
+
+
+#endif  // HEADERS_MODSECURITY_SLOW_CAPTURE_H_
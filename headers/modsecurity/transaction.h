@@ -14,6 +14,7 @@
  */
 
 #ifdef __cplusplus
+#include <cstdint>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
@@ -48,14 +49,35 @@ typedef struct Rules_t RulesSet;
 #include "modsecurity/variable_value.h"
 #include "modsecurity/collection/collection.h"
 #include "modsecurity/variable_origin.h"
+#include "modsecurity/rule_exclusions.h"
 #include "modsecurity/anchored_set_variable_translation_proxy.h"
 #include "modsecurity/audit_log.h"
 
+/**
+ * Returned by the phase processing functions when the evaluation of the
+ * phase was suspended, as the slice set by msc_set_evaluation_slice() was
+ * exhausted. Calling the same function again resumes it.
+ */
+#define MSC_PHASE_SUSPENDED 2
+
+
+/**
+ * Debug log messages above this level are compiled out; see the configure
+ * option --with-debug-logs-max-level.
+ */
+#ifndef MSC_DEBUG_LOG_MAX_LEVEL
+#define MSC_DEBUG_LOG_MAX_LEVEL 9
+#endif
 
+/*
+ * The message, c, is only formatted when it is going to be logged. Work
+ * needed by a message and nothing else goes under ms_dbg_a_enabled().
+ */
 #ifndef NO_LOGS
 #define ms_dbg(b, c) \
   do { \
-      if (m_rules && m_rules->m_debugLog && m_rules->m_debugLog->m_debugLevel >= b) { \
+      if ((b) <= MSC_DEBUG_LOG_MAX_LEVEL && m_rules && m_rules->m_debugLog \
+          && m_rules->m_debugLog->m_debugLevel >= b) { \
           m_rules->debug(b, *m_id.get(), m_uri, c); \
       } \
   } while (0);
@@ -64,10 +86,18 @@ typedef struct Rules_t RulesSet;
   do { } while (0);
 #endif
 
+#ifndef NO_LOGS
+#define ms_dbg_a_enabled(t, b) \
+    ((b) <= MSC_DEBUG_LOG_MAX_LEVEL && t && t->m_rules \
+        && t->m_rules->m_debugLog && t->m_rules->m_debugLog->m_debugLevel >= b)
+#else
+#define ms_dbg_a_enabled(t, b) false
+#endif
+
 #ifndef NO_LOGS
 #define ms_dbg_a(t, b, c) \
   do { \
-      if (t && t->m_rules && t->m_rules->m_debugLog && t->m_rules->m_debugLog->m_debugLevel >= b) { \
+      if (ms_dbg_a_enabled(t, b)) { \
           t->debug(b, c); \
       } \
   } while (0);
@@ -104,6 +134,9 @@ class ModSecurity;
 class Transaction;
 class RulesSet;
 class RuleMessage;
+class CaptureTimings;
+class SlowCapture;
+class ShadowMatches;
 namespace actions {
 class Action;
 namespace disruptive {
@@ -387,6 +420,9 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
     int processLogging();
     int updateStatusCode(int status);
 
+    void setEvaluationSlice(int rules, int usec);
+    bool isEvaluationSuspended() const { return m_suspendedPhase != -1; }
+
     bool intervention(ModSecurityIntervention *it);
 
     bool addArgument(const std::string& orig, const std::string& key,
@@ -402,6 +438,7 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
     void debug(int, const std::string&) const;
 #endif
     void serverLog(std::shared_ptr<RuleMessage> rm);
+    void ruleMatched(int64_t ruleId, int phase);
 
     int getRuleEngineState() const;
 
@@ -497,25 +534,9 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
     RulesSet *m_rules;
 
     /**
-     *
-     */
-    std::list<int > m_ruleRemoveById;
-    std::list<std::pair<int, int> > m_ruleRemoveByIdRange;
-
-    /**
-     *
-     */
-    std::list<std::string> m_ruleRemoveByTag;
-
-    /**
-     *
-     */
-    std::list< std::pair<std::string, std::string> > m_ruleRemoveTargetByTag;
-
-    /**
-     *
+     * Rules and targets removed by ctl actions during this transaction.
      */
-    std::list< std::pair<int, std::string> > m_ruleRemoveTargetById;
+    RuleExclusions m_ruleExclusions;
 
     /**
      *
@@ -570,6 +591,46 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
      */
     modsecurity::actions::disruptive::AllowType m_allowType;
 
+    /**
+     * Upper bounds for a single evaluation of a phase, in rules and in
+     * microseconds. 0 means no bound.
+     */
+    int m_sliceRules;
+    int m_sliceTime;
+
+    /**
+     * Phase whose evaluation was suspended (-1 if none) and the index of
+     * the rule where it is going to be resumed. Skip and SecMarker state
+     * are kept as usual; a chain is never split between two slices.
+     */
+    int m_suspendedPhase;
+    int m_suspendedRule;
+
+    /**
+     * Address @geoLookup last filled the GEO collection for, and whether
+     * it was found (-1 before the first lookup).
+     */
+    std::string m_geoLookupAddress;
+    int m_geoLookupResult;
+
+    /**
+     * Time spent per phase and per rule, kept only while the rules set
+     * captures slow transactions.
+     */
+    std::unique_ptr<CaptureTimings> m_captureTimings;
+
+    /**
+     * Capture of the rules set when the transaction was created; changing
+     * it on the rules set only applies to the transactions created next.
+     */
+    std::shared_ptr<const SlowCapture> m_slowCapture;
+
+    /**
+     * Rules matched so far, kept only for the transactions sampled for a
+     * shadow rules set, and for the shadow transactions themselves.
+     */
+    std::unique_ptr<ShadowMatches> m_shadowMatches;
+
     /**
      * Holds the decode URI. Notice that m_uri holds the raw version
      * of the URI.
@@ -613,6 +674,13 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
     std::map<std::string, std::string> m_variableEnvs;
     std::string m_variableHighestSeverityAction;
     std::string m_variableRemoteUser;
+    /**
+     * REMOTE_USER as taken from the Authorization header, null if there is
+     * none. Resolved once, on first use; a new Authorization header makes
+     * it resolved again.
+     */
+    std::unique_ptr<VariableValue> m_remoteUser;
+    bool m_remoteUserResolved;
     std::string m_variableTime;
     std::string m_variableTimeDay;
     std::string m_variableTimeEpoch;
@@ -625,6 +693,9 @@ class Transaction : public TransactionAnchoredVariables, public TransactionSecMa
     std::vector<std::shared_ptr<RequestBodyProcessor::MultipartPartTmpFile>> m_multipartPartTmpFiles;
 
  private:
+    bool completeSuspendedPhase(int phase);
+    int evaluatePhase(int phase);
+
     /**
      * Pointer to the callback function that will be called to fill
      * the web server (connector) log.
@@ -718,6 +789,9 @@ int msc_process_logging(Transaction *transaction);
 /** @ingroup ModSecurity_C_API */
 int msc_update_status_code(Transaction *transaction, int status);
 
+/** @ingroup ModSecurity_C_API */
+int msc_set_evaluation_slice(Transaction *transaction, int rules, int usec);
+
 #ifdef __cplusplus
 }
 }  // namespace modsecurity
@@ -0,0 +1,147 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#endif
+
+
+#ifndef HEADERS_MODSECURITY_TRANSACTION_BATCH_H_
+#define HEADERS_MODSECURITY_TRANSACTION_BATCH_H_
+
+#include "modsecurity/intervention.h"
+
+#ifdef __cplusplus
+
+namespace modsecurity {
+class ModSecurity;
+class RulesSet;
+class Transaction;
+namespace utils {
+class ThreadPool;
+}
+
+
+/**
+ * A complete HTTP exchange, as handed to TransactionBatch. Response
+ * phases are only evaluated when m_responseStatus is set.
+ */
+class BatchRequest {
+ public:
+    BatchRequest()
+        : m_clientIp("127.0.0.1"),
+        m_clientPort(0),
+        m_serverIp("127.0.0.1"),
+        m_serverPort(80),
+        m_uri("/"),
+        m_method("GET"),
+        m_httpVersion("1.1"),
+        m_responseStatus(0),
+        m_responseProtocol("HTTP 1.1"),
+        m_requestBodyData(nullptr),
+        m_requestBodySize(0),
+        m_responseBodyData(nullptr),
+        m_responseBodySize(0),
+        m_logCbData(nullptr) { }
+
+    std::string m_clientIp;
+    int m_clientPort;
+    std::string m_serverIp;
+    int m_serverPort;
+    std::string m_uri;
+    std::string m_method;
+    std::string m_httpVersion;
+    std::vector<std::pair<std::string, std::string>> m_requestHeaders;
+    std::string m_requestBody;
+
+    int m_responseStatus;
+    std::string m_responseProtocol;
+    std::vector<std::pair<std::string, std::string>> m_responseHeaders;
+    std::string m_responseBody;
+
+    /**
+     * Bodies owned by the caller, read in place of m_requestBody and
+     * m_responseBody when set. They must outlive the evaluation.
+     */
+    const char *m_requestBodyData;
+    size_t m_requestBodySize;
+    const char *m_responseBodyData;
+    size_t m_responseBodySize;
+
+    /** Handed to the server log callback, as in Transaction(). */
+    void *m_logCbData;
+};
+
+
+/** @ingroup ModSecurity_CPP_API */
+class TransactionBatch {
+ public:
+    /**
+     * Called once per request, on a worker thread, after the last phase
+     * was evaluated and before the transaction is released. `index' is
+     * the position of the request in the submitted vector.
+     */
+    typedef std::function<void(size_t index, Transaction *transaction,
+        const ModSecurityIntervention *it)> CompletionCb;
+
+    /**
+     * workers < 0 picks one worker per hardware thread, 0 evaluates every
+     * request on the calling thread.
+     */
+    TransactionBatch(ModSecurity *ms, RulesSet *rules, int workers = -1);
+    ~TransactionBatch();
+
+    TransactionBatch(const TransactionBatch &b) = delete;
+    TransactionBatch& operator= (const TransactionBatch &b) = delete;
+
+    /**
+     * Evaluates all the requests, sharing the same RulesSet, and blocks
+     * until every one of them is completed. Returns the amount of
+     * requests that ended up with a disruptive intervention.
+     */
+    size_t process(const std::vector<BatchRequest> &requests,
+        CompletionCb cb);
+
+    size_t workers() const;
+
+    static void evaluate(ModSecurity *ms, RulesSet *rules,
+        const BatchRequest &request, ModSecurityIntervention *it,
+        const std::function<void(Transaction *)> &done);
+
+    /**
+     * As above, also calling `start' on the transaction before its first
+     * phase.
+     */
+    static void evaluate(ModSecurity *ms, RulesSet *rules,
+        const BatchRequest &request, ModSecurityIntervention *it,
+        const std::function<void(Transaction *)> &start,
+        const std::function<void(Transaction *)> &done);
+
+ private:
+    ModSecurity *m_ms;
+    RulesSet *m_rules;
+    std::unique_ptr<utils::ThreadPool> m_pool;
+};
+
+
+}  // namespace modsecurity
+#endif
+
+#endif  // HEADERS_MODSECURITY_TRANSACTION_BATCH_H_
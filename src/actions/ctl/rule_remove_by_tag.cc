@@ -33,7 +33,7 @@ bool RuleRemoveByTag::init(std::string *error) {
 }
 
 bool RuleRemoveByTag::evaluate(RuleWithActions *rule, Transaction *transaction) {
-    transaction->m_ruleRemoveByTag.push_back(m_tag);
+    transaction->m_ruleExclusions.removeByTag(m_tag);
     return true;
 }
 
@@ -123,7 +123,7 @@ std::unique_ptr<std::string> AnchoredSetVariable::resolveFirst(
 }
 
 
-void AnchoredSetVariable::resolveRegularExpression(Utils::Regex *r,
+void AnchoredSetVariable::resolveRegularExpression(const Utils::Regex *r,
     std::vector<const VariableValue *> *l) {
     for (const auto& x : *this) {
         int ret = Utils::regex_search(x.first, *r);
@@ -135,7 +135,7 @@ void AnchoredSetVariable::resolveRegularExpression(Utils::Regex *r,
 }
 
 
-void AnchoredSetVariable::resolveRegularExpression(Utils::Regex *r,
+void AnchoredSetVariable::resolveRegularExpression(const Utils::Regex *r,
     std::vector<const VariableValue *> *l,
     variables::KeyExclusions &ke) {
     for (const auto& x : *this) {
@@ -114,8 +114,8 @@ void AnchoredVariable::evaluate(std::vector<const VariableValue *> *l) {
         return;
     }
 
-    m_var->setValue(m_value);
     VariableValue *m_var2 = new VariableValue(m_var);
+    m_var2->setValue(m_value);
     l->push_back(m_var2);
 }
 
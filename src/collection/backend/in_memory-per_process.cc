@@ -17,14 +17,19 @@
 #include "src/collection/backend/in_memory-per_process.h"
 
 #ifdef __cplusplus
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <memory>
+#include <utility>
+#include <vector>
 #endif
 
 #include <pthread.h>
+#include <strings.h>
 
 #include "modsecurity/variable_value.h"
 #include "src/utils/regex.h"
@@ -36,8 +41,12 @@ namespace collection {
 namespace backend {
 
 
+constexpr size_t InMemoryPerProcess::kRateLimitsSweepAt;
+
+
 InMemoryPerProcess::InMemoryPerProcess(const std::string &name) :
-    Collection(name) {
+    Collection(name),
+    m_rateLimitsSweepAt(kRateLimitsSweepAt) {
     this->reserve(1000);
     pthread_mutex_init(&m_lock, NULL);
 }
@@ -56,9 +65,14 @@ void InMemoryPerProcess::store(std::string key, std::string value) {
 
 bool InMemoryPerProcess::storeOrUpdateFirst(const std::string &key,
     const std::string &value) {
-    if (updateFirst(key, value) == false) {
-        store(key, value);
+    pthread_mutex_lock(&m_lock);
+    auto it = this->find(key);
+    if (it != this->end()) {
+        it->second = value;
+    } else {
+        this->emplace(key, value);
     }
+    pthread_mutex_unlock(&m_lock);
     return true;
 }
 
@@ -85,13 +99,46 @@ void InMemoryPerProcess::del(const std::string& key) {
 }
 
 
+bool InMemoryPerProcess::rateLimit(const std::string &key, int64_t now,
+    int64_t period, int64_t limit) {
+    bool allowed;
+
+    pthread_mutex_lock(&m_lock);
+    auto it = m_rateLimits.find(key);
+    if (it == m_rateLimits.end()) {
+        if (m_rateLimits.size() >= m_rateLimitsSweepAt) {
+            expireRateLimits(now);
+        }
+        it = m_rateLimits.emplace(key, 0).first;
+    }
+    allowed = rateLimitNext(&it->second, now, period, limit);
+    pthread_mutex_unlock(&m_lock);
+    return allowed;
+}
+
+
+void InMemoryPerProcess::expireRateLimits(int64_t now) {
+    for (auto it = m_rateLimits.begin(); it != m_rateLimits.end();) {
+        if (it->second <= now) {
+            it = m_rateLimits.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_rateLimitsSweepAt = std::max(kRateLimitsSweepAt,
+        2 * m_rateLimits.size());
+}
+
+
 void InMemoryPerProcess::resolveSingleMatch(const std::string& var,
     std::vector<const VariableValue *> *l) {
+    pthread_mutex_lock(&m_lock);
     auto range = this->equal_range(var);
 
     for (auto it = range.first; it != range.second; ++it) {
         l->push_back(new VariableValue(&m_name, &it->first, &it->second));
     }
+    pthread_mutex_unlock(&m_lock);
 }
 
 
@@ -100,6 +147,7 @@ void InMemoryPerProcess::resolveMultiMatches(const std::string& var,
     size_t keySize = var.size();
     l->reserve(15);
 
+    pthread_mutex_lock(&m_lock);
     if (keySize == 0) {
         for (auto &i : *this) {
             if (ke.toOmit(i.first)) {
@@ -118,37 +166,22 @@ void InMemoryPerProcess::resolveMultiMatches(const std::string& var,
                 &it->second));
         }
     }
+    pthread_mutex_unlock(&m_lock);
 }
 
 
-void InMemoryPerProcess::resolveRegularExpression(const std::string& var,
-    std::vector<const VariableValue *> *l, variables::KeyExclusions &ke) {
-
-    //if (var.find(":") == std::string::npos) {
-    //    return;
-    //}
-    //if (var.size() < var.find(":") + 3) {
-    //    return;
-    //}
-    //std::string col = std::string(var, 0, var.find(":"));
-    //std::string name = std::string(var, var.find(":") + 2,
-    //    var.size() - var.find(":") - 3);
-    //size_t keySize = col.size();
-    Utils::Regex r(var, true);
+void InMemoryPerProcess::resolveRegularExpression(const std::string& prefix,
+    const Utils::Regex *r, std::vector<const VariableValue *> *l,
+    variables::KeyExclusions &ke) {
+    size_t keySize = prefix.size();
 
+    pthread_mutex_lock(&m_lock);
     for (const auto& x : *this) {
-        //if (x.first.size() <= keySize + 1) {
-        //    continue;
-        //}
-        //if (x.first.at(keySize) != ':') {
-        //    continue;
-        //}
-        //if (std::string(x.first, 0, keySize) != col) {
-        //    continue;
-        //}
-        //std::string content = std::string(x.first, keySize + 1,
-         //                                 x.first.size() - keySize - 1);
-        int ret = Utils::regex_search(x.first, r);
+        if (x.first.size() <= keySize
+            || strncasecmp(x.first.c_str(), prefix.c_str(), keySize) != 0) {
+            continue;
+        }
+        int ret = Utils::regex_search(std::string(x.first, keySize), *r);
         if (ret <= 0) {
             continue;
         }
@@ -157,17 +190,87 @@ void InMemoryPerProcess::resolveRegularExpression(const std::string& var,
         }
         l->insert(l->begin(), new VariableValue(&m_name, &x.first, &x.second));
     }
+    pthread_mutex_unlock(&m_lock);
 }
 
 
 std::unique_ptr<std::string> InMemoryPerProcess::resolveFirst(
     const std::string& var) {
-    auto range = equal_range(var);
-    for (auto it = range.first; it != range.second; ++it) {
-        return std::unique_ptr<std::string>(new std::string(it->second));
+    std::unique_ptr<std::string> ret;
+    pthread_mutex_lock(&m_lock);
+    auto it = find(var);
+    if (it != end()) {
+        ret.reset(new std::string(it->second));
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return ret;
+}
+
+
+bool InMemoryPerProcess::countEntries(size_t *entries) {
+    pthread_mutex_lock(&m_lock);
+    *entries = size();
+    pthread_mutex_unlock(&m_lock);
+    return true;
+}
+
+
+void InMemoryPerProcess::copyEntries(
+    std::vector<std::pair<std::string, std::string>> *l) {
+    const size_t bucketsPerLock = 256;
+
+    /*
+     * A rehash in between two chunks moves entries to other buckets: start
+     * over, and after a few attempts copy everything in one go.
+     */
+    for (int attempt = 0; ; attempt++) {
+        l->clear();
+        pthread_mutex_lock(&m_lock);
+        size_t buckets = bucket_count();
+        if (attempt == 3) {
+            for (const auto &x : *this) {
+                l->emplace_back(x.first, x.second);
+            }
+            pthread_mutex_unlock(&m_lock);
+            return;
+        }
+        pthread_mutex_unlock(&m_lock);
+
+        bool rehashed = false;
+        for (size_t b = 0; b < buckets && !rehashed; b += bucketsPerLock) {
+            pthread_mutex_lock(&m_lock);
+            if (bucket_count() != buckets) {
+                rehashed = true;
+            } else {
+                size_t last = std::min(b + bucketsPerLock, buckets);
+                for (size_t n = b; n < last; n++) {
+                    for (auto it = begin(n); it != end(n); ++it) {
+                        l->emplace_back(it->first, it->second);
+                    }
+                }
+            }
+            pthread_mutex_unlock(&m_lock);
+        }
+        if (!rehashed) {
+            return;
+        }
     }
+}
+
 
-    return NULL;
+void InMemoryPerProcess::restoreEntries(
+    const std::vector<std::pair<std::string, std::string>> &l) {
+    std::unordered_set<std::string, MyHash, MyEqual> restored;
+
+    pthread_mutex_lock(&m_lock);
+    for (const auto &x : l) {
+        if (restored.count(x.first) > 0 || find(x.first) == end()) {
+            emplace(x.first, x.second);
+            restored.insert(x.first);
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
 }
 
 
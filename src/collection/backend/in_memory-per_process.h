@@ -21,7 +21,9 @@
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 #include <memory>
+#include <utility>
 #endif
 
 
@@ -38,13 +40,8 @@ namespace collection {
 namespace backend {
 
 /*
- * FIXME:
- *
- * This was an example grabbed from:
- * http://stackoverflow.com/questions/8627698/case-insensitive-stl-containers-e-g-stdunordered-set
- *
- * We have to have a better hash function, maybe based on the std::hash.
- *
+ * Keys are case insensitive: both the hash and the comparison ignore the
+ * case. The hash is FNV-1a over the lower cased bytes.
  */
 struct MyEqual {
     bool operator()(const std::string& Left, const std::string& Right) const {
@@ -58,12 +55,12 @@ struct MyEqual {
 
 struct MyHash{
     size_t operator()(const std::string& Keyval) const {
-        // You might need a better hash function than this
-        size_t h = 0;
-        std::for_each(Keyval.begin(), Keyval.end(), [&](char c) {
-            h += tolower(c);
-        });
-        return h;
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : Keyval) {
+            h ^= static_cast<unsigned char>(tolower(c));
+            h *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(h);
     }
 };
 
@@ -84,6 +81,9 @@ class InMemoryPerProcess :
 
     void del(const std::string& key) override;
 
+    bool rateLimit(const std::string &key, int64_t now, int64_t period,
+        int64_t limit) override;
+
     std::unique_ptr<std::string> resolveFirst(const std::string& var) override;
 
     void resolveSingleMatch(const std::string& var,
@@ -91,12 +91,38 @@ class InMemoryPerProcess :
     void resolveMultiMatches(const std::string& var,
         std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) override;
-    void resolveRegularExpression(const std::string& var,
-        std::vector<const VariableValue *> *l,
+    void resolveRegularExpression(const std::string& prefix,
+        const Utils::Regex *r, std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) override;
 
+    bool countEntries(size_t *entries) override;
+
+    /**
+     * Copies every entry. The lock is taken for a few buckets at a time,
+     * so the transactions writing to the collection are barely held back.
+     */
+    void copyEntries(std::vector<std::pair<std::string, std::string>> *l);
+
+    /**
+     * Adds the entries whose key is not in the collection yet.
+     */
+    void restoreEntries(
+        const std::vector<std::pair<std::string, std::string>> &l);
+
  private:
+    /**
+     * Drops the rate limits whose theoretical arrival time is not after
+     * `now': they allow the next event just as a missing entry would.
+     * Called with m_lock held, once the map doubled since the last sweep.
+     */
+    void expireRateLimits(int64_t now);
+
+    static constexpr size_t kRateLimitsSweepAt = 1024;
+
     pthread_mutex_t m_lock;
+    /* rateLimit() state, kept apart from the variables of the collection. */
+    std::unordered_map<std::string, int64_t, MyHash, MyEqual> m_rateLimits;
+    size_t m_rateLimitsSweepAt;
 };
 
 }  // namespace backend
@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <cstdlib>
 #include <string>
 #include <memory>
 
@@ -37,6 +39,9 @@ namespace backend {
 
 #ifdef WITH_LMDB
 
+/* When the next rateLimit() call sweeps the expired entries, in us. */
+static std::atomic<int64_t> nextRateLimitSweep(0);
+
 LMDB::LMDB(std::string name) :
     Collection(name), m_env(NULL), isOpen(false) {}
 
@@ -228,6 +233,125 @@ end_txn:
 }
 
 
+bool LMDB::rateLimit(const std::string &key, int64_t now, int64_t period,
+    int64_t limit) {
+    int rc;
+    MDB_txn *txn;
+    MDB_val mdb_key;
+    MDB_val mdb_value;
+    MDB_val mdb_value_ret;
+    int64_t tat = 0;
+    bool allowed = true;
+    std::string value;
+    int64_t sweep = nextRateLimitSweep.load(std::memory_order_relaxed);
+
+    /*
+     * All the collections share one database; a single thread of the
+     * process sweeps it, before taking the write transaction below.
+     */
+    if (now >= sweep && nextRateLimitSweep.compare_exchange_strong(sweep,
+        now + kRateLimitSweepInterval)) {
+        expireRateLimits(now);
+    }
+
+    string2val(key, &mdb_key);
+
+    /* A write transaction, so no other process sees the old value. */
+    rc = txn_begin(0, &txn);
+    lmdb_debug(rc, "txn", "rateLimit");
+    if (rc != 0) {
+        goto end_txn;
+    }
+
+    rc = mdb_get(txn, m_dbi, &mdb_key, &mdb_value_ret);
+    lmdb_debug(rc, "get", "rateLimit");
+    if (rc == 0) {
+        tat = std::strtoll(std::string(
+            reinterpret_cast<char *>(mdb_value_ret.mv_data),
+            mdb_value_ret.mv_size).c_str(), NULL, 10);
+    }
+
+    allowed = rateLimitNext(&tat, now, period, limit);
+    if (!allowed) {
+        mdb_txn_abort(txn);
+        goto end_txn;
+    }
+
+    if (rc == 0) {
+        rc = mdb_del(txn, m_dbi, &mdb_key, &mdb_value_ret);
+        lmdb_debug(rc, "del", "rateLimit");
+        if (rc != 0) {
+            goto end_del;
+        }
+    }
+
+    value = std::to_string(tat);
+    string2val(value, &mdb_value);
+    rc = mdb_put(txn, m_dbi, &mdb_key, &mdb_value, 0);
+    lmdb_debug(rc, "put", "rateLimit");
+    if (rc != 0) {
+        goto end_put;
+    }
+
+    rc = mdb_txn_commit(txn);
+    lmdb_debug(rc, "commit", "rateLimit");
+    if (rc != 0) {
+        goto end_commit;
+    }
+
+end_put:
+end_del:
+    if (rc != 0) {
+        mdb_txn_abort(txn);
+    }
+end_commit:
+end_txn:
+    return allowed;
+}
+
+
+void LMDB::expireRateLimits(int64_t now) {
+    MDB_val key, data;
+    MDB_txn *txn = NULL;
+    MDB_cursor *cursor;
+    int rc;
+
+    rc = txn_begin(0, &txn);
+    lmdb_debug(rc, "txn", "expireRateLimits");
+    if (rc != 0) {
+        goto end_txn;
+    }
+
+    rc = mdb_cursor_open(txn, m_dbi, &cursor);
+    lmdb_debug(rc, "cursor_open", "expireRateLimits");
+    if (rc != 0) {
+        goto end_cursor_open;
+    }
+
+    while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) {
+        std::string k(reinterpret_cast<char *>(key.mv_data), key.mv_size);
+        if (k.find("::RATELIMIT_") == std::string::npos) {
+            continue;
+        }
+        std::string v(reinterpret_cast<char *>(data.mv_data), data.mv_size);
+        if (std::strtoll(v.c_str(), NULL, 10) <= now) {
+            rc = mdb_cursor_del(cursor, 0);
+            lmdb_debug(rc, "del", "expireRateLimits");
+        }
+    }
+
+    mdb_cursor_close(cursor);
+    rc = mdb_txn_commit(txn);
+    lmdb_debug(rc, "commit", "expireRateLimits");
+    goto end_txn;
+
+end_cursor_open:
+    mdb_txn_abort(txn);
+end_txn:
+    return;
+}
+
+
 void LMDB::resolveSingleMatch(const std::string& var,
     std::vector<const VariableValue *> *l) {
     int rc;
@@ -451,16 +575,15 @@ end_txn:
 }
 
 
-void LMDB::resolveRegularExpression(const std::string& var,
-    std::vector<const VariableValue *> *l,
+void LMDB::resolveRegularExpression(const std::string& prefix,
+    const Utils::Regex *r, std::vector<const VariableValue *> *l,
     variables::KeyExclusions &ke) {
     MDB_val key, data;
     MDB_txn *txn = NULL;
     int rc;
     MDB_stat mst;
     MDB_cursor *cursor;
-
-    Utils::Regex r(var, true);
+    size_t keySize = prefix.size();
 
     rc = txn_begin(MDB_RDONLY, &txn);
     lmdb_debug(rc, "txn", "resolveRegularExpression");
@@ -475,13 +598,15 @@ void LMDB::resolveRegularExpression(const std::string& var,
     }
 
     while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) {
-        char *a = reinterpret_cast<char *>(key.mv_data);
-        int ret = Utils::regex_search(a, r);
+        std::string a(reinterpret_cast<char *>(key.mv_data), key.mv_size);
+        if (a.size() <= keySize || a.compare(0, keySize, prefix) != 0) {
+            continue;
+        }
+        int ret = Utils::regex_search(std::string(a, keySize), *r);
         if (ret <= 0) {
             continue;
         }
-        if (ke.toOmit(std::string(reinterpret_cast<char *>(key.mv_data),
-                key.mv_size))) {
+        if (ke.toOmit(a)) {
             continue;
         }
 
@@ -105,6 +105,9 @@ class LMDB :
 
     void del(const std::string& key) override;
 
+    bool rateLimit(const std::string &key, int64_t now, int64_t period,
+        int64_t limit) override;
+
     std::unique_ptr<std::string> resolveFirst(const std::string& var) override;
 
     void resolveSingleMatch(const std::string& var,
@@ -112,11 +115,19 @@ class LMDB :
     void resolveMultiMatches(const std::string& var,
         std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) override;
-    void resolveRegularExpression(const std::string& var,
-        std::vector<const VariableValue *> *l,
+    void resolveRegularExpression(const std::string& prefix,
+        const Utils::Regex *r, std::vector<const VariableValue *> *l,
         variables::KeyExclusions &ke) override;
 
  private:
+    /**
+     * Deletes the rate limits whose theoretical arrival time is not after
+     * `now'. rateLimit() calls it once a minute at most; otherwise every
+     * key ever rate limited would stay in the database.
+     */
+    void expireRateLimits(int64_t now);
+    static constexpr int64_t kRateLimitSweepInterval = 60 * 1000000LL;
+
     int txn_begin(unsigned int flags, MDB_txn **ret);
     void string2val(const std::string& str, MDB_val *val);
     void inline lmdb_debug(int rc, std::string op, std::string scope);
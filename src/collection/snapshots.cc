@@ -0,0 +1,257 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/collection/snapshots.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/collection/collection.h"
+#include "src/collection/backend/in_memory-per_process.h"
+#include "src/utils/thread_pool.h"
+
+
+namespace modsecurity {
+namespace collection {
+
+
+namespace {
+
+const char kMagic[] = "MSCSNAP1";
+const size_t kMagicSize = 8;
+
+/* Anything larger is taken as a corrupted file. */
+const uint32_t kMaxString = 64 * 1024 * 1024;
+
+
+void putU32(std::string *out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+
+void putU64(std::string *out, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+
+void putString(std::string *out, const std::string &s) {
+    putU32(out, s.size());
+    out->append(s);
+}
+
+
+class Reader {
+ public:
+    explicit Reader(const std::string &data) : m_data(data), m_pos(0) { }
+
+    bool u32(uint32_t *v) {
+        if (m_data.size() - m_pos < 4) {
+            return false;
+        }
+        *v = 0;
+        for (int i = 0; i < 4; i++) {
+            *v |= static_cast<uint32_t>(
+                static_cast<unsigned char>(m_data[m_pos++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool u64(uint64_t *v) {
+        if (m_data.size() - m_pos < 8) {
+            return false;
+        }
+        *v = 0;
+        for (int i = 0; i < 8; i++) {
+            *v |= static_cast<uint64_t>(
+                static_cast<unsigned char>(m_data[m_pos++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool string(std::string *s) {
+        uint32_t size;
+        if (!u32(&size) || size > kMaxString || m_data.size() - m_pos < size) {
+            return false;
+        }
+        s->assign(m_data, m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    bool done() const { return m_pos == m_data.size(); }
+
+ private:
+    const std::string &m_data;
+    size_t m_pos;
+};
+
+}  // namespace
+
+
+Snapshots::Snapshots(const std::vector<Collection *> &collections,
+    const std::string &path, int interval, int ttl)
+    : m_collections(collections),
+    m_path(path),
+    m_interval(interval),
+    m_ttl(ttl > 0 ? ttl : 0),
+    m_stop(false) {
+#ifndef MSC_NO_THREADS
+    if (m_interval > 0) {
+        m_thread = std::thread(&Snapshots::run, this);
+    }
+#endif
+}
+
+
+Snapshots::~Snapshots() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    save();
+}
+
+
+void Snapshots::run() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_cond.wait_for(lock, std::chrono::seconds(m_interval),
+        [this] { return m_stop; })) {
+        lock.unlock();
+        save();
+        lock.lock();
+    }
+}
+
+
+bool Snapshots::save() {
+    uint64_t now = std::time(NULL);
+    uint64_t expiry = m_ttl > 0 ? now + m_ttl : 0;
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string out(kMagic, kMagicSize);
+
+    putU64(&out, now);
+    for (Collection *c : m_collections) {
+        backend::InMemoryPerProcess *m =
+            dynamic_cast<backend::InMemoryPerProcess *>(c);
+        if (m == nullptr) {
+            continue;
+        }
+        m->copyEntries(&entries);
+        putString(&out, m->m_name);
+        putU64(&out, entries.size());
+        for (const auto &e : entries) {
+            putU64(&out, expiry);
+            putString(&out, e.first);
+            putString(&out, e.second);
+        }
+    }
+
+    std::string tmp = m_path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        f.write(out.data(), out.size());
+        if (!f.good()) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), m_path.c_str()) == 0;
+}
+
+
+int Snapshots::load() {
+    std::ifstream f(m_path, std::ios::binary);
+    if (!f.is_open()) {
+        return 0;
+    }
+    std::string data((std::istreambuf_iterator<char>(f)),
+        std::istreambuf_iterator<char>());
+
+    if (data.compare(0, kMagicSize, kMagic) != 0) {
+        return -1;
+    }
+    data.erase(0, kMagicSize);
+
+    /*
+     * Everything is decoded before anything is restored, so a truncated
+     * file leaves the collections untouched.
+     */
+    Reader r(data);
+    uint64_t written;
+    std::vector<std::pair<backend::InMemoryPerProcess *,
+        std::vector<std::pair<std::string, std::string>>>> restore;
+    uint64_t now = std::time(NULL);
+    int restored = 0;
+
+    if (!r.u64(&written)) {
+        return -1;
+    }
+    while (!r.done()) {
+        std::string name;
+        uint64_t count;
+        if (!r.string(&name) || !r.u64(&count)) {
+            return -1;
+        }
+
+        backend::InMemoryPerProcess *target = nullptr;
+        for (Collection *c : m_collections) {
+            if (c->m_name == name) {
+                target = dynamic_cast<backend::InMemoryPerProcess *>(c);
+            }
+        }
+        restore.emplace_back(target,
+            std::vector<std::pair<std::string, std::string>>());
+
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t expiry;
+            std::string key;
+            std::string value;
+            if (!r.u64(&expiry) || !r.string(&key) || !r.string(&value)) {
+                return -1;
+            }
+            if (target != nullptr && (expiry == 0 || expiry > now)) {
+                restore.back().second.emplace_back(std::move(key),
+                    std::move(value));
+            }
+        }
+    }
+
+    for (auto &c : restore) {
+        if (c.first != nullptr) {
+            c.first->restoreEntries(c.second);
+            restored += c.second.size();
+        }
+    }
+    return restored;
+}
+
+
+}  // namespace collection
+}  // namespace modsecurity
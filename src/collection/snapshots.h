@@ -0,0 +1,84 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SRC_COLLECTION_SNAPSHOTS_H_
+#define SRC_COLLECTION_SNAPSHOTS_H_
+
+
+namespace modsecurity {
+namespace collection {
+class Collection;
+
+
+/**
+ * Keeps the in memory persistent collections (IP, SESSION, USER, ...) in
+ * a file, so they survive a restart.
+ *
+ * The file is written every `interval' seconds by a thread of its own,
+ * and once more when the snapshots are stopped. It is replaced atomically
+ * (written aside, then renamed). Each entry carries an expiry time, the
+ * time it was written plus `ttl' seconds (0: never); expired entries are
+ * not loaded back. Collections on other backends are left out.
+ *
+ * Format, integers in little endian:
+ *
+ *   "MSCSNAP1"  u64 time written
+ *   per collection:  u32 name length, name, u64 entries
+ *     per entry:     u64 expiry, u32 key length, key,
+ *                    u32 value length, value
+ *
+ */
+class Snapshots {
+ public:
+    Snapshots(const std::vector<Collection *> &collections,
+        const std::string &path, int interval, int ttl);
+    ~Snapshots();
+
+    Snapshots(const Snapshots &s) = delete;
+    Snapshots& operator= (const Snapshots &s) = delete;
+
+    /**
+     * Restores the entries of the file, if any, that did not expire.
+     * Returns how many, or -1 if the file is not a valid snapshot.
+     */
+    int load();
+    bool save();
+
+ private:
+    void run();
+
+    std::vector<Collection *> m_collections;
+    std::string m_path;
+    int m_interval;
+    int m_ttl;
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+
+}  // namespace collection
+}  // namespace modsecurity
+
+
+#endif  // SRC_COLLECTION_SNAPSHOTS_H_
@@ -0,0 +1,247 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/data_provider.h"
+
+#if !defined(WIN32) && !defined(__EMSCRIPTEN__) && !defined(__wasi__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MSC_DATA_MMAP 1
+#endif
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "modsecurity/rules.h"
+#include "src/utils/system.h"
+
+
+namespace modsecurity {
+
+
+bool DataSpan::getline(size_t *offset, std::string *line) const {
+    if (*offset >= m_size) {
+        return false;
+    }
+    const char *start = m_data + *offset;
+    const char *end = static_cast<const char *>(
+        memchr(start, '\n', m_size - *offset));
+    size_t length = end ? end - start : m_size - *offset;
+
+    line->assign(start, length);
+    *offset += length + (end ? 1 : 0);
+    return true;
+}
+
+
+namespace {
+
+class HostSpan : public DataSpan {
+ public:
+    HostSpan(const void *data, size_t size, ModSecDataReleaseCb cb,
+        void *cbData)
+        : DataSpan(static_cast<const char *>(data), size),
+        m_cb(cb),
+        m_cbData(cbData) { }
+
+    ~HostSpan() override {
+        if (m_cb) {
+            m_cb(m_cbData, m_data, m_size);
+        }
+    }
+
+ private:
+    ModSecDataReleaseCb m_cb;
+    void *m_cbData;
+};
+
+
+#ifdef MSC_DATA_MMAP
+class MappedSpan : public DataSpan {
+ public:
+    MappedSpan(const char *data, size_t size) : DataSpan(data, size) { }
+
+    ~MappedSpan() override {
+        if (m_size > 0) {
+            munmap(const_cast<char *>(m_data), m_size);
+        }
+    }
+
+    static std::shared_ptr<DataSpan> map(const std::string &file) {
+        int fd = open(file.c_str(), O_RDONLY);
+        struct stat st;
+        void *data = nullptr;
+
+        if (fd < 0) {
+            return nullptr;
+        }
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return nullptr;
+        }
+        if (st.st_size > 0) {
+            data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+        return std::make_shared<MappedSpan>(static_cast<const char *>(data),
+            st.st_size);
+    }
+};
+#endif
+
+
+std::mutex &registeredLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+
+std::map<std::string, std::shared_ptr<DataSpan>> &registered() {
+    static std::map<std::string, std::shared_ptr<DataSpan>> spans;
+    return spans;
+}
+
+
+class DefaultDataProvider : public DataProvider {
+ public:
+    std::shared_ptr<DataSpan> get(const std::string &name,
+        const std::string &config, std::string *error) override {
+        {
+            std::lock_guard<std::mutex> lock(registeredLock());
+            auto it = registered().find(name);
+            if (it != registered().end()) {
+                return it->second;
+            }
+        }
+
+        /* Kept as long as the host keeps the map. */
+        std::unordered_map<std::string, std::string> *map =
+            wasm_data::get_data_map();
+        if (map != nullptr) {
+            auto it = map->find(name);
+            if (it != map->end()) {
+                return std::make_shared<DataSpan>(it->second.data(),
+                    it->second.size());
+            }
+        }
+
+#ifdef MSC_DATA_MMAP
+        std::string err;
+        std::string file = utils::find_resource(name, config, &err);
+        std::shared_ptr<DataSpan> span = MappedSpan::map(
+            file.empty() ? name : file);
+        if (span == nullptr) {
+            error->assign("Failed to open file: " + name + ". " + err);
+        }
+        return span;
+#else
+        error->assign("the data '" + name + "' is not found");
+        return nullptr;
+#endif
+    }
+};
+
+
+std::mutex &providerLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+
+std::shared_ptr<DataProvider> &provider() {
+    static std::shared_ptr<DataProvider> p;
+    return p;
+}
+
+}  // namespace
+
+
+std::shared_ptr<DataProvider> DataProvider::current() {
+    std::lock_guard<std::mutex> lock(providerLock());
+    if (provider() == nullptr) {
+        provider() = std::make_shared<DefaultDataProvider>();
+    }
+    return provider();
+}
+
+
+void DataProvider::set(std::shared_ptr<DataProvider> p) {
+    std::lock_guard<std::mutex> lock(providerLock());
+    provider() = p;
+}
+
+
+/**
+ * @name    msc_data_register
+ * @brief   Makes a data file available to the rules, without copying it.
+ *
+ * The rules loaded next find `data' under `name' (the file name as written
+ * in @pmFromFile, @ipMatchFromFile, @fuzzyHash or SecUnicodeMapFile). The
+ * bytes must stay valid and unchanged until `cb' is called; registering
+ * the same name again releases the previous bytes.
+ *
+ * @param name Name of the file.
+ * @param data Contents of the file.
+ * @param size Size of the contents.
+ * @param cb Called once the contents are not used anymore (can be NULL).
+ * @param cb_data Passed to cb.
+ *
+ * @returns If the file was registered or not.
+ * @retval 1 Registered.
+ * @retval 0 Missing name, or contents.
+ *
+ */
+extern "C" int msc_data_register(const char *name, const void *data,
+    size_t size, ModSecDataReleaseCb cb, void *cb_data) {
+    if (name == NULL || (data == NULL && size > 0)) {
+        return 0;
+    }
+    std::shared_ptr<DataSpan> span = std::make_shared<HostSpan>(data, size,
+        cb, cb_data);
+    std::lock_guard<std::mutex> lock(registeredLock());
+    registered()[name].swap(span);
+    return 1;
+}
+
+
+/**
+ * @name    msc_data_release
+ * @brief   Forgets every registered data file.
+ *
+ * Compiled rules do not refer to the data files anymore, so this is meant
+ * to be called once the rules are loaded: the release callbacks are called
+ * right away (or, if rules are being loaded meanwhile, as soon as they are
+ * done with the file).
+ *
+ */
+extern "C" void msc_data_release(void) {
+    std::map<std::string, std::shared_ptr<DataSpan>> spans;
+    {
+        std::lock_guard<std::mutex> lock(registeredLock());
+        spans.swap(registered());
+    }
+}
+
+
+}  // namespace modsecurity
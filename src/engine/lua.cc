@@ -121,22 +121,43 @@ const char *Lua::blob_reader(lua_State *L, void *ud, size_t *size) {
 #endif
 
 
-int Lua::run(Transaction *t, const std::string &str) {
+std::atomic<size_t> Lua::m_statePoolSize(16);
+
+
+Lua::~Lua() {
 #ifdef WITH_LUA
-    std::string luaRet;
-    const char *a = NULL;
-    int ret = true;
+    for (lua_State *L : m_states) {
+        lua_close(L);
+    }
+#endif
+}
+
+
+#ifdef WITH_LUA
+/**
+ * Takes an idle state of this script, or builds a new one: standard
+ * libraries open, the `m' library registered and the script chunk loaded,
+ * but not executed, under the registry key `msc_chunk'.
+ */
+lua_State *Lua::acquireState(Transaction *t) {
+    {
+        std::lock_guard<std::mutex> lock(m_statesLock);
+        if (!m_states.empty()) {
+            lua_State *L = m_states.back();
+            m_states.pop_back();
+            return L;
+        }
+    }
+
     lua_State *L = luaL_newstate();
     luaL_openlibs(L);
 
     luaL_newmetatable(L, "luaL_msc");
     lua_newtable(L);
 
-    lua_pushlightuserdata(L, reinterpret_cast<void *>(t));
-    lua_setglobal(L, "__transaction");
-
     luaL_setfuncs(L, mscLuaLib, 0);
     lua_setglobal(L, "m");
+    lua_setglobal(L, "modsec");
 
 #ifdef WITH_LUA_5_1
     int rc = lua_load(L, Lua::blob_reader, &m_blob, m_scriptName.c_str());
@@ -162,9 +183,72 @@ int Lua::run(Transaction *t, const std::string &str) {
         }
         e.append(lua_tostring(L, -1));
         ms_dbg_a(t, 2, e);
-        ret = false;
-        goto err;
+        lua_close(L);
+        return NULL;
+    }
+
+    lua_setfield(L, LUA_REGISTRYINDEX, "msc_chunk");
+    return L;
+}
+
+
+void Lua::releaseState(lua_State *L) {
+    lua_settop(L, 0);
+    lua_pushnil(L);
+    lua_setglobal(L, "__transaction");
+
+    {
+        std::lock_guard<std::mutex> lock(m_statesLock);
+        if (m_states.size() < m_statePoolSize) {
+            m_states.push_back(L);
+            return;
+        }
     }
+    lua_close(L);
+}
+#endif
+
+
+int Lua::run(Transaction *t, const std::string &str) {
+#ifdef WITH_LUA
+    std::string luaRet;
+    const char *a = NULL;
+    int ret = true;
+    lua_State *L = acquireState(t);
+
+    if (L == NULL) {
+        return false;
+    }
+
+    lua_pushlightuserdata(L, reinterpret_cast<void *>(t));
+    lua_setglobal(L, "__transaction");
+
+    /*
+     * The chunk runs in a fresh environment, falling back to the globals,
+     * so the globals a run defines, through _G as well, are not seen by
+     * the next one using this state. Changes made to the tables reached
+     * from there (string, m, package.loaded...) do persist, vide
+     * setStatePoolSize.
+     */
+    lua_getfield(L, LUA_REGISTRYINDEX, "msc_chunk");
+    lua_newtable(L);
+    lua_newtable(L);
+#if defined LUA_VERSION_NUM && LUA_VERSION_NUM >= 502
+    lua_pushglobaltable(L);
+#else
+    lua_pushvalue(L, LUA_GLOBALSINDEX);
+#endif
+    lua_setfield(L, -2, "__index");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "_G");
+    lua_pushvalue(L, -1);
+#if defined LUA_VERSION_NUM && LUA_VERSION_NUM >= 502
+    lua_setupvalue(L, -3, 1);
+#else
+    lua_setfenv(L, -3);
+#endif
+    lua_insert(L, -2);
 
     if (lua_pcall(L, 0, 0, 0)) {
         std::string e;
@@ -181,9 +265,7 @@ int Lua::run(Transaction *t, const std::string &str) {
         goto err;
     }
 
-    lua_setglobal(L, "modsec");
-
-    lua_getglobal(L, "main");
+    lua_getfield(L, -1, "main");
 
     ms_dbg_a(t, 1, str);
 
@@ -217,9 +299,11 @@ int Lua::run(Transaction *t, const std::string &str) {
         ret = false;
     }
 
+    releaseState(L);
+    return ret;
 
 err:
-    lua_pop(L, 1);
+    /* A state that raised an error is not trusted for the next runs. */
     lua_close(L);
 
     return ret;
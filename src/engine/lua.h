@@ -17,10 +17,13 @@
 #include <lua.hpp>
 #endif
 
+#include <atomic>
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #ifndef SRC_ENGINE_LUA_H_
 #define SRC_ENGINE_LUA_H_
@@ -66,11 +69,25 @@ class LuaScriptBlob {
 class Lua {
  public:
     Lua() { }
+    ~Lua();
 
     bool load(const std::string &script, std::string *err);
     int run(Transaction *t, const std::string &str="");
     static bool isCompatible(const std::string &script, Lua *l, std::string *error);
 
+    /**
+     * Amount of idle states, with the libraries open and the script
+     * loaded, kept by every script for its next runs. With 0 every run
+     * starts from a new state.
+     *
+     * Every run gets its own global environment, but the tables shared
+     * by the runs of a state are not copied: a script that changes them
+     * (string.x = ..., a module cached in package.loaded, the `m' table)
+     * leaves the change to the next runs. Scripts doing so need 0 here.
+     */
+    static void setStatePoolSize(size_t size) { m_statePoolSize = size; }
+    static size_t getStatePoolSize() { return m_statePoolSize; }
+
 #ifdef WITH_LUA
     static int blob_keeper(lua_State *L, const void *p, size_t sz, void *ud);
     static const char *blob_reader(lua_State *L, void *us, size_t *size);
@@ -85,6 +102,16 @@ class Lua {
     LuaScriptBlob m_blob;
 #endif
     std::string m_scriptName;
+
+ private:
+#ifdef WITH_LUA
+    lua_State *acquireState(Transaction *t);
+    void releaseState(lua_State *L);
+
+    std::mutex m_statesLock;
+    std::vector<lua_State *> m_states;
+#endif
+    static std::atomic<size_t> m_statePoolSize;
 };
 
 #ifdef WITH_LUA
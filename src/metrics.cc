@@ -0,0 +1,451 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/metrics.h"
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+
+
+namespace modsecurity {
+
+
+namespace {
+
+const size_t kShards = 8;
+const int kPhases = modsecurity::Phases::NUMBER_OF_PHASES;
+
+/*
+ * Latency buckets are log-linear: four linear buckets per power of two,
+ * from 1us (2^10 ns) up to 2^34 ns (about 17s), plus one bucket for
+ * anything faster and one for anything slower.
+ */
+const int kMinPower = 10;
+const int kMaxPower = 34;
+const int kBuckets = 1 + (kMaxPower - kMinPower) * 4 + 1;
+
+const char *kPhaseNames[kPhases] = {
+    "connection",
+    "uri",
+    "request_headers",
+    "request_body",
+    "response_headers",
+    "response_body",
+    "logging",
+};
+
+const char *kCacheNames[Metrics::NUMBER_OF_CACHES] = {
+    "negative",
+    "geo",
+    "rbl",
+};
+
+
+int bucketOf(uint64_t ns) {
+    if (ns < (1ULL << kMinPower)) {
+        return 0;
+    }
+    int power = 63 - __builtin_clzll(ns);
+    if (power >= kMaxPower) {
+        return kBuckets - 1;
+    }
+    return 1 + (power - kMinPower) * 4 + ((ns >> (power - 2)) & 3);
+}
+
+
+/* Upper bound, in nanoseconds, of every bucket but the last one. */
+uint64_t bucketBound(int bucket) {
+    if (bucket == 0) {
+        return 1ULL << kMinPower;
+    }
+    int power = kMinPower + (bucket - 1) / 4;
+    return static_cast<uint64_t>(4 + (bucket - 1) % 4 + 1) << (power - 2);
+}
+
+
+enum Counter {
+    TransactionsCounter,
+    RequestBodyBytesCounter,
+    ResponseBodyBytesCounter,
+    BodyParserErrorsCounter,
+    CacheLookupsCounter,
+    CacheHitsCounter = CacheLookupsCounter + Metrics::NUMBER_OF_CACHES,
+    NUMBER_OF_COUNTERS = CacheHitsCounter + Metrics::NUMBER_OF_CACHES
+};
+
+
+/*
+ * Fixed size, open addressing table of counters. A slot is claimed once,
+ * with a compare and swap on its key, and never released. A key probes at
+ * most kMaxProbes slots, so a full table costs no more than a busy one.
+ */
+template <size_t N>
+class KeyedCounters {
+ public:
+    KeyedCounters() : m_dropped(0) {
+        for (size_t i = 0; i < N; i++) {
+            m_keys[i] = kEmpty;
+            m_counts[i] = 0;
+        }
+    }
+
+    void add(int64_t key) {
+        size_t i = (static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ULL) >> 32;
+        for (size_t probe = 0; probe < kMaxProbes; probe++, i++) {
+            i &= N - 1;
+            int64_t k = m_keys[i].load(std::memory_order_acquire);
+            if (k == kEmpty) {
+                if (m_keys[i].compare_exchange_strong(k, key)) {
+                    k = key;
+                }
+            }
+            if (k == key) {
+                m_counts[i].fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sum(std::map<int64_t, uint64_t> *into, uint64_t *dropped) const {
+        for (size_t i = 0; i < N; i++) {
+            int64_t k = m_keys[i].load(std::memory_order_acquire);
+            if (k != kEmpty) {
+                (*into)[k] += m_counts[i].load(std::memory_order_relaxed);
+            }
+        }
+        *dropped += m_dropped.load(std::memory_order_relaxed);
+    }
+
+ private:
+    static const int64_t kEmpty = INT64_MIN;
+    static const size_t kMaxProbes = N < 16 ? N : 16;
+
+    std::atomic<int64_t> m_keys[N];
+    std::atomic<uint64_t> m_counts[N];
+    std::atomic<uint64_t> m_dropped;
+};
+
+
+struct Histogram {
+    Histogram() : m_count(0), m_sum(0) {
+        for (int i = 0; i < kBuckets; i++) {
+            m_buckets[i] = 0;
+        }
+    }
+
+    std::atomic<uint64_t> m_buckets[kBuckets];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+};
+
+
+std::atomic<size_t> threadCount(0);
+
+
+std::string seconds(uint64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", ns / 1e9);
+    return buf;
+}
+
+
+std::string escape(const std::string &s) {
+    std::string r;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            r.push_back('\\');
+        }
+        if (c == '\n') {
+            r.append("\\n");
+            continue;
+        }
+        r.push_back(c);
+    }
+    return r;
+}
+
+}  // namespace
+
+
+struct Metrics::Shard {
+    Shard() {
+        for (int i = 0; i < NUMBER_OF_COUNTERS; i++) {
+            m_counters[i] = 0;
+        }
+    }
+
+    std::atomic<uint64_t> m_counters[NUMBER_OF_COUNTERS];
+    Histogram m_phases[kPhases];
+    KeyedCounters<1024> m_rules;
+    KeyedCounters<64> m_statuses;
+};
+
+
+Metrics::Metrics()
+    : m_enabled(true) {
+    for (size_t i = 0; i < kShards; i++) {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+
+Metrics::~Metrics() { }
+
+
+Metrics::Shard *Metrics::shard() const {
+    static thread_local size_t index = threadCount.fetch_add(1) % kShards;
+    return m_shards[index].get();
+}
+
+
+void Metrics::transaction() {
+    if (isEnabled()) {
+        shard()->m_counters[TransactionsCounter].fetch_add(1,
+            std::memory_order_relaxed);
+    }
+}
+
+
+void Metrics::intervention(int status) {
+    if (isEnabled()) {
+        shard()->m_statuses.add(status);
+    }
+}
+
+
+void Metrics::ruleMatched(int64_t id) {
+    if (isEnabled()) {
+        shard()->m_rules.add(id);
+    }
+}
+
+
+void Metrics::phaseDuration(int phase, uint64_t nanoseconds) {
+    if (!isEnabled() || phase < 0 || phase >= kPhases) {
+        return;
+    }
+    Histogram &h = shard()->m_phases[phase];
+    h.m_buckets[bucketOf(nanoseconds)].fetch_add(1,
+        std::memory_order_relaxed);
+    h.m_count.fetch_add(1, std::memory_order_relaxed);
+    h.m_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+
+void Metrics::bodyBytes(bool response, size_t bytes) {
+    if (isEnabled()) {
+        shard()->m_counters[response ? ResponseBodyBytesCounter
+            : RequestBodyBytesCounter].fetch_add(bytes,
+            std::memory_order_relaxed);
+    }
+}
+
+
+void Metrics::bodyParserError() {
+    if (isEnabled()) {
+        shard()->m_counters[BodyParserErrorsCounter].fetch_add(1,
+            std::memory_order_relaxed);
+    }
+}
+
+
+void Metrics::cacheLookup(Cache cache, bool hit) {
+    if (!isEnabled()) {
+        return;
+    }
+    Shard *s = shard();
+    s->m_counters[CacheLookupsCounter + cache].fetch_add(1,
+        std::memory_order_relaxed);
+    if (hit) {
+        s->m_counters[CacheHitsCounter + cache].fetch_add(1,
+            std::memory_order_relaxed);
+    }
+}
+
+
+std::string Metrics::dump(int format,
+    const std::vector<std::pair<std::string, size_t>> &collections) const {
+    uint64_t counters[NUMBER_OF_COUNTERS] = {};
+    uint64_t buckets[kPhases][kBuckets] = {};
+    uint64_t counts[kPhases] = {};
+    uint64_t sums[kPhases] = {};
+    std::map<int64_t, uint64_t> rules;
+    std::map<int64_t, uint64_t> statuses;
+    uint64_t dropped = 0;
+
+    for (auto &s : m_shards) {
+        for (int i = 0; i < NUMBER_OF_COUNTERS; i++) {
+            counters[i] += s->m_counters[i].load(std::memory_order_relaxed);
+        }
+        for (int p = 0; p < kPhases; p++) {
+            for (int b = 0; b < kBuckets; b++) {
+                buckets[p][b] += s->m_phases[p].m_buckets[b].load(
+                    std::memory_order_relaxed);
+            }
+            counts[p] += s->m_phases[p].m_count.load(
+                std::memory_order_relaxed);
+            sums[p] += s->m_phases[p].m_sum.load(std::memory_order_relaxed);
+        }
+        s->m_rules.sum(&rules, &dropped);
+        s->m_statuses.sum(&statuses, &dropped);
+    }
+
+    std::stringstream ss;
+
+    if (format == MetricsJsonFormat) {
+        const char *sep = "";
+        ss << "{\"transactions\":" << counters[TransactionsCounter];
+        ss << ",\"interventions\":{";
+        for (auto &st : statuses) {
+            ss << sep << "\"" << st.first << "\":" << st.second;
+            sep = ",";
+        }
+        ss << "},\"rules_matched\":{";
+        sep = "";
+        for (auto &r : rules) {
+            ss << sep << "\"" << r.first << "\":" << r.second;
+            sep = ",";
+        }
+        ss << "},\"phases\":{";
+        for (int p = 0; p < kPhases; p++) {
+            ss << (p ? "," : "") << "\"" << kPhaseNames[p] \
+                << "\":{\"count\":" \
+                << counts[p] << ",\"sum_seconds\":" << seconds(sums[p]) \
+                << ",\"buckets\":[";
+            sep = "";
+            for (int b = 0; b < kBuckets; b++) {
+                if (buckets[p][b] == 0) {
+                    continue;
+                }
+                ss << sep << "[" << (b == kBuckets - 1 ? "null" :
+                    seconds(bucketBound(b))) << "," << buckets[p][b] << "]";
+                sep = ",";
+            }
+            ss << "]}";
+        }
+        ss << "},\"request_body_bytes\":" \
+            << counters[RequestBodyBytesCounter];
+        ss << ",\"response_body_bytes\":" \
+            << counters[ResponseBodyBytesCounter];
+        ss << ",\"body_parser_errors\":" \
+            << counters[BodyParserErrorsCounter];
+        ss << ",\"collections\":{";
+        sep = "";
+        for (auto &c : collections) {
+            ss << sep << "\"" << escape(c.first) << "\":" << c.second;
+            sep = ",";
+        }
+        ss << "},\"caches\":{";
+        for (int c = 0; c < NUMBER_OF_CACHES; c++) {
+            ss << (c ? "," : "") << "\"" << kCacheNames[c] \
+                << "\":{\"lookups\":" << counters[CacheLookupsCounter + c] \
+                << ",\"hits\":" << counters[CacheHitsCounter + c] << "}";
+        }
+        ss << "},\"dropped\":" << dropped << "}";
+        return ss.str();
+    }
+
+    ss << "# HELP modsecurity_transactions_total Transactions created.\n";
+    ss << "# TYPE modsecurity_transactions_total counter\n";
+    ss << "modsecurity_transactions_total " \
+        << counters[TransactionsCounter] << "\n";
+
+    ss << "# HELP modsecurity_interventions_total Disruptive " \
+        "interventions, by status.\n";
+    ss << "# TYPE modsecurity_interventions_total counter\n";
+    for (auto &st : statuses) {
+        ss << "modsecurity_interventions_total{status=\"" << st.first \
+            << "\"} " << st.second << "\n";
+    }
+
+    ss << "# HELP modsecurity_rule_matches_total Rules matched, by id.\n";
+    ss << "# TYPE modsecurity_rule_matches_total counter\n";
+    for (auto &r : rules) {
+        ss << "modsecurity_rule_matches_total{id=\"" << r.first << "\"} " \
+            << r.second << "\n";
+    }
+
+    ss << "# HELP modsecurity_phase_duration_seconds Time spent " \
+        "evaluating the rules of a phase.\n";
+    ss << "# TYPE modsecurity_phase_duration_seconds histogram\n";
+    for (int p = 0; p < kPhases; p++) {
+        uint64_t cumulative = 0;
+        for (int b = 0; b < kBuckets - 1; b++) {
+            cumulative += buckets[p][b];
+            ss << "modsecurity_phase_duration_seconds_bucket{phase=\"" \
+                << kPhaseNames[p] << "\",le=\"" \
+                << seconds(bucketBound(b)) << "\"} " << cumulative << "\n";
+        }
+        ss << "modsecurity_phase_duration_seconds_bucket{phase=\"" \
+            << kPhaseNames[p] << "\",le=\"+Inf\"} " << counts[p] << "\n";
+        ss << "modsecurity_phase_duration_seconds_sum{phase=\"" \
+            << kPhaseNames[p] << "\"} " << seconds(sums[p]) << "\n";
+        ss << "modsecurity_phase_duration_seconds_count{phase=\"" \
+            << kPhaseNames[p] << "\"} " << counts[p] << "\n";
+    }
+
+    ss << "# HELP modsecurity_body_bytes_total Body bytes inspected.\n";
+    ss << "# TYPE modsecurity_body_bytes_total counter\n";
+    ss << "modsecurity_body_bytes_total{direction=\"request\"} " \
+        << counters[RequestBodyBytesCounter] << "\n";
+    ss << "modsecurity_body_bytes_total{direction=\"response\"} " \
+        << counters[ResponseBodyBytesCounter] << "\n";
+
+    ss << "# HELP modsecurity_body_parser_errors_total Request bodies " \
+        "that failed to parse.\n";
+    ss << "# TYPE modsecurity_body_parser_errors_total counter\n";
+    ss << "modsecurity_body_parser_errors_total " \
+        << counters[BodyParserErrorsCounter] << "\n";
+
+    ss << "# HELP modsecurity_collection_entries Entries held by a " \
+        "persistent collection.\n";
+    ss << "# TYPE modsecurity_collection_entries gauge\n";
+    for (auto &c : collections) {
+        ss << "modsecurity_collection_entries{collection=\"" \
+            << escape(c.first) << "\"} " << c.second << "\n";
+    }
+
+    ss << "# HELP modsecurity_cache_lookups_total Lookups, by cache.\n";
+    ss << "# TYPE modsecurity_cache_lookups_total counter\n";
+    for (int c = 0; c < NUMBER_OF_CACHES; c++) {
+        ss << "modsecurity_cache_lookups_total{cache=\"" << kCacheNames[c] \
+            << "\"} " << counters[CacheLookupsCounter + c] << "\n";
+    }
+    ss << "# HELP modsecurity_cache_hits_total Lookups answered from the " \
+        "cache, by cache.\n";
+    ss << "# TYPE modsecurity_cache_hits_total counter\n";
+    for (int c = 0; c < NUMBER_OF_CACHES; c++) {
+        ss << "modsecurity_cache_hits_total{cache=\"" << kCacheNames[c] \
+            << "\"} " << counters[CacheHitsCounter + c] << "\n";
+    }
+
+    ss << "# HELP modsecurity_metrics_dropped_total Rule ids or statuses " \
+        "that did not fit in the metrics tables.\n";
+    ss << "# TYPE modsecurity_metrics_dropped_total counter\n";
+    ss << "modsecurity_metrics_dropped_total " << dropped << "\n";
+
+    return ss.str();
+}
+
+
+}  // namespace modsecurity
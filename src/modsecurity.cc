@@ -30,20 +30,34 @@
 #endif
 
 
+#include <atomic>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "modsecurity/rule.h"
 #include "modsecurity/rule_message.h"
 #include "src/collection/backend/in_memory-per_process.h"
 #include "src/collection/backend/lmdb.h"
+#include "src/collection/snapshots.h"
 #include "src/unique_id.h"
 #include "src/utils/regex.h"
 #include "src/utils/geo_lookup.h"
+#include "src/utils/rbl_resolver.h"
+#include "src/utils/thread_pool.h"
 #include "src/actions/transformations/transformation.h"
 
 namespace modsecurity {
 
+/*
+ * Libraries are set up by the first instance and only torn down along with
+ * the last one, a shadow rules set having an instance of its own.
+ */
+static std::atomic<int> instances(0);
+
 /**
  * @name    ModSecurity
  * @brief   Initilizes ModSecurity CPP API
@@ -79,8 +93,12 @@ ModSecurity::ModSecurity()
     m_connector(""),
     m_whoami(""),
     m_logCb(NULL),
-    m_logProperties(0) {
+    m_logProperties(0),
+    m_ruleMatchCb(NULL) {
     UniqueId::uniqueId();
+    if (instances++ > 0) {
+        return;
+    }
     srand(time(NULL));
 #ifdef MSC_WITH_CURL
     curl_global_init(CURL_GLOBAL_ALL);
@@ -92,15 +110,19 @@ ModSecurity::ModSecurity()
 
 
 ModSecurity::~ModSecurity() {
+    m_shadow.reset();
+    m_snapshots.reset();
+    if (--instances == 0) {
 #ifdef MSC_WITH_CURL
-    curl_global_cleanup();
+        curl_global_cleanup();
 #endif
 #ifdef WITH_GEOIP
-    Utils::GeoLookup::getInstance().cleanUp();
+        Utils::GeoLookup::getInstance().cleanUp();
 #endif
 #ifdef WITH_LIBXML2
-    xmlCleanupParser();
+        xmlCleanupParser();
 #endif
+    }
     delete m_global_collection;
     delete m_resource_collection;
     delete m_ip_collection;
@@ -192,8 +214,11 @@ const std::string& ModSecurity::getConnectorInformation() const {
 
 void ModSecurity::serverLog(void *data, std::shared_ptr<RuleMessage> rm) {
     if (m_logCb == NULL) {
-        std::cerr << "Server log callback is not set -- " << rm->errorLog();
-        std::cerr << std::endl;
+        if (m_ruleMatchCb == NULL) {
+            std::cerr << "Server log callback is not set -- " \
+                << rm->errorLog();
+            std::cerr << std::endl;
+        }
         return;
     }
 
@@ -412,6 +437,28 @@ void ModSecurity::setServerLogCb(ModSecLogCb cb, int properties) {
     m_logProperties = properties;
 }
 
+void ModSecurity::setRuleMatchCb(ModSecRuleMatchCb cb) {
+    m_ruleMatchCb = cb;
+}
+
+
+void ModSecurity::ruleMatched(void *data, int64_t ruleId, int phase) {
+    if (m_ruleMatchCb != NULL) {
+        m_ruleMatchCb(data, ruleId, phase);
+    }
+}
+
+
+void ModSecurity::setRblLookup(int timeoutMs, bool unknownMatches,
+    int positiveTtl, int negativeTtl) {
+    utils::RblCache &cache = utils::RblCache::getInstance();
+
+    cache.setTimeout(timeoutMs);
+    cache.setUnknownMatches(unknownMatches);
+    cache.setTtl(positiveTtl, negativeTtl);
+}
+
+
 /**
  * @name    msc_set_log_cb
  * @brief   Set the log callback functiond
@@ -428,6 +475,23 @@ extern "C" void msc_set_log_cb(ModSecurity *msc, ModSecLogCb cb) {
     msc->setServerLogCb(cb);
 }
 
+
+/**
+ * @name    msc_set_rule_match_cb
+ * @brief   Set the callback called on every rule match
+ *
+ * Reports every matched rule, including the ones that do not log, with
+ * the log callback reference of the transaction.
+ *
+ * @param msc The current ModSecurity instance
+ * @param cb The callback function, NULL to stop the reports.
+ *
+ */
+extern "C" void msc_set_rule_match_cb(ModSecurity *msc,
+    ModSecRuleMatchCb cb) {
+    msc->setRuleMatchCb(cb);
+}
+
 /**
  * @name    msc_set_connector_info
  * @brief   Set information about the connector that is using the library.
@@ -451,6 +515,25 @@ extern "C" void msc_set_connector_info(ModSecurity *msc,
 }
 
 
+/**
+ * @name    msc_set_rbl_lookup
+ * @brief   Tune the lookups made by the @rbl operator.
+ *
+ * @param msc The current ModSecurity instance
+ * @param timeout_ms How long a transaction waits for an answer.
+ * @param unknown_matches Non zero if a lookup that did not complete, or
+ *                        failed, should be taken as listed.
+ * @param positive_ttl Seconds a listed answer is kept.
+ * @param negative_ttl Seconds a not listed answer is kept.
+ *
+ */
+extern "C" void msc_set_rbl_lookup(ModSecurity *msc, int timeout_ms,
+    int unknown_matches, int positive_ttl, int negative_ttl) {
+    msc->setRblLookup(timeout_ms, unknown_matches != 0, positive_ttl,
+        negative_ttl);
+}
+
+
 /**
  * @name    msc_who_am_i
  * @brief   Return information about this ModSecurity version and platform.
@@ -468,6 +551,143 @@ extern "C" const char *msc_who_am_i(ModSecurity *msc) {
 }
 
 
+std::string ModSecurity::dumpMetrics(int format) {
+    std::vector<std::pair<std::string, size_t>> sizes;
+
+    for (collection::Collection *c : {m_global_collection,
+        m_resource_collection, m_ip_collection, m_session_collection,
+        m_user_collection}) {
+        size_t entries;
+        if (c != nullptr && c->countEntries(&entries)) {
+            sizes.emplace_back(c->m_name, entries);
+        }
+    }
+
+    return m_metrics.dump(format, sizes);
+}
+
+
+/**
+ * @name    msc_metrics_dump
+ * @brief   Render the metrics of a ModSecurity instance.
+ *
+ * Counters and latency histograms are collected for every transaction
+ * created on this instance, see the Metrics class.
+ *
+ * @param msc The current ModSecurity instance
+ * @param format MetricsPrometheusFormat or MetricsJsonFormat.
+ *
+ * @return A newly allocated string, to be released with free().
+ *
+ */
+extern "C" char *msc_metrics_dump(ModSecurity *msc, int format) {
+    return strdup(msc->dumpMetrics(format).c_str());
+}
+
+
+bool ModSecurity::setShadowRules(RulesSet *rules, double sampleRate,
+    int workers, size_t queueSize, ModSecShadowCb cb, void *cbData) {
+    m_shadow.reset();
+    if (rules == NULL) {
+        return true;
+    }
+#ifdef MSC_NO_THREADS
+    return false;
+#else
+    m_shadow.reset(new Shadow(this, rules, sampleRate, workers, queueSize,
+        cb, cbData));
+    return true;
+#endif
+}
+
+
+void ModSecurity::getShadowStats(ModSecurityShadowStats *stats) const {
+    if (m_shadow) {
+        m_shadow->stats(stats);
+    } else {
+        *stats = ModSecurityShadowStats();
+    }
+}
+
+
+/**
+ * @name    msc_set_shadow_rules
+ * @brief   Evaluate a second rules set against a sample of the traffic.
+ *
+ * Sampled transactions are evaluated again, in DetectionOnly mode, by the
+ * shadow rules set on background threads, and the rules matched by both
+ * sets are compared. The transactions of this instance never wait for it.
+ *
+ * @param msc The current ModSecurity instance
+ * @param rules The shadow rules set, NULL to detach the current one.
+ * @param sample_rate Fraction of the transactions to sample, 0 to 1.
+ * @param workers Amount of shadow threads.
+ * @param queue_size Sampled transactions allowed to wait, any more are
+ *                   dropped.
+ * @param cb Called with the rules matched by only one of the sets.
+ * @param cb_data Handed to cb.
+ *
+ * @retval 1 The shadow rules set is in place (or was detached).
+ * @retval 0 Threads are not available on this platform.
+ *
+ */
+extern "C" int msc_set_shadow_rules(ModSecurity *msc, RulesSet *rules,
+    double sample_rate, int workers, size_t queue_size, ModSecShadowCb cb,
+    void *cb_data) {
+    return msc->setShadowRules(rules, sample_rate, workers, queue_size, cb,
+        cb_data);
+}
+
+
+/**
+ * @name    msc_shadow_stats
+ * @brief   Read the counters of the shadow rules set evaluation.
+ *
+ * @param msc The current ModSecurity instance
+ * @param stats Filled with the counters, all 0 without a shadow set.
+ *
+ */
+extern "C" void msc_shadow_stats(ModSecurity *msc,
+    ModSecurityShadowStats *stats) {
+    msc->getShadowStats(stats);
+}
+
+
+int ModSecurity::setCollectionSnapshots(const char *path, int interval,
+    int ttl) {
+    m_snapshots.reset();
+    if (path == NULL || *path == '\0') {
+        return 0;
+    }
+
+    m_snapshots.reset(new collection::Snapshots({m_global_collection,
+        m_resource_collection, m_ip_collection, m_session_collection,
+        m_user_collection}, path, interval, ttl));
+    return m_snapshots->load();
+}
+
+
+/**
+ * @name    msc_set_collection_snapshots
+ * @brief   Keep the in memory persistent collections across restarts.
+ *
+ * Loads the entries of the snapshot file, then writes it every `interval'
+ * seconds from a background thread, and when the instance is cleaned up.
+ *
+ * @param msc The current ModSecurity instance
+ * @param path Snapshot file, NULL to stop taking snapshots.
+ * @param interval Seconds between two snapshots, 0 for the last one only.
+ * @param ttl Seconds a snapshot entry stays valid, 0 for ever.
+ *
+ * @return Amount of entries loaded, -1 if the file is not a valid snapshot.
+ *
+ */
+extern "C" int msc_set_collection_snapshots(ModSecurity *msc,
+    const char *path, int interval, int ttl) {
+    return msc->setCollectionSnapshots(path, interval, ttl);
+}
+
+
 /**
  * @name    msc_cleanup
  * @brief   Cleanup ModSecurity C API
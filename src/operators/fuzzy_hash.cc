@@ -15,10 +15,11 @@
 
 #include "src/operators/fuzzy_hash.h"
 
+#include <memory>
 #include <string>
 
+#include "modsecurity/data_provider.h"
 #include "src/operators/operator.h"
-#include "src/utils/system.h"
 
 namespace modsecurity {
 namespace operators {
@@ -27,9 +28,7 @@ bool FuzzyHash::init(const std::string &param2, std::string *error) {
 #ifdef WITH_SSDEEP
     std::string digit;
     std::string file;
-    std::istream *iss;
     struct fuzzy_hash_chunk *chunk, *t;
-    std::string err;
 
     auto pos = m_param.find_last_of(' ');
     if (pos == std::string::npos) {
@@ -45,16 +44,14 @@ bool FuzzyHash::init(const std::string &param2, std::string *error) {
         return false;
     }
 
-    std::string resource = utils::find_resource(file, param2, &err);
-    iss = new std::ifstream(resource, std::ios::in);
-
-    if (((std::ifstream *)iss)->is_open() == false) {
-        error->assign("Failed to open file: " + m_param + ". " + err);
-        delete iss;
+    std::shared_ptr<DataSpan> data = DataProvider::current()->get(file,
+        param2, error);
+    if (data == nullptr) {
         return false;
     }
 
-    for (std::string line; std::getline(*iss, line); ) {
+    size_t offset = 0;
+    for (std::string line; data->getline(&offset, &line); ) {
        chunk = (struct fuzzy_hash_chunk *)calloc(1,
             sizeof(struct fuzzy_hash_chunk));
 
@@ -74,7 +71,6 @@ bool FuzzyHash::init(const std::string &param2, std::string *error) {
         }
     }
 
-    delete iss;
     return true;
 #else
     error->assign("@fuzzyHash: SSDEEP support was not enabled " \
@@ -40,8 +40,15 @@ bool GeoLookup::evaluate(Transaction *trans, const std::string &exp) {
     bool ret = true;
 
     if (trans) {
+        /* The GEO collection already holds what this address resolves to. */
+        if (trans->m_geoLookupResult != -1
+            && trans->m_geoLookupAddress == exp) {
+            return trans->m_geoLookupResult == 1;
+        }
         ret = Utils::GeoLookup::getInstance().lookup(exp, trans,
             std::bind(&GeoLookup::debug, this, trans, _1, _2));
+        trans->m_geoLookupAddress = exp;
+        trans->m_geoLookupResult = ret ? 1 : 0;
     } else {
         ret = Utils::GeoLookup::getInstance().lookup(exp, NULL,
             nullptr);
@@ -14,8 +14,8 @@
  */
 
 #include "src/operators/ip_match_from_file.h"
-#include "src/utils/system.h"
 
+#include <memory>
 #include <string>
 
 #include <string.h>
@@ -34,11 +34,12 @@ bool IpMatchFromFile::init(const std::string &file,
     if (m_param.compare(0, 8, "https://") == 0) {
         res = m_tree.addFromUrl(m_param, &e);
     } else {
-        std::string resf = utils::find_resource(m_param, file, error);
-        if (resf == "") {
+        std::shared_ptr<DataSpan> data = DataProvider::current()->get(
+            m_param, file, error);
+        if (data == nullptr) {
             return false;
         }
-        res = m_tree.addFromFile(resf, &e);
+        res = m_tree.addFromData(*data, &e);
     }
 
     if (res == false) {
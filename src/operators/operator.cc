@@ -44,6 +44,7 @@
 #include "src/operators/pm_f.h"
 #include "src/operators/pm_from_file.h"
 #include "src/operators/pm.h"
+#include "src/operators/rate_limit.h"
 #include "src/operators/rbl.h"
 #include "src/operators/rsub.h"
 #include "src/operators/rx.h"
@@ -167,6 +168,7 @@ Operator *Operator::instantiate(const std::string& op, const std::string& param_
     IF_MATCH(pmfromfile) { return new PmFromFile(std::move(param)); }
     IF_MATCH(pmf) { return new PmF(std::move(param)); }
     IF_MATCH(pm) { return new Pm(std::move(param)); }
+    IF_MATCH(ratelimit) { return new RateLimit(std::move(param)); }
     IF_MATCH(rbl) { return new Rbl(std::move(param)); }
     IF_MATCH(rsub) { return new Rsub(std::move(param)); }
     IF_MATCH(rx) { return new Rx(std::move(param)); }
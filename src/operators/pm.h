@@ -52,12 +52,6 @@ class Pm : public Operator {
 
  protected:
     ACMP *m_p;
-
-#ifdef MODSEC_MUTEX_ON_PM
-
- private:
-    pthread_mutex_t m_lock;
-#endif
 };
 
 
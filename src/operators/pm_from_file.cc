@@ -15,11 +15,11 @@
 
 #include "src/operators/pm_from_file.h"
 
+#include <memory>
 #include <string>
 
+#include "modsecurity/data_provider.h"
 #include "src/operators/operator.h"
-#include "src/utils/https_client.h"
-#include "src/utils/system.h"
 
 
 namespace modsecurity {
@@ -44,61 +44,16 @@ bool PmFromFile::isComment(const std::string &s) {
 }
 
 bool PmFromFile::init(const std::string &config, std::string *error) {
-    // std::istream *iss;
-
-    // if (m_param.compare(0, 8, "https://") == 0) {
-    //     Utils::HttpsClient client;
-    //     bool ret = client.download(m_param);
-    //     if (ret == false) {
-    //         error->assign(client.error);
-    //         return false;
-    //     }
-    //     iss = new std::stringstream(client.content);
-    // } else {
-    //     std::string err;
-    //     std::string resource = utils::find_resource(m_param, config, &err);
-    //     iss = new std::ifstream(resource, std::ios::in);
-
-    //     if (((std::ifstream *)iss)->is_open() == false) {
-    //         error->assign("Failed to open file: " + m_param + ". " + err);
-    //         delete iss;
-    //         return false;
-    //     }
-    // }
-
-    // for (std::string line; std::getline(*iss, line); ) {
-    //     if (isComment(line) == false) {
-    //         acmp_add_pattern(m_p, line.c_str(), NULL, NULL, line.length());
-	// }
-    // }
-
-    // while (m_p->is_failtree_done == 0) {
-    //     acmp_prepare(m_p);
-    // }
-
-    // delete iss;
-    // return true;
-
-
-    std::unordered_map<std::string, std::string>* map_ptr = wasm_data::get_data_map();
-    if (map_ptr == nullptr) {
-        error->assign("data map is not set");
-        return false;
-    }
-
-    auto it = map_ptr->find(m_param);
-    if (it == map_ptr->end()) {
-        error->assign("the data '" + m_param + "' is not found");
+    std::shared_ptr<DataSpan> data = DataProvider::current()->get(m_param,
+        config, error);
+    if (data == nullptr) {
         return false;
     }
 
-    std::string data_value = it->second;
-    if (!data_value.empty()) {
-        std::istringstream data_stream(data_value);
-        for (std::string line; std::getline(data_stream, line); ) {
-            if (isComment(line) == false) {
-                acmp_add_pattern(m_p, line.c_str(), NULL, NULL, line.length());
-            }
+    size_t offset = 0;
+    for (std::string line; data->getline(&offset, &line); ) {
+        if (isComment(line) == false) {
+            acmp_add_pattern(m_p, line.c_str(), NULL, NULL, line.length());
         }
     }
 
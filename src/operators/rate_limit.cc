@@ -0,0 +1,141 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+
+#include "src/operators/rate_limit.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "modsecurity/collection/collection.h"
+#include "modsecurity/rule_with_actions.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "src/operators/operator.h"
+#include "src/utils/string.h"
+
+namespace modsecurity {
+namespace operators {
+
+
+bool RateLimit::init(const std::string &file, std::string *error) {
+    std::string err;
+
+    if (!parse(m_param, &m_collection, &m_period, &m_limit, &err)) {
+        error->assign("@rateLimit: " + err);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool RateLimit::evaluate(Transaction *t, RuleWithActions *rule,
+    const std::string &str, std::shared_ptr<RuleMessage> ruleMessage) {
+    if (count(t, rule, m_collection, str, m_period, m_limit)) {
+        return false;
+    }
+
+    ms_dbg_a(t, 4, "@rateLimit: '" + str + "' is over " \
+        + std::to_string(m_limit) + " event(s) per " \
+        + std::to_string(m_period / 1000000) + "s.");
+    return true;
+}
+
+
+bool RateLimit::parse(const std::string &param, std::string *collection,
+    int64_t *period, int64_t *limit, std::string *error) {
+    std::string p(param);
+    char *end = NULL;
+    int64_t window;
+
+    p.erase(std::remove_if(p.begin(), p.end(), ::isspace), p.end());
+    std::vector<std::string> args = utils::string::split(p, ',');
+
+    if (args.size() != 3) {
+        error->assign("expected collection,window,limit; got: " + param);
+        return false;
+    }
+
+    *collection = utils::string::tolower(args[0]);
+    if (*collection != "global" && *collection != "ip"
+        && *collection != "resource" && *collection != "session"
+        && *collection != "user") {
+        error->assign("not a persistent collection: " + args[0]);
+        return false;
+    }
+
+    const std::string &w = args[1];
+    window = std::strtoll(w.c_str(), &end, 10);
+    std::string unit(end);
+    if (end == w.c_str() || window <= 0) {
+        error->assign("not a valid window: " + args[1]);
+        return false;
+    }
+    if (unit == "h") {
+        window *= 3600;
+    } else if (unit == "m") {
+        window *= 60;
+    } else if (unit != "" && unit != "s") {
+        error->assign("not a valid window: " + args[1]);
+        return false;
+    }
+    *period = window * 1000000;
+
+    const std::string &l = args[2];
+    *limit = std::strtoll(l.c_str(), &end, 10);
+    if (end == l.c_str() || *end != '\0' || *limit <= 0) {
+        error->assign("not a valid limit: " + args[2]);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool RateLimit::count(Transaction *t, RuleWithActions *rule,
+    const std::string &collection, const std::string &value,
+    int64_t period, int64_t limit) {
+    collection::Collection *c;
+
+    if (collection == "ip") {
+        c = t->m_collections.m_ip_collection;
+    } else if (collection == "session") {
+        c = t->m_collections.m_session_collection;
+    } else if (collection == "user") {
+        c = t->m_collections.m_user_collection;
+    } else if (collection == "resource") {
+        c = t->m_collections.m_resource_collection;
+    } else {
+        c = t->m_collections.m_global_collection;
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    /* LMDB::expireRateLimits() looks for this key. */
+    std::string key = "RATELIMIT_"
+        + std::to_string(rule ? rule->m_ruleId : 0);
+
+    return c->rateLimit(key, value, t->m_rules->m_secWebAppId.m_value, now,
+        period, limit);
+}
+
+
+}  // namespace operators
+}  // namespace modsecurity
@@ -0,0 +1,85 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+
+#ifndef SRC_OPERATORS_RATE_LIMIT_H_
+#define SRC_OPERATORS_RATE_LIMIT_H_
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <utility>
+
+#include "src/operators/operator.h"
+
+
+namespace modsecurity {
+namespace operators {
+
+/**
+ * @rateLimit collection,window,limit
+ *
+ * Matches once the value it is given (e.g. REMOTE_ADDR) was seen more than
+ * `limit' times in the last `window' (seconds, or with an s/m/h suffix).
+ * The counter is the theoretical arrival time of the generic cell rate
+ * algorithm, kept in the given persistent collection (global, ip,
+ * resource, session or user) under the value and the rule id; the backend
+ * reads and updates it at once.
+ *
+ *   SecRule REMOTE_ADDR "@rateLimit ip,60s,100" \
+ *       "id:1,phase:1,deny,status:429"
+ *
+ * The @rateLimit token still has to be added to seclang-scanner.ll, along
+ * with a regenerated seclang-scanner.cc; until then the operator is only
+ * reachable through Operator::instantiate().
+ *
+ */
+class RateLimit : public Operator {
+ public:
+    /** @ingroup ModSecurity_Operator */
+    explicit RateLimit(std::unique_ptr<RunTimeString> param)
+        : Operator("RateLimit", std::move(param)),
+        m_period(0),
+        m_limit(0) { }
+    bool init(const std::string &file, std::string *error) override;
+    bool evaluate(Transaction *transaction, RuleWithActions *rule,
+        const std::string &str,
+        std::shared_ptr<RuleMessage> ruleMessage) override;
+
+    /**
+     * Parses "collection,window,limit". The window is returned in microseconds.
+     */
+    static bool parse(const std::string &param, std::string *collection,
+        int64_t *period, int64_t *limit, std::string *error);
+
+    /**
+     * Counts one event of `rule' for `value' in the persistent collection
+     * named `collection'. Returns false if the event is over the limit.
+     */
+    static bool count(Transaction *transaction, RuleWithActions *rule,
+        const std::string &collection, const std::string &value,
+        int64_t period, int64_t limit);
+
+ private:
+    std::string m_collection;
+    int64_t m_period;
+    int64_t m_limit;
+};
+
+}  // namespace operators
+}  // namespace modsecurity
+
+
+#endif  // SRC_OPERATORS_RATE_LIMIT_H_
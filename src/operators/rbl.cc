@@ -21,10 +21,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include <cstring>
 #include <string>
 
 #include "modsecurity/rules_set.h"
 #include "src/operators/operator.h"
+#include "src/utils/rbl_resolver.h"
 
 namespace modsecurity {
 namespace operators {
@@ -69,13 +71,16 @@ std::string Rbl::mapIpToAddress(const std::string &ipStr, Transaction *trans) co
 
 void Rbl::futherInfo_httpbl(struct sockaddr_in *sin, const std::string &ipStr,
     Transaction *trans) {
-    char *respBl;
+    char respBl[INET_ADDRSTRLEN];
     int first, days, score, type;
 #ifndef NO_LOGS
     std::string ptype;
 #endif
 
-    respBl = inet_ntoa(sin->sin_addr);
+    if (inet_ntop(AF_INET, &sin->sin_addr, respBl, sizeof(respBl)) == NULL) {
+        ms_dbg_a(trans, 4, "RBL lookup of " + ipStr + " failed: bad response");
+        return;
+    }
 
     if (sscanf(respBl, "%d.%d.%d.%d", &first, &days, &score, &type) != 4) {
         ms_dbg_a(trans, 4, "RBL lookup of " + ipStr + " failed: bad response");
@@ -203,29 +208,41 @@ void Rbl::furtherInfo(struct sockaddr_in *sin, const std::string &ipStr,
 bool Rbl::evaluate(Transaction *t, RuleWithActions *rule,
         const std::string& ipStr,
         std::shared_ptr<RuleMessage> ruleMessage) {
-    struct addrinfo *info = NULL;
+    utils::RblCache &cache = utils::RblCache::getInstance();
     std::string host = Rbl::mapIpToAddress(ipStr, t);
-    int rc = 0;
+    uint32_t address = 0;
+    bool cached = false;
 
     if (host.empty()) {
         return false;
     }
 
-    rc = 0;
-
-    if (rc != 0) {
-        if (info != NULL) {
-            freeaddrinfo(info);
-        }
-        ms_dbg_a(t, 5, "RBL lookup of " + ipStr + " failed.");
-        return false;
+    utils::RblCache::Result result = cache.lookup(host, &address, &cached);
+    if (t && t->m_ms) {
+        t->m_ms->m_metrics.cacheLookup(Metrics::RblCache, cached);
     }
 
-    struct sockaddr *addr = info->ai_addr;
-    struct sockaddr_in *sin = (struct sockaddr_in *) addr;
-    furtherInfo(sin, ipStr, t, m_provider);
+    switch (result) {
+        case utils::RblCache::NotListed:
+            ms_dbg_a(t, 5, "RBL lookup of " + ipStr + " failed.");
+            return false;
+        case utils::RblCache::Unknown:
+            ms_dbg_a(t, 4, "RBL lookup of " + ipStr + " did not complete, " \
+                "assuming it is " + \
+                (cache.unknownMatches() ? "listed." : "not listed."));
+            if (!cache.unknownMatches()) {
+                return false;
+            }
+            break;
+        case utils::RblCache::Listed:
+            struct sockaddr_in sin;
+            memset(&sin, 0, sizeof(sin));
+            sin.sin_family = AF_INET;
+            sin.sin_addr.s_addr = address;
+            furtherInfo(&sin, ipStr, t, m_provider);
+            break;
+    }
 
-    freeaddrinfo(info);
     if (rule && t && rule->hasCaptureAction()) {
         t->m_collections.m_tx_collection->storeOrUpdateFirst(
         "0", std::string(ipStr));
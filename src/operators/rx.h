@@ -37,26 +37,26 @@ class Rx : public Operator {
  public:
     /** @ingroup ModSecurity_Operator */
     explicit Rx(std::unique_ptr<RunTimeString> param)
-        : m_re(nullptr),
-        Operator("Rx", std::move(param)) {
+        : Operator("Rx", std::move(param)) {
             m_couldContainsMacro = true;
         }
 
-    ~Rx() {
-        if (m_string->m_containsMacro == false && m_re != NULL) {
-            delete m_re;
-            m_re = NULL;
-        }
-    }
-
     bool evaluate(Transaction *transaction, RuleWithActions *rule,
         const std::string& input,
         std::shared_ptr<RuleMessage> ruleMessage) override;
 
     bool init(const std::string &arg, std::string *error) override;
 
+    /**
+     * Whether the (macro free) expression failed to compile, in which case
+     * every evaluation is a miss that gets logged.
+     */
+    bool hasError() const {
+        return m_re && m_re->hasError();
+    }
+
  private:
-    Regex *m_re;
+    std::shared_ptr<const Regex> m_re;
 };
 
 
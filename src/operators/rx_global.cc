@@ -29,7 +29,7 @@ namespace operators {
 
 bool RxGlobal::init(const std::string &arg, std::string *error) {
     if (m_string->m_containsMacro == false) {
-        m_re = new Regex(m_param);
+        m_re = Regex::shared(m_param);
     }
 
     return true;
@@ -38,7 +38,8 @@ bool RxGlobal::init(const std::string &arg, std::string *error) {
 
 bool RxGlobal::evaluate(Transaction *transaction, RuleWithActions *rule,
     const std::string& input, std::shared_ptr<RuleMessage> ruleMessage) {
-    Regex *re;
+    const Regex *re;
+    std::unique_ptr<Regex> expanded;
 
     if (m_param.empty() && !m_string->m_containsMacro) {
         return true;
@@ -46,9 +47,10 @@ bool RxGlobal::evaluate(Transaction *transaction, RuleWithActions *rule,
 
     if (m_string->m_containsMacro) {
         std::string eparam(m_string->evaluate(transaction));
-        re = new Regex(eparam);
+        expanded.reset(new Regex(eparam));
+        re = expanded.get();
     } else {
-        re = m_re;
+        re = m_re.get();
     }
 
     std::vector<Utils::SMatchCapture> captures;
@@ -69,10 +71,6 @@ bool RxGlobal::evaluate(Transaction *transaction, RuleWithActions *rule,
         logOffset(ruleMessage, capture.m_offset, capture.m_length);
     }
 
-    if (m_string->m_containsMacro) {
-        delete re;
-    }
-
     if (captures.size() > 0) {
         return true;
     }
@@ -37,18 +37,10 @@ class RxGlobal : public Operator {
  public:
     /** @ingroup ModSecurity_Operator */
     explicit RxGlobal(std::unique_ptr<RunTimeString> param)
-        : m_re(nullptr),
-        Operator("RxGlobal", std::move(param)) {
+        : Operator("RxGlobal", std::move(param)) {
             m_couldContainsMacro = true;
         }
 
-    ~RxGlobal() {
-        if (m_string->m_containsMacro == false && m_re != NULL) {
-            delete m_re;
-            m_re = NULL;
-        }
-    }
-
     bool evaluate(Transaction *transaction, RuleWithActions *rule,
         const std::string& input,
         std::shared_ptr<RuleMessage> ruleMessage) override;
@@ -56,7 +48,7 @@ class RxGlobal : public Operator {
     bool init(const std::string &arg, std::string *error) override;
 
  private:
-    Regex *m_re;
+    std::shared_ptr<const Regex> m_re;
 };
 
 
@@ -3222,7 +3222,7 @@ namespace yy {
         }
 
         file = modsecurity::utils::find_resource(f, *yystack_[0].location.end.filename, &err);
-        if (file.empty()) {
+        if (file.empty() && !ConfigUnicodeMap::isAvailable(f)) {
             std::stringstream ss;
             ss << "Failed to locate the unicode map file from: " << f << " ";
             ss << err;
@@ -3230,7 +3230,7 @@ namespace yy {
             YYERROR;
         }
 
-        ConfigUnicodeMap::loadConfig(file, num, &driver, &error);
+        ConfigUnicodeMap::loadConfig(file.empty() ? f : file, num, &driver, &error);
 
         if (!error.empty()) {
             driver.error(yystack_[1].location, error);
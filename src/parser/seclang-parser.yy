@@ -1750,7 +1750,7 @@ expression:
         }
 
         file = modsecurity::utils::find_resource(f, *@1.end.filename, &err);
-        if (file.empty()) {
+        if (file.empty() && !ConfigUnicodeMap::isAvailable(f)) {
             std::stringstream ss;
             ss << "Failed to locate the unicode map file from: " << f << " ";
             ss << err;
@@ -1758,7 +1758,7 @@ expression:
             YYERROR;
         }
 
-        ConfigUnicodeMap::loadConfig(file, num, &driver, &error);
+        ConfigUnicodeMap::loadConfig(file.empty() ? f : file, num, &driver, &error);
 
         if (!error.empty()) {
             driver.error(@0, error);
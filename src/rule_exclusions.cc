@@ -0,0 +1,173 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/rule_exclusions.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rule_with_actions.h"
+#include "modsecurity/rules_set_phases.h"
+#include "src/actions/tag.h"
+
+
+namespace modsecurity {
+
+
+void RuleIdIndex::build(RulesSetPhases *phases) {
+    m_ids.clear();
+    m_ordinals.clear();
+
+    for (int phase = 0; phase < modsecurity::Phases::NUMBER_OF_PHASES;
+        phase++) {
+        Rules *rules = phases->at(phase);
+        for (int i = 0; i < rules->size(); i++) {
+            RuleWithActions *rule = dynamic_cast<RuleWithActions *>(
+                rules->at(i).get());
+            while (rule != nullptr) {
+                m_ids.push_back(rule->m_ruleId);
+                rule = rule->m_chainedRuleChild.get();
+            }
+        }
+    }
+
+    std::sort(m_ids.begin(), m_ids.end());
+    m_ids.erase(std::unique(m_ids.begin(), m_ids.end()), m_ids.end());
+    m_ordinals.reserve(m_ids.size());
+    for (size_t i = 0; i < m_ids.size(); i++) {
+        m_ordinals[m_ids[i]] = i;
+    }
+}
+
+
+bool RuleIdIndex::ordinal(int64_t id, size_t *ordinal) const {
+    auto it = m_ordinals.find(id);
+    if (it == m_ordinals.end()) {
+        return false;
+    }
+    *ordinal = it->second;
+    return true;
+}
+
+
+void RuleIdIndex::range(int64_t from, int64_t to, size_t *first,
+    size_t *last) const {
+    *first = std::lower_bound(m_ids.begin(), m_ids.end(), from)
+        - m_ids.begin();
+    *last = std::upper_bound(m_ids.begin(), m_ids.end(), to)
+        - m_ids.begin();
+}
+
+
+void RuleExclusions::removeById(int64_t id) {
+    size_t o;
+    if (m_index == nullptr || !m_index->ordinal(id, &o)) {
+        return;
+    }
+    m_removed.resize(m_index->size());
+    m_removed[o] = true;
+    m_removedAny = true;
+}
+
+
+void RuleExclusions::removeByIdRange(int64_t from, int64_t to) {
+    size_t first, last;
+    if (m_index == nullptr) {
+        return;
+    }
+    m_index->range(from, to, &first, &last);
+    if (first >= last) {
+        return;
+    }
+    m_removed.resize(m_index->size());
+    std::fill(m_removed.begin() + first, m_removed.begin() + last, true);
+    m_removedAny = true;
+}
+
+
+void RuleExclusions::removeByTag(const std::string &tag) {
+    m_removedTags.insert(tag);
+}
+
+
+void RuleExclusions::removeTargetById(int64_t id,
+    const std::string &target) {
+    m_targetsById[id].insert(target);
+    m_version++;
+}
+
+
+void RuleExclusions::removeTargetByTag(const std::string &tag,
+    const std::string &target) {
+    m_targetsByTag[tag].insert(target);
+    m_version++;
+}
+
+
+bool RuleExclusions::isRemovedById(int64_t id) const {
+    size_t o;
+    return m_removedAny && m_index->ordinal(id, &o) && m_removed[o];
+}
+
+
+bool RuleExclusions::isRemovedByTag(RuleWithActions *rule,
+    Transaction *t) const {
+    if (m_removedTags.empty()) {
+        return false;
+    }
+    for (actions::Tag *tag : rule->getTags()) {
+        if (tag != nullptr && m_removedTags.count(tag->getName(t)) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool RuleExclusions::Targets::contains(const std::string &target) {
+    if (m_version != m_exclusions->m_version) {
+        m_sets.clear();
+
+        auto id = m_exclusions->m_targetsById.find(m_rule->m_ruleId);
+        if (id != m_exclusions->m_targetsById.end()) {
+            m_sets.push_back(&id->second);
+        }
+        if (!m_exclusions->m_targetsByTag.empty()) {
+            for (actions::Tag *tag : m_rule->getTags()) {
+                if (tag == nullptr) {
+                    continue;
+                }
+                auto t = m_exclusions->m_targetsByTag.find(
+                    tag->getName(m_transaction));
+                if (t != m_exclusions->m_targetsByTag.end()) {
+                    m_sets.push_back(&t->second);
+                }
+            }
+        }
+        m_version = m_exclusions->m_version;
+    }
+
+    for (const std::unordered_set<std::string> *s : m_sets) {
+        if (s->count(target) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+}  // namespace modsecurity
@@ -41,6 +41,11 @@
 #include "src/actions/multi_match.h"
 #include "src/actions/set_var.h"
 #include "src/actions/block.h"
+#include "src/actions/log.h"
+#include "src/actions/no_log.h"
+#include "src/actions/audit_log.h"
+#include "src/actions/no_audit_log.h"
+#include "src/actions/disruptive/pass.h"
 #include "src/variables/variable.h"
 
 
@@ -322,7 +327,8 @@ inline void RuleWithActions::executeTransformation(
     std::string newValue = a->evaluate(*oldValue, trans);
 
     if (newValue != *oldValue) {
-        std::shared_ptr<std::string> u(new std::string(newValue));
+        std::shared_ptr<std::string> u =
+            std::make_shared<std::string>(std::move(newValue));
         if (m_containsMultiMatchAction) {
             ret->push_back(std::make_pair(u, a->m_name));
             (*nth)++;
@@ -339,7 +345,7 @@ inline void RuleWithActions::executeTransformation(
     ms_dbg_a(trans, 9, " T (" + \
         std::to_string(*nth) + ") " + \
         *a->m_name.get() + ": \"" + \
-        utils::string::limitTo(80, newValue) +"\"");
+        utils::string::limitTo(80, **value) +"\"");
 }
 
 void RuleWithActions::executeTransformations(
@@ -427,10 +433,33 @@ void RuleWithActions::executeTransformations(
     }
 
     if (!m_containsMultiMatchAction) {
-        ret.push_back(std::make_pair(
-            std::shared_ptr<std::string>(new std::string(*value)),
-            std::shared_ptr<std::string>(new std::string(path))));
+        ret.push_back(std::make_pair(value,
+            std::make_shared<std::string>(std::move(path))));
+    }
+}
+
+
+bool RuleWithActions::hasSideEffectFreeActions() const {
+    if (m_containsCaptureAction || m_containsStaticBlockAction
+        || !m_actionsSetVar.empty()) {
+        return false;
     }
+
+    if (m_disruptiveAction != nullptr
+        && !dynamic_cast<actions::disruptive::Pass *>(m_disruptiveAction)) {
+        return false;
+    }
+
+    for (Action *a : m_actionsRuntimePos) {
+        if (!dynamic_cast<actions::Log *>(a)
+            && !dynamic_cast<actions::NoLog *>(a)
+            && !dynamic_cast<actions::AuditLog *>(a)
+            && !dynamic_cast<actions::NoAuditLog *>(a)) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 
@@ -40,6 +40,37 @@
 #include "src/actions/multi_match.h"
 #include "src/actions/set_var.h"
 #include "src/actions/block.h"
+#include "src/operators/begins_with.h"
+#include "src/operators/contains.h"
+#include "src/operators/contains_word.h"
+#include "src/operators/detect_sqli.h"
+#include "src/operators/detect_xss.h"
+#include "src/operators/ends_with.h"
+#include "src/operators/eq.h"
+#include "src/operators/ge.h"
+#include "src/operators/gt.h"
+#include "src/operators/ip_match.h"
+#include "src/operators/le.h"
+#include "src/operators/lt.h"
+#include "src/operators/no_match.h"
+#include "src/operators/pm.h"
+#include "src/operators/rx.h"
+#include "src/operators/str_eq.h"
+#include "src/operators/str_match.h"
+#include "src/operators/unconditional_match.h"
+#include "src/operators/validate_byte_range.h"
+#include "src/operators/validate_url_encoding.h"
+#include "src/operators/validate_utf8_encoding.h"
+#include "src/operators/verify_cc.h"
+#include "src/operators/verify_cpf.h"
+#include "src/operators/verify_ssn.h"
+#include "src/operators/verify_svnr.h"
+#include "src/operators/within.h"
+#include "src/utils/negative_cache.h"
+#include "src/utils/tracepoints.h"
+#include "src/variables/request_file_name.h"
+#include "src/variables/request_method.h"
+#include "src/variables/server_name.h"
 #include "src/variables/variable.h"
 
 
@@ -59,7 +90,53 @@ RuleWithOperator::RuleWithOperator(Operator *op,
     int lineNumber)
     : RuleWithActions(actions, transformations, std::move(fileName), lineNumber),
     m_variables(_variables),
-    m_operator(op) { /* */ }
+    m_operator(op),
+    m_transactionFreeOperator(false),
+    m_cacheableOperator(false) {
+    /*
+     * Operators that reach a decision looking only at their (macro free)
+     * parameter and at the value: no need for a transaction, and the same
+     * value always gets the same answer.
+     */
+    if (op == NULL || (op->m_string && op->m_string->containsMacro())) {
+        return;
+    }
+    m_transactionFreeOperator = dynamic_cast<operators::Rx *>(op)
+        || dynamic_cast<operators::Pm *>(op)
+        || dynamic_cast<operators::Contains *>(op)
+        || dynamic_cast<operators::ContainsWord *>(op)
+        || dynamic_cast<operators::BeginsWith *>(op)
+        || dynamic_cast<operators::EndsWith *>(op)
+        || dynamic_cast<operators::StrEq *>(op)
+        || dynamic_cast<operators::StrMatch *>(op)
+        || dynamic_cast<operators::Within *>(op)
+        || dynamic_cast<operators::Eq *>(op)
+        || dynamic_cast<operators::Ge *>(op)
+        || dynamic_cast<operators::Gt *>(op)
+        || dynamic_cast<operators::Le *>(op)
+        || dynamic_cast<operators::Lt *>(op)
+        || dynamic_cast<operators::DetectSQLi *>(op)
+        || dynamic_cast<operators::DetectXSS *>(op)
+        || dynamic_cast<operators::ValidateByteRange *>(op)
+        || dynamic_cast<operators::ValidateUrlEncoding *>(op)
+        || dynamic_cast<operators::ValidateUtf8Encoding *>(op)
+        || dynamic_cast<operators::IpMatch *>(op)
+        || dynamic_cast<operators::UnconditionalMatch *>(op)
+        || dynamic_cast<operators::NoMatch *>(op)
+        || dynamic_cast<operators::VerifyCC *>(op)
+        || dynamic_cast<operators::VerifyCPF *>(op)
+        || dynamic_cast<operators::VerifySSN *>(op)
+        || dynamic_cast<operators::VerifySVNR *>(op);
+    /*
+     * An expression that does not compile is a miss for every value, but
+     * one that has to be logged each time: not worth a cache entry.
+     */
+    operators::Rx *rx = dynamic_cast<operators::Rx *>(op);
+    m_cacheableOperator = m_transactionFreeOperator
+        && !dynamic_cast<operators::UnconditionalMatch *>(op)
+        && !dynamic_cast<operators::NoMatch *>(op)
+        && !(rx && rx->hasError());
+}
 
 
 RuleWithOperator::~RuleWithOperator() {
@@ -113,7 +190,11 @@ bool RuleWithOperator::executeOperatorAt(Transaction *trans, const std::string &
         utils::string::toHexIfNeeded(value)) \
         + "\" (Variable: " + key + ")");
 
+    MSC_TRACE3(operator__begin, trans->m_id->c_str(),
+        m_operator->m_op.c_str(), value.size());
     ret = this->m_operator->evaluateInternal(trans, this, value, ruleMessage);
+    MSC_TRACE3(operator__end, trans->m_id->c_str(),
+        m_operator->m_op.c_str(), ret);
 
     if (ret == false) {
         return false;
@@ -179,6 +260,7 @@ void RuleWithOperator::getVariablesExceptions(Transaction *t,
 inline void RuleWithOperator::getFinalVars(variables::Variables *vars,
     variables::Variables *exclusion, Transaction *trans) {
     variables::Variables addition;
+    RuleExclusions::Targets removed(&trans->m_ruleExclusions, this, trans);
     getVariablesExceptions(trans, exclusion, &addition);
 
     for (int i = 0; i < m_variables->size(); i++) {
@@ -186,21 +268,7 @@ inline void RuleWithOperator::getFinalVars(variables::Variables *vars,
         if (exclusion->contains(variable)) {
             continue;
         }
-        if (std::find_if(trans->m_ruleRemoveTargetById.begin(),
-                trans->m_ruleRemoveTargetById.end(),
-                [&, variable, this](std::pair<int, std::string> &m) -> bool {
-                    return m.first == m_ruleId
-                        && m.second == *variable->m_fullName.get();
-                }) != trans->m_ruleRemoveTargetById.end()) {
-            continue;
-        }
-        if (std::find_if(trans->m_ruleRemoveTargetByTag.begin(),
-                    trans->m_ruleRemoveTargetByTag.end(),
-                    [&, variable, trans, this](
-                        std::pair<std::string, std::string> &m) -> bool {
-                        return containsTag(m.first, trans)
-                            && m.second == *variable->m_fullName.get();
-                    }) != trans->m_ruleRemoveTargetByTag.end()) {
+        if (removed.contains(*variable->m_fullName.get())) {
             continue;
         }
         vars->push_back(variable);
@@ -213,53 +281,53 @@ inline void RuleWithOperator::getFinalVars(variables::Variables *vars,
 }
 
 
+// FIXME: Make a class runTimeException to handle this cases.
+bool RuleWithOperator::isRemovedAtRuntime(Transaction *trans) {
+    if (trans->m_ruleExclusions.isRemovedById(m_ruleId)) {
+        ms_dbg_a(trans, 9, "Rule id: " + std::to_string(m_ruleId) +
+            " was skipped due to a ruleRemoveById action...");
+        return true;
+    }
+    return false;
+}
+
+
 bool RuleWithOperator::evaluate(Transaction *trans,
     std::shared_ptr<RuleMessage> ruleMessage) {
     bool globalRet = false;
     variables::Variables *variables = this->m_variables;
     bool recursiveGlobalRet;
     bool containsBlock = hasBlockAction();
-    std::string eparam;
     variables::Variables vars;
     vars.reserve(4);
     variables::Variables exclusion;
+    utils::NegativeCache *cache = nullptr;
+    RuleExclusions::Targets removed(&trans->m_ruleExclusions, this, trans);
 
-    RuleWithActions::evaluate(trans, ruleMessage);
+    MSC_TRACE2(rule__begin, trans->m_id->c_str(), m_ruleId);
 
+    RuleWithActions::evaluate(trans, ruleMessage);
 
-    // FIXME: Make a class runTimeException to handle this cases.
-    for (auto &i : trans->m_ruleRemoveById) {
-        if (m_ruleId != i) {
-            continue;
-        }
-        ms_dbg_a(trans, 9, "Rule id: " + std::to_string(m_ruleId) +
-            " was skipped due to a ruleRemoveById action...");
-        return true;
-    }
-    for (auto &i : trans->m_ruleRemoveByIdRange) {
-        if (!(i.first <= m_ruleId && i.second >= m_ruleId)) {
-            continue;
-        }
-        ms_dbg_a(trans, 9, "Rule id: " + std::to_string(m_ruleId) +
-            " was skipped due to a ruleRemoveById action...");
+    if (isRemovedAtRuntime(trans)) {
+        MSC_TRACE3(rule__end, trans->m_id->c_str(), m_ruleId, false);
         return true;
     }
 
-    if (m_operator->m_string) {
-        eparam = m_operator->m_string->evaluate(trans);
+    /* The operator expands its own parameter; this one is only logged. */
+    if (ms_dbg_a_enabled(trans, 4) && m_operator->m_string) {
+        std::string eparam = "\"" + m_operator->m_string->evaluate(trans)
+            + "\"";
 
         if (m_operator->m_string->containsMacro()) {
-            eparam = "\"" + eparam + "\" Was: \"" \
-                + m_operator->m_string->evaluate(NULL) + "\"";
-        } else {
-            eparam = "\"" + eparam + "\"";
+            eparam += " Was: \"" + m_operator->m_string->evaluate(NULL)
+                + "\"";
         }
-    ms_dbg_a(trans, 4, "(Rule: " + std::to_string(m_ruleId) \
-        + ") Executing operator \"" + getOperatorName() \
-        + "\" with param " \
-        + eparam \
-        + " against " \
-        + variables + ".");
+        ms_dbg_a(trans, 4, "(Rule: " + std::to_string(m_ruleId) \
+            + ") Executing operator \"" + getOperatorName() \
+            + "\" with param " \
+            + eparam \
+            + " against " \
+            + variables + ".");
     } else {
         ms_dbg_a(trans, 4, "(Rule: " + std::to_string(m_ruleId) \
             + ") Executing operator \"" + getOperatorName() \
@@ -270,6 +338,15 @@ bool RuleWithOperator::evaluate(Transaction *trans,
 
     getFinalVars(&vars, &exclusion, trans);
 
+    /*
+     * Not used while the rules are traced, so the debug log stays the
+     * same with and without the cache.
+     */
+    if (m_cacheableOperator && trans->m_rules->m_negativeCache
+        && !ms_dbg_a_enabled(trans, 4)) {
+        cache = trans->m_rules->m_negativeCache.get();
+    }
+
     for (auto &var : vars) {
         std::vector<const VariableValue *> e;
         if (!var) {
@@ -281,23 +358,7 @@ bool RuleWithOperator::evaluate(Transaction *trans,
             const std::string &key = v->getKeyWithCollection();
 
             if (exclusion.contains(v) ||
-                std::find_if(trans->m_ruleRemoveTargetById.begin(),
-                    trans->m_ruleRemoveTargetById.end(),
-                    [&, v, this](std::pair<int, std::string> &m) -> bool {
-                        return m.first == m_ruleId && m.second == v->getKeyWithCollection();
-                    }) != trans->m_ruleRemoveTargetById.end()
-            ) {
-                delete v;
-                v = NULL;
-                continue;
-            }
-            if (exclusion.contains(v) ||
-                std::find_if(trans->m_ruleRemoveTargetByTag.begin(),
-                    trans->m_ruleRemoveTargetByTag.end(),
-                    [&, v, trans, this](std::pair<std::string, std::string> &m) -> bool {
-                        return containsTag(m.first, trans) && m.second == v->getKeyWithCollection();
-                    }) != trans->m_ruleRemoveTargetByTag.end()
-            ) {
+                removed.contains(v->getKeyWithCollection())) {
                 delete v;
                 v = NULL;
                 continue;
@@ -310,9 +371,25 @@ bool RuleWithOperator::evaluate(Transaction *trans,
             for (const auto &valueTemp : values) {
                 bool ret;
                 std::string valueAfterTrans = std::move(*valueTemp.first);
+                bool cacheable = cache && cache->accepts(valueAfterTrans);
+
+                if (cacheable) {
+                    bool hit = cache->contains(this, valueAfterTrans);
+                    if (trans->m_ms) {
+                        trans->m_ms->m_metrics.cacheLookup(
+                            Metrics::NegativeCache, hit);
+                    }
+                    if (hit) {
+                        continue;
+                    }
+                }
 
                 ret = executeOperatorAt(trans, key, valueAfterTrans, ruleMessage);
 
+                if (ret == false && cacheable) {
+                    cache->insert(this, valueAfterTrans);
+                }
+
                 if (ret == true) {
                     ruleMessage->m_match = m_operator->resolveMatchMessage(trans,
                         key, value);
@@ -363,6 +440,7 @@ bool RuleWithOperator::evaluate(Transaction *trans,
     }
 
 end_clean:
+    MSC_TRACE3(rule__end, trans->m_id->c_str(), m_ruleId, false);
     return false;
 
 end_exec:
@@ -370,6 +448,7 @@ end_exec:
 
     /* last rule in the chain. */
     performLogging(trans, ruleMessage, true, true);
+    MSC_TRACE3(rule__end, trans->m_id->c_str(), m_ruleId, true);
     return true;
 }
 
@@ -377,4 +456,144 @@ end_exec:
 std::string RuleWithOperator::getOperatorName() const { return m_operator->m_op; }
 
 
+bool RuleWithOperator::isSideEffectFree() const {
+    if (isChained() || m_chainedRuleParent != nullptr
+        || !hasSideEffectFreeActions()) {
+        return false;
+    }
+
+    /*
+     * The operator is going to be evaluated without a transaction.
+     */
+    if (!m_transactionFreeOperator) {
+        return false;
+    }
+
+    /*
+     * Targets written while the phase is evaluated (matched vars, the
+     * highest severity) or computed at the time they are read.
+     */
+    for (Variable *v : *m_variables) {
+        const std::string &c = v->m_collectionName;
+        if (c.compare(0, 11, "MATCHED_VAR") == 0
+            || c.compare(0, 4, "TIME") == 0
+            || c == "DURATION" || c == "REMOTE_USER"
+            || c == "HIGHEST_SEVERITY" || c == "RULE"
+            || c == "XML" || c == "ENV") {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool RuleWithOperator::matchesAnyTarget(Transaction *trans) {
+    bool ret = false;
+    variables::Variables vars;
+    variables::Variables exclusion;
+
+    getFinalVars(&vars, &exclusion, trans);
+
+    for (auto &var : vars) {
+        std::vector<const VariableValue *> e;
+        if (!var) {
+            continue;
+        }
+        var->evaluate(trans, this, &e);
+        for (const VariableValue *v : e) {
+            if (ret == false && !exclusion.contains(v)) {
+                TransformationResults values;
+                executeTransformations(trans, v->getValue(), values);
+                for (const auto &valueTemp : values) {
+                    if (m_operator->evaluateInternal(nullptr, this,
+                        *valueTemp.first, nullptr)) {
+                        ret = true;
+                        break;
+                    }
+                }
+            }
+            delete v;
+        }
+        if (ret) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+
+void RuleWithOperator::evaluateNoMatch(Transaction *trans) {
+    trans->m_matched.clear();
+
+    if (isRemovedAtRuntime(trans)) {
+        return;
+    }
+
+    cleanMatchedVars(trans);
+}
+
+
+bool RuleWithOperator::getStaticGuard(RulesSetProperties *rules,
+    std::string *variable, std::string *value, bool *prefix) const {
+    RulesExceptions &e = rules->m_exceptions;
+    bool none = false;
+    bool transformed = false;
+
+    if (m_operator == NULL || m_operator->m_negation
+        || !m_operator->m_string || m_operator->m_string->containsMacro()
+        || m_variables->size() != 1) {
+        return false;
+    }
+    if (dynamic_cast<operators::StrEq *>(m_operator)) {
+        *prefix = false;
+    } else if (dynamic_cast<operators::BeginsWith *>(m_operator)) {
+        *prefix = true;
+    } else {
+        return false;
+    }
+
+    Variable *v = m_variables->at(0);
+    if (!dynamic_cast<variables::RequestFilename *>(v)
+        && !dynamic_cast<variables::RequestMethod *>(v)
+        && !dynamic_cast<variables::ServerName *>(v)) {
+        return false;
+    }
+
+    /* Only the transformations after the last t:none are applied. */
+    for (Transformation *t : getTransformations()) {
+        none = none || t->m_isNone;
+        transformed = !t->m_isNone;
+    }
+    if (transformed) {
+        return false;
+    }
+    if (!none) {
+        for (auto &a : rules->m_defaultActions[getPhase()]) {
+            if (a->action_kind
+                == actions::Action::RunTimeBeforeMatchAttemptKind) {
+                return false;
+            }
+        }
+    }
+
+    /* Changed, or removed, by a SecRuleUpdate... or SecRuleRemove... */
+    if (e.m_action_pre_update_target_by_id.count(m_ruleId)
+        || e.m_variable_update_target_by_id.count(m_ruleId)
+        || e.contains(m_ruleId)
+        || (!getTags().empty()
+            && (!e.m_variable_update_target_by_tag.empty()
+            || !e.m_remove_rule_by_tag.empty()))
+        || (hasMsg() && (!e.m_variable_update_target_by_msg.empty()
+            || !e.m_remove_rule_by_msg.empty()))) {
+        return false;
+    }
+
+    *variable = *v->m_fullName;
+    *value = m_operator->m_string->evaluate();
+    return !value->empty();
+}
+
+
 }  // namespace modsecurity
@@ -13,6 +13,8 @@
  *
  */
 
+#include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <iostream>
 #include <fstream>
@@ -23,8 +25,21 @@
 #include "modsecurity/modsecurity.h"
 #include "modsecurity/transaction.h"
 #include "src/parser/driver.h"
+#include "src/utils/guard_index.h"
 #include "src/utils/https_client.h"
+#include "src/utils/negative_cache.h"
+#include "src/utils/thread_pool.h"
+#include "src/actions/audit_log.h"
+#include "src/actions/log.h"
+#include "src/actions/log_data.h"
+#include "src/actions/msg.h"
+#include "src/actions/no_audit_log.h"
+#include "src/actions/no_log.h"
+#include "src/actions/severity.h"
+#include "src/actions/tag.h"
 #include "modsecurity/rules.h"
+#include "modsecurity/rule_marker.h"
+#include "modsecurity/rule_with_operator.h"
 
 using modsecurity::Parser::Driver;
 using modsecurity::Utils::HttpsClient;
@@ -111,31 +126,121 @@ int RulesSet::evaluate(int phase, Transaction *t) {
        return 0;
     }
 
+    Metrics::PhaseTimer timer(t->m_ms ? &t->m_ms->m_metrics : nullptr,
+        phase);
+    if (t->m_shadowMatches) {
+        t->m_shadowMatches->phase(phase);
+    }
     Rules *rules = m_rulesSetPhases[phase];
+    int first = 0;
+
+    if (t->m_suspendedPhase == phase) {
+        first = t->m_suspendedRule;
+        t->m_suspendedPhase = -1;
+        ms_dbg_a(t, 9, "Resuming the evaluation of this phase at rule " \
+            + std::to_string(first + 1) + " of " \
+            + std::to_string(rules->size()) + ".");
+    } else {
+        ms_dbg_a(t, 9, "This phase consists of " \
+            + std::to_string(rules->size()) + " rule(s).");
+
+        if (t->m_allowType == actions::disruptive::FromNowOnAllowType
+            && phase != modsecurity::Phases::LoggingPhase) {
+            ms_dbg_a(t, 9, "Skipping all rules evaluation on this phase as request " \
+                "through the utilization of an `allow' action.");
+            return true;
+        }
+        if (t->m_allowType == actions::disruptive::RequestAllowType
+            && phase <= modsecurity::Phases::RequestBodyPhase) {
+            ms_dbg_a(t, 9, "Skipping all rules evaluation on this phase as request " \
+                "through the utilization of an `allow' action.");
+            return true;
+        }
+        //if (t->m_allowType != actions::disruptive::NoneAllowType) {
+        t->m_allowType = actions::disruptive::NoneAllowType;
+        //}
+    }
 
-    ms_dbg_a(t, 9, "This phase consists of " \
-        + std::to_string(rules->size()) + " rule(s).");
-
-    if (t->m_allowType == actions::disruptive::FromNowOnAllowType
-        && phase != modsecurity::Phases::LoggingPhase) {
-        ms_dbg_a(t, 9, "Skipping all rules evaluation on this phase as request " \
-            "through the utilization of an `allow' action.");
-        return true;
+    bool sliced = (t->m_sliceRules > 0 || t->m_sliceTime > 0)
+        && phase >= modsecurity::Phases::RequestHeadersPhase
+        && phase <= modsecurity::Phases::ResponseBodyPhase;
+    std::chrono::steady_clock::time_point start;
+    if (sliced) {
+        start = std::chrono::steady_clock::now();
     }
-    if (t->m_allowType == actions::disruptive::RequestAllowType
-        && phase <= modsecurity::Phases::RequestBodyPhase) {
-        ms_dbg_a(t, 9, "Skipping all rules evaluation on this phase as request " \
-            "through the utilization of an `allow' action.");
-        return true;
+
+    std::vector<char> ahead;
+    int aheadFrom = 0;
+    int aheadTo = 0;
+    bool traced = ms_dbg_a_enabled(t, 4);
+    bool parallel = m_parallelPool && m_parallelPool->size() > 0 && !traced;
+
+    const utils::GuardIndex *guards = m_guardIndexes[phase].get();
+    std::vector<int> candidates;
+    size_t candidate = 0;
+    if (guards) {
+        guards->candidates(t, &candidates);
     }
-    //if (t->m_allowType != actions::disruptive::NoneAllowType) {
-    t->m_allowType = actions::disruptive::NoneAllowType;
-    //}
 
-    for (int i = 0; i < rules->size(); i++) {
+    for (int i = first; i < rules->size(); i++) {
+        if (sliced && i > first && ((t->m_sliceRules > 0
+            && i - first >= t->m_sliceRules) || (t->m_sliceTime > 0
+            && std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count()
+                >= t->m_sliceTime))) {
+            t->m_suspendedPhase = phase;
+            t->m_suspendedRule = i;
+            ms_dbg_a(t, 9, "Suspending the evaluation of this phase " \
+                "before rule " + std::to_string(i + 1) + " of " \
+                + std::to_string(rules->size()) + ".");
+            return MSC_PHASE_SUSPENDED;
+        }
+
+        /*
+         * Every skipped rule is logged while the rules are traced,
+         * otherwise go straight to the marker or to the rule after the
+         * ones to skip.
+         */
+        if (!traced && (t->isInsideAMarker() || t->m_skip_next > 0)) {
+            i = jump(phase, i, t);
+            if (i >= rules->size()) {
+                break;
+            }
+        }
+
+        /*
+         * Go straight to the next rule that is not guarded or whose guard
+         * holds. Passing over a rule that does not match only clears the
+         * matched variables, once is enough.
+         */
+        if (guards && guards->guarded(i) && !t->isInsideAMarker()
+            && t->m_skip_next == 0
+            && t->m_allowType == actions::disruptive::NoneAllowType
+            && !t->m_ruleExclusions.removesRules()) {
+            int next = guards->nextUnguarded(i);
+            while (candidate < candidates.size() && candidates[candidate] < i) {
+                candidate++;
+            }
+            if (candidate < candidates.size() && candidates[candidate] < next) {
+                next = candidates[candidate];
+            }
+            if (next > i) {
+                ms_dbg_a(t, 9, "Passed over " + std::to_string(next - i) \
+                    + " rule(s), from rule id '" \
+                    + rules->at(i)->getReference() \
+                    + "' on. Their guard does not hold.");
+                static_cast<RuleWithOperator *>(
+                    rules->at(next - 1).get())->evaluateNoMatch(t);
+                i = next;
+                if (i >= rules->size()) {
+                    break;
+                }
+            }
+        }
+
         // FIXME: This is not meant to be here. At the end of this refactoring,
         //        the shared pointer won't be used.
-        auto rule = rules->at(i);
+        const std::shared_ptr<Rule> &rule = rules->m_rules[i];
         if (t->isInsideAMarker() && !rule->isMarker()) {
             ms_dbg_a(t, 9, "Skipped rule id '" + rule->getReference() \
                 + "' due to a SecMarker: " + *t->getCurrentMarker());
@@ -192,23 +297,47 @@ int RulesSet::evaluate(int phase, Transaction *t) {
             }
 
 
-            if (ruleWithActions) {
-                for (auto &z : t->m_ruleRemoveByTag) {
-                    if (ruleWithActions->containsTag(z, t) == true) {
-                        ms_dbg_a(t, 9, "Skipped rule id '" \
-                            + ruleWithActions->getReference() \
-                            + "'. Skipped due to a ruleRemoveByTag action.");
-                        remove_rule = true;
-                        break;
-                    }
+            if (ruleWithActions
+                && t->m_ruleExclusions.isRemovedByTag(ruleWithActions, t)) {
+                ms_dbg_a(t, 9, "Skipped rule id '" \
+                    + ruleWithActions->getReference() \
+                    + "'. Skipped due to a ruleRemoveByTag action.");
+                continue;
+            }
+
+            if (parallel && i >= aheadTo
+                && m_sideEffectFreeRuns[phase][i] > i + 1) {
+                aheadFrom = i;
+                aheadTo = m_sideEffectFreeRuns[phase][i];
+                evaluateAhead(rules, aheadFrom, aheadTo, t, &ahead);
+            }
+
+            std::chrono::steady_clock::time_point ruleStart;
+            if (t->m_captureTimings) {
+                ruleStart = std::chrono::steady_clock::now();
+            }
+            if (i < aheadTo && !ahead[i - aheadFrom]) {
+                static_cast<RuleWithOperator *>(base)->evaluateNoMatch(t);
+            } else if (rule->evaluate(t) && ruleWithActions) {
+                if (t->m_ms) {
+                    t->m_ms->m_metrics.ruleMatched(ruleWithActions->m_ruleId);
+                    t->ruleMatched(ruleWithActions->m_ruleId, phase);
                 }
-                if (remove_rule) {
-                    continue;
+                if (t->m_shadowMatches) {
+                    t->m_shadowMatches->matched(ruleWithActions->m_ruleId,
+                        phase, i);
                 }
             }
-
-            rule->evaluate(t);
+            if (t->m_captureTimings && ruleWithActions) {
+                t->m_captureTimings->rule(ruleWithActions->m_ruleId, phase,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - ruleStart).count());
+            }
             if (t->m_it.disruptive > 0) {
+                if (t->m_shadowMatches) {
+                    t->m_shadowMatches->stopped(ruleWithActions ?
+                        ruleWithActions->m_ruleId : 0, phase, i);
+                }
 
                 ms_dbg_a(t, 8, "Skipping this phase as this " \
                     "request was already intercepted.");
@@ -220,6 +349,206 @@ int RulesSet::evaluate(int phase, Transaction *t) {
 }
 
 
+/*
+ * Evaluates, on the pool, whether each one of the rules [from, to) would
+ * match. The evaluation itself is done later on, in order, and only for
+ * the rules that matched here.
+ */
+void RulesSet::evaluateAhead(Rules *rules, int from, int to, Transaction *t,
+    std::vector<char> *matches) {
+    utils::WaitGroup wg;
+
+    matches->assign(to - from, 1);
+    wg.add(to - from);
+    for (int i = from; i < to; i++) {
+        RuleWithOperator *rule = static_cast<RuleWithOperator *>(
+            rules->at(i).get());
+        char *match = &(*matches)[i - from];
+        m_parallelPool->submit([rule, t, match, &wg] () {
+            *match = rule->matchesAnyTarget(t);
+            wg.done();
+        });
+    }
+    wg.wait();
+}
+
+
+void RulesSet::buildJumpTables() {
+    for (int phase = 0; phase < modsecurity::Phases::NUMBER_OF_PHASES;
+        phase++) {
+        Rules *rules = m_rulesSetPhases[phase];
+        JumpTable &table = m_jumpTables[phase];
+
+        table.m_markers.clear();
+        table.m_rules.clear();
+        table.m_rulesBefore.assign(rules->size() + 1, 0);
+        for (int i = 0; i < rules->size(); i++) {
+            RuleMarker *marker = dynamic_cast<RuleMarker *>(
+                rules->at(i).get());
+            table.m_rulesBefore[i] = table.m_rules.size();
+            if (marker) {
+                table.m_markers[*marker->getName()].push_back(i);
+            } else {
+                table.m_rules.push_back(i);
+            }
+        }
+        table.m_rulesBefore[rules->size()] = table.m_rules.size();
+    }
+}
+
+
+/**
+ * Returns the position, at or after i, where the evaluation of the
+ * phase has to continue given the skipAfter or skip in effect; the size
+ * of the phase when it has nothing else to evaluate. Consumes the
+ * amount of rules to skip the same way walking over them would.
+ */
+int RulesSet::jump(int phase, int i, Transaction *t) {
+    const JumpTable &table = m_jumpTables[phase];
+    int size = table.m_rulesBefore.size() - 1;
+
+    if (t->isInsideAMarker()) {
+        auto it = table.m_markers.find(*t->getCurrentMarker());
+        if (it == table.m_markers.end()) {
+            return size;
+        }
+        auto m = std::lower_bound(it->second.begin(), it->second.end(), i);
+        return m == it->second.end() ? size : *m;
+    }
+
+    /* Markers are not counted by skip and do nothing outside skipAfter. */
+    int before = table.m_rulesBefore[i];
+    int target = before + t->m_skip_next;
+    if (target >= static_cast<int>(table.m_rules.size())) {
+        t->m_skip_next -= table.m_rules.size() - before;
+        return size;
+    }
+    t->m_skip_next = 0;
+    return table.m_rules[target];
+}
+
+
+void RulesSet::findSideEffectFreeRuns() {
+    for (int phase = 0; phase < modsecurity::Phases::NUMBER_OF_PHASES;
+        phase++) {
+        Rules *rules = m_rulesSetPhases[phase];
+        std::vector<int> &runs = m_sideEffectFreeRuns[phase];
+        bool defaults = true;
+
+        /* Default actions are also executed by every matching rule. */
+        for (auto &a : m_defaultActions[phase]) {
+            actions::Action *b = a.get();
+            if (b->action_kind != actions::Action::RunTimeOnlyIfMatchKind
+                || b->isDisruptive()
+                || dynamic_cast<actions::Log *>(b)
+                || dynamic_cast<actions::NoLog *>(b)
+                || dynamic_cast<actions::AuditLog *>(b)
+                || dynamic_cast<actions::NoAuditLog *>(b)
+                || dynamic_cast<actions::LogData *>(b)
+                || dynamic_cast<actions::Msg *>(b)
+                || dynamic_cast<actions::Severity *>(b)
+                || dynamic_cast<actions::Tag *>(b)) {
+                continue;
+            }
+            defaults = false;
+        }
+
+        runs.assign(rules->size(), 0);
+        int end = rules->size();
+        for (int i = rules->size() - 1; i >= 0; i--) {
+            RuleWithOperator *rule = dynamic_cast<RuleWithOperator *>(
+                rules->at(i).get());
+            if (defaults && rule && rule->isSideEffectFree()
+                && m_exceptions.m_action_pre_update_target_by_id.count(
+                    rule->m_ruleId) == 0
+                && m_exceptions.m_action_pos_update_target_by_id.count(
+                    rule->m_ruleId) == 0) {
+                runs[i] = end;
+            } else {
+                runs[i] = i;
+                end = i;
+            }
+        }
+    }
+}
+
+
+void RulesSet::buildGuardIndexes() {
+    for (int phase = 0; phase < modsecurity::Phases::NUMBER_OF_PHASES;
+        phase++) {
+        Rules *rules = m_rulesSetPhases[phase];
+        std::shared_ptr<utils::GuardIndex> index =
+            std::make_shared<utils::GuardIndex>(rules->size());
+        std::string variable;
+        std::string value;
+        bool prefix;
+        utils::GuardIndex::Attribute a;
+
+        for (int i = 0; i < rules->size(); i++) {
+            RuleWithOperator *rule = dynamic_cast<RuleWithOperator *>(
+                rules->at(i).get());
+            if (rule && rule->getStaticGuard(this, &variable, &value, &prefix)
+                && utils::GuardIndex::attribute(variable, &a)) {
+                index->add(i, a, value, prefix);
+            }
+        }
+
+        if (index->size() > 0) {
+            index->build();
+            m_guardIndexes[phase] = index;
+        } else {
+            m_guardIndexes[phase].reset();
+        }
+    }
+}
+
+
+void RulesSet::setParallelEvaluation(int workers) {
+    if (workers > 0) {
+        m_parallelPool = std::make_shared<utils::ThreadPool>(workers);
+    } else {
+        m_parallelPool.reset();
+    }
+}
+
+
+size_t RulesSet::getParallelEvaluation() const {
+    return m_parallelPool ? m_parallelPool->size() : 0;
+}
+
+
+void RulesSet::setNegativeCache(size_t entries, size_t maxValueLength) {
+    if (entries == 0) {
+        m_negativeCache.reset();
+    } else {
+        m_negativeCache = std::make_shared<utils::NegativeCache>(entries,
+            maxValueLength);
+    }
+}
+
+
+uint64_t RulesSet::getNegativeCacheHits() const {
+    return m_negativeCache ? m_negativeCache->hits() : 0;
+}
+
+
+uint64_t RulesSet::getNegativeCacheLookups() const {
+    return m_negativeCache ? m_negativeCache->lookups() : 0;
+}
+
+
+void RulesSet::setSlowCapture(uint64_t thresholdUs, size_t bodyLimit,
+    std::shared_ptr<CaptureSink> sink) {
+    std::shared_ptr<SlowCapture> capture;
+    if (sink != nullptr) {
+        capture = std::make_shared<SlowCapture>(thresholdUs, bodyLimit,
+            sink);
+    }
+    /* Transactions being created read it concurrently. */
+    std::atomic_store(&m_slowCapture, capture);
+}
+
+
 int RulesSet::merge(Driver *from) {
     int amount_of_rules = 0;
 
@@ -229,6 +558,14 @@ int RulesSet::merge(Driver *from) {
         dynamic_cast<RulesSetProperties *>(from),
         dynamic_cast<RulesSetProperties *>(this),
         &m_parserError);
+    m_ruleIds.build(&m_rulesSetPhases);
+    buildJumpTables();
+    findSideEffectFreeRuns();
+    buildGuardIndexes();
+
+    if (m_negativeCache) {
+        m_negativeCache->clear();
+    }
 
     return amount_of_rules;
 }
@@ -243,6 +580,14 @@ int RulesSet::merge(RulesSet *from) {
         dynamic_cast<RulesSetProperties *>(from),
         dynamic_cast<RulesSetProperties *>(this),
         &m_parserError);
+    m_ruleIds.build(&m_rulesSetPhases);
+    buildJumpTables();
+    findSideEffectFreeRuns();
+    buildGuardIndexes();
+
+    if (m_negativeCache) {
+        m_negativeCache->clear();
+    }
 
     return amount_of_rules;
 }
@@ -317,5 +662,81 @@ extern "C" int msc_rules_cleanup(RulesSet *rules) {
 }
 
 
+/**
+ * @name    msc_rules_set_parallel
+ * @brief   Evaluates side effect free rules of a phase in parallel.
+ *
+ * Runs of consecutive side effect free rules are evaluated on `workers'
+ * threads before being applied, in order, to the transaction. The
+ * results are the same as the ones of the serial evaluation.
+ *
+ * @param rules Pointer to the rules set.
+ * @param workers Amount of worker threads, 0 to go back to serial.
+ *
+ * @returns Amount of worker threads actually in use.
+ *
+ */
+extern "C" int msc_rules_set_parallel(RulesSet *rules, int workers) {
+    rules->setParallelEvaluation(workers);
+    return rules->getParallelEvaluation();
+}
+
+
+extern "C" int msc_rules_set_negative_cache(RulesSet *rules, size_t entries,
+    size_t max_value_length) {
+    rules->setNegativeCache(entries, max_value_length);
+    return true;
+}
+
+
+/**
+ * @name    msc_rules_negative_cache_stats
+ * @brief   Reads the hit rate of the negative result cache.
+ *
+ * @param rules Pointer to the rules set.
+ * @param hits Amount of operator evaluations skipped due to the cache.
+ * @param lookups Amount of times the cache was consulted.
+ *
+ */
+extern "C" int msc_rules_negative_cache_stats(RulesSet *rules,
+    unsigned long long *hits, unsigned long long *lookups) {
+    *hits = rules->getNegativeCacheHits();
+    *lookups = rules->getNegativeCacheLookups();
+    return true;
+}
+
+
+/**
+ * @name    msc_rules_set_slow_capture
+ * @brief   Captures the transactions slower than a threshold into a file.
+ *
+ * Every transaction that spent at least `threshold_us' microseconds in
+ * ModSecurity is appended to `path' as one JSON line, which modsec-replay
+ * can run again. Applies to the transactions created afterwards.
+ *
+ * @param rules Pointer to the rules set.
+ * @param threshold_us Latency threshold, in microseconds.
+ * @param body_limit Maximum amount of each body to be recorded, in bytes.
+ * @param path File the records are appended to, NULL to stop capturing.
+ *
+ * @returns If the capture was set up.
+ * @retval true  Capture set (or stopped).
+ * @retval false The file could not be opened, nothing was changed.
+ *
+ */
+extern "C" int msc_rules_set_slow_capture(RulesSet *rules,
+    unsigned long threshold_us, size_t body_limit, const char *path) {
+    std::shared_ptr<FileCaptureSink> sink;
+    if (path != NULL) {
+        sink = std::make_shared<FileCaptureSink>(path);
+        if (!sink->good()) {
+            return false;
+        }
+    }
+    rules->setSlowCapture(threshold_us, body_limit, sink);
+    return true;
+}
+
+
 }  // namespace modsecurity
 
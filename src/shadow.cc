@@ -0,0 +1,224 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/shadow.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rule_with_actions.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/transaction_batch.h"
+#include "src/collection/backend/in_memory-per_process.h"
+#include "src/config.h"
+#include "src/utils/thread_pool.h"
+
+
+namespace modsecurity {
+
+
+static void discardLog(void *data, const void *message) { }
+
+
+Shadow::Shadow(ModSecurity *primary, RulesSet *rules, double sampleRate,
+    int workers, size_t queueSize, ModSecShadowCb cb, void *cbData)
+    : m_ms(new ModSecurity()),
+    m_rules(rules),
+    m_sampleRate(sampleRate < 0 ? 0 : sampleRate > 1 ? 1 : sampleRate),
+    m_queueSize(queueSize),
+    m_cb(cb),
+    m_cbData(cbData),
+    m_seen(0),
+    m_sampled(0),
+    m_dropped(0),
+    m_evaluated(0),
+    m_different(0),
+    m_pending(0),
+    m_pool(new utils::ThreadPool(workers > 0 ? workers : 1)) {
+    m_ms->setConnectorInformation(primary->getConnectorInformation());
+    m_ms->setServerLogCb(discardLog, RuleMessageLogProperty);
+#ifdef WITH_LMDB
+    /* Never write into the persistent collections of the primary set. */
+    delete m_ms->m_global_collection;
+    delete m_ms->m_resource_collection;
+    delete m_ms->m_ip_collection;
+    delete m_ms->m_session_collection;
+    delete m_ms->m_user_collection;
+    m_ms->m_global_collection =
+        new collection::backend::InMemoryPerProcess("GLOBAL");
+    m_ms->m_resource_collection =
+        new collection::backend::InMemoryPerProcess("RESOURCE");
+    m_ms->m_ip_collection = new collection::backend::InMemoryPerProcess("IP");
+    m_ms->m_session_collection =
+        new collection::backend::InMemoryPerProcess("SESSION");
+    m_ms->m_user_collection =
+        new collection::backend::InMemoryPerProcess("USER");
+#endif
+}
+
+
+Shadow::~Shadow() {
+    m_pool.reset();
+}
+
+
+bool Shadow::sample() {
+    uint64_t n = m_seen.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<uint64_t>((n + 1) * m_sampleRate)
+        > static_cast<uint64_t>(n * m_sampleRate);
+}
+
+
+void Shadow::submit(Transaction *t) {
+    m_sampled++;
+    if (m_pending.fetch_add(1) >= m_queueSize) {
+        m_dropped++;
+        done();
+        return;
+    }
+
+    std::shared_ptr<ShadowMatches> primary(t->m_shadowMatches.release());
+    std::shared_ptr<BatchRequest> r = std::make_shared<BatchRequest>();
+
+    r->m_clientIp = t->m_clientIpAddress ? *t->m_clientIpAddress : "";
+    r->m_clientPort = t->m_clientPort;
+    r->m_serverIp = t->m_serverIpAddress ? *t->m_serverIpAddress : "";
+    r->m_serverPort = t->m_serverPort;
+    r->m_uri = t->m_uri;
+    r->m_method = t->m_variableRequestMethod.m_value;
+    r->m_httpVersion = t->m_httpVersion;
+    for (const auto &h : t->m_variableRequestHeaders) {
+        r->m_requestHeaders.emplace_back(h.second->getKey(),
+            h.second->getValue());
+    }
+    r->m_requestBody = t->m_requestBody.str();
+
+    if (primary->m_phases & (1u << modsecurity::ResponseHeadersPhase)) {
+        r->m_responseStatus = t->m_httpCodeReturned;
+        r->m_responseProtocol = t->m_variableResponseProtocol.m_value;
+        for (const auto &h : t->m_variableResponseHeaders) {
+            r->m_responseHeaders.emplace_back(h.second->getKey(),
+                h.second->getValue());
+        }
+        r->m_responseBody = t->m_responseBody.str();
+    }
+
+    std::string id = *t->m_id;
+    m_pool->submit([this, r, primary, id] {
+        evaluate(*r, *primary, id);
+        done();
+    });
+}
+
+
+void Shadow::evaluate(const BatchRequest &r, const ShadowMatches &primary,
+    const std::string &id) {
+    ModSecurityIntervention it;
+    std::set<int64_t> p;
+    std::set<int64_t> s;
+
+    for (const auto &m : primary.m_rules) {
+        p.insert(m.m_id);
+    }
+
+    /*
+     * Where the primary was intercepted, in the shadow set: at the same
+     * rule if it has it, else at the same position.
+     */
+    int stop = primary.m_stoppedIndex;
+    if (primary.m_stoppedPhase != -1 && primary.m_stoppedRule != 0) {
+        Rules *rules = m_rules->m_rulesSetPhases[primary.m_stoppedPhase];
+        for (int i = 0; i < rules->size(); i++) {
+            RuleWithActions *rule = dynamic_cast<RuleWithActions *>(
+                rules->m_rules[i].get());
+            if (rule && rule->m_ruleId == primary.m_stoppedRule) {
+                stop = i;
+                break;
+            }
+        }
+    }
+
+    TransactionBatch::evaluate(m_ms.get(), m_rules, r, &it,
+        [] (Transaction *t) {
+            t->m_secRuleEngine = RulesSetProperties::DetectionOnlyRuleEngine;
+            t->m_shadowMatches.reset(new ShadowMatches());
+        },
+        [&primary, &s, stop] (Transaction *t) {
+            for (const auto &m : t->m_shadowMatches->m_rules) {
+                if ((primary.m_phases & (1u << m.m_phase))
+                    && (m.m_phase != primary.m_stoppedPhase
+                        || m.m_index <= stop)) {
+                    s.insert(m.m_id);
+                }
+            }
+        });
+    intervention::free(&it);
+
+    std::vector<long long> onlyPrimary;
+    std::vector<long long> onlyShadow;
+    for (int64_t i : p) {
+        if (s.count(i) == 0) {
+            onlyPrimary.push_back(i);
+        }
+    }
+    for (int64_t i : s) {
+        if (p.count(i) == 0) {
+            onlyShadow.push_back(i);
+        }
+    }
+
+    m_evaluated++;
+    if (onlyPrimary.empty() && onlyShadow.empty()) {
+        return;
+    }
+    m_different++;
+    if (m_cb) {
+        ModSecurityShadowDiff diff;
+        diff.id = id.c_str();
+        diff.primary = onlyPrimary.data();
+        diff.primaryCount = onlyPrimary.size();
+        diff.shadow = onlyShadow.data();
+        diff.shadowCount = onlyShadow.size();
+        m_cb(m_cbData, &diff);
+    }
+}
+
+
+void Shadow::done() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (--m_pending == 0) {
+        m_idle.notify_all();
+    }
+}
+
+
+void Shadow::drain() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+}
+
+
+void Shadow::stats(ModSecurityShadowStats *stats) const {
+    stats->sampled = m_sampled;
+    stats->dropped = m_dropped;
+    stats->evaluated = m_evaluated;
+    stats->different = m_different;
+}
+
+
+}  // namespace modsecurity
@@ -0,0 +1,315 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/slow_capture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "src/utils/base64.h"
+#include "src/utils/thread_pool.h"
+
+
+namespace modsecurity {
+
+
+namespace {
+
+const int kVersion = 1;
+
+/* Only the slowest rules of a run are kept in its record. */
+const size_t kMaxRules = 64;
+
+const char *kPhaseNames[CaptureTimings::kPhases] = {
+    "connection",
+    "uri",
+    "request_headers",
+    "request_body",
+    "response_headers",
+    "response_body",
+    "logging",
+};
+
+
+void appendString(std::string *r, const std::string &s) {
+    char hex[8];
+
+    r->push_back('"');
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            r->push_back('\\');
+            r->push_back(c);
+        } else if (c < 0x20 || c > 0x7e) {
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            r->append(hex);
+        } else {
+            r->push_back(c);
+        }
+    }
+    r->push_back('"');
+}
+
+
+void appendHeaders(std::string *r, const AnchoredSetVariable &headers) {
+    bool first = true;
+
+    r->push_back('[');
+    for (const auto &h : headers) {
+        if (!first) {
+            r->push_back(',');
+        }
+        first = false;
+        r->push_back('[');
+        appendString(r, h.second->getKey());
+        r->push_back(',');
+        appendString(r, h.second->getValue());
+        r->push_back(']');
+    }
+    r->push_back(']');
+}
+
+
+/*
+ * The body is base64 encoded, flagged the way tools/replay expects it; its
+ * length before the cut goes to the capture part of the record.
+ */
+void appendBody(std::string *r, const std::string &body, size_t limit) {
+    r->append("\"body\":");
+    appendString(r, Utils::Base64::encode(body.size() > limit ?
+        body.substr(0, limit) : body));
+    r->append(",\"encoding\":\"base64\"");
+}
+
+
+}  // namespace
+
+
+FileCaptureSink::FileCaptureSink(const std::string &path)
+    : m_path(path),
+    m_file(path, std::ios::app | std::ios::binary),
+    m_good(m_file.is_open()),
+    m_errors(0),
+    m_dropped(0),
+    m_writing(false),
+    m_stop(false) {
+#ifndef MSC_NO_THREADS
+    m_thread = std::thread(&FileCaptureSink::run, this);
+#endif
+}
+
+
+FileCaptureSink::~FileCaptureSink() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+
+void FileCaptureSink::write(const std::string &record) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_thread.joinable()) {
+        append(record);
+        return;
+    }
+    if (m_queue.size() >= kMaxQueued) {
+        m_dropped++;
+        return;
+    }
+    m_queue.push_back(record);
+    m_cond.notify_one();
+}
+
+
+void FileCaptureSink::flush() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_idle.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+}
+
+
+/*
+ * Writes everything queued before stopping, so no record is lost when
+ * the capture is turned off.
+ */
+void FileCaptureSink::run() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true) {
+        m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            return;
+        }
+        std::deque<std::string> records;
+        records.swap(m_queue);
+        m_writing = true;
+        lock.unlock();
+        for (const std::string &record : records) {
+            append(record);
+        }
+        lock.lock();
+        m_writing = false;
+        m_idle.notify_all();
+    }
+}
+
+
+/*
+ * A failed write is counted, and the file opened again for the next
+ * record.
+ */
+void FileCaptureSink::append(const std::string &record) {
+    if (!m_file.is_open()) {
+        m_file.clear();
+        m_file.open(m_path, std::ios::app | std::ios::binary);
+    }
+    m_file << record << "\n";
+    m_file.flush();
+    if (!m_file.good()) {
+        m_errors++;
+        m_file.close();
+    }
+}
+
+
+bool SlowCapture::capture(Transaction *t) const {
+    if (t->m_captureTimings == nullptr || m_sink == nullptr
+        || t->m_captureTimings->total() / 1000 < m_thresholdUs) {
+        return false;
+    }
+    m_sink->write(record(t));
+    return true;
+}
+
+
+std::string SlowCapture::record(Transaction *t) const {
+    const CaptureTimings *timings = t->m_captureTimings.get();
+    std::string r;
+
+    r.append("{\"client_ip\":");
+    appendString(&r, t->m_clientIpAddress ? *t->m_clientIpAddress : "");
+    r.append(",\"client_port\":" + std::to_string(t->m_clientPort));
+    r.append(",\"server_ip\":");
+    appendString(&r, t->m_serverIpAddress ? *t->m_serverIpAddress : "");
+    r.append(",\"server_port\":" + std::to_string(t->m_serverPort));
+
+    r.append(",\"method\":");
+    appendString(&r, t->m_variableRequestMethod.m_value);
+    r.append(",\"uri\":");
+    appendString(&r, t->m_uri);
+    r.append(",\"http_version\":");
+    appendString(&r, t->m_httpVersion);
+    r.append(",\"headers\":");
+    appendHeaders(&r, t->m_variableRequestHeaders);
+    r.push_back(',');
+    appendBody(&r, t->m_requestBody.str(), m_bodyLimit);
+
+    r.append(",\"response\":{\"status\":"
+        + std::to_string(t->m_httpCodeReturned));
+    r.append(",\"protocol\":");
+    appendString(&r, t->m_variableResponseProtocol.m_value);
+    r.append(",\"headers\":");
+    appendHeaders(&r, t->m_variableResponseHeaders);
+    r.push_back(',');
+    appendBody(&r, t->m_responseBody.str(), m_bodyLimit);
+    r.push_back('}');
+
+    r.append(",\"capture\":{\"version\":" + std::to_string(kVersion));
+    r.append(",\"id\":");
+    appendString(&r, *t->m_id);
+    r.append(",\"time\":" + std::to_string(t->m_timeStamp));
+    r.append(",\"duration_us\":" + std::to_string(timings ?
+        timings->total() / 1000 : 0));
+    r.append(",\"threshold_us\":" + std::to_string(m_thresholdUs));
+    r.append(",\"body_length\":"
+        + std::to_string(t->m_requestBody.str().size()));
+    r.append(",\"response_body_length\":"
+        + std::to_string(t->m_responseBody.str().size()));
+
+    bool requestBodyAccess = t->m_requestBodyAccess
+        == RulesSetProperties::TrueConfigBoolean
+        || (t->m_requestBodyAccess != RulesSetProperties::FalseConfigBoolean
+        && t->m_rules->m_secRequestBodyAccess
+            == RulesSetProperties::TrueConfigBoolean);
+    r.append(",\"engine\":{\"rule_engine\":");
+    appendString(&r, RulesSetProperties::ruleEngineStateString(
+        static_cast<RulesSetProperties::RuleEngine>(
+            t->getRuleEngineState())));
+    r.append(",\"request_body_access\":");
+    r.append(requestBodyAccess ? "true" : "false");
+    r.append(",\"response_body_access\":");
+    r.append(t->m_rules->m_secResponseBodyAccess
+        == RulesSetProperties::TrueConfigBoolean ? "true" : "false");
+    r.append(",\"intervention\":" + std::to_string(timings ?
+        timings->m_status : 0));
+    r.append(",\"phases_us\":{");
+    for (int i = 0; i < CaptureTimings::kPhases; i++) {
+        if (i > 0) {
+            r.push_back(',');
+        }
+        r.append("\"" + std::string(kPhaseNames[i]) + "\":"
+            + std::to_string(timings ? timings->m_phases[i] / 1000 : 0));
+    }
+    r.append("}}");
+
+    /*
+     * A rule evaluated more than once in a phase (e.g. once per slice or
+     * chained) is reported once, with the sum of its times.
+     */
+    std::vector<CaptureTimings::Rule> rules;
+    if (timings) {
+        std::map<std::pair<int64_t, int>, uint64_t> sums;
+        for (const auto &rule : timings->m_rules) {
+            sums[std::make_pair(rule.m_id, rule.m_phase)] +=
+                rule.m_nanoseconds;
+        }
+        for (const auto &s : sums) {
+            rules.push_back({s.first.first, s.first.second, s.second});
+        }
+        std::stable_sort(rules.begin(), rules.end(),
+            [](const CaptureTimings::Rule &a, const CaptureTimings::Rule &b) {
+                return a.m_nanoseconds > b.m_nanoseconds;
+            });
+        if (rules.size() > kMaxRules) {
+            rules.resize(kMaxRules);
+        }
+    }
+    r.append(",\"rules\":[");
+    for (size_t i = 0; i < rules.size(); i++) {
+        if (i > 0) {
+            r.push_back(',');
+        }
+        r.append("{\"id\":" + std::to_string(rules[i].m_id)
+            + ",\"phase\":\"" + kPhaseNames[rules[i].m_phase] + "\""
+            + ",\"ns\":" + std::to_string(rules[i].m_nanoseconds)
+            + "}");
+    }
+    r.append("]}}");
+
+    return r;
+}
+
+
+}  // namespace modsecurity
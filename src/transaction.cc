@@ -47,9 +47,11 @@
 #include "src/utils/system.h"
 #include "src/utils/decode.h"
 #include "src/utils/random.h"
+#include "src/utils/tracepoints.h"
 #include "modsecurity/rule.h"
 #include "modsecurity/rule_message.h"
 #include "modsecurity/rules_set_properties.h"
+#include "modsecurity/slow_capture.h"
 #include "src/actions/disruptive/allow.h"
 #include "src/variables/remote_user.h"
 
@@ -115,11 +117,7 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, void *logCbData)
     m_requestBodyType(UnknownFormat),
     m_requestBodyProcessor(UnknownFormat),
     m_rules(rules),
-    m_ruleRemoveById(),
-    m_ruleRemoveByIdRange(),
-    m_ruleRemoveByTag(),
-    m_ruleRemoveTargetByTag(),
-    m_ruleRemoveTargetById(),
+    m_ruleExclusions(rules ? &rules->m_ruleIds : nullptr),
     m_requestBodyAccess(RulesSet::PropertyNotSetConfigBoolean),
     m_auditLogModifier(),
     m_ctlAuditEngine(AuditLog::AuditLogStatus::NotSetLogStatus),
@@ -129,6 +127,12 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, void *logCbData)
     /* m_id(), */
     m_skip_next(0),
     m_allowType(modsecurity::actions::disruptive::NoneAllowType),
+    m_sliceRules(0),
+    m_sliceTime(0),
+    m_suspendedPhase(-1),
+    m_suspendedRule(0),
+    m_geoLookupAddress(),
+    m_geoLookupResult(-1),
     m_uri_decoded(""),
     m_actions(),
     m_it(),
@@ -152,6 +156,8 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, void *logCbData)
     m_variableEnvs(),
     m_variableHighestSeverityAction(""),
     m_variableRemoteUser(""),
+    m_remoteUser(),
+    m_remoteUserResolved(false),
     m_variableTime(""),
     m_variableTimeDay(""),
     m_variableTimeEpoch(""),
@@ -162,13 +168,28 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, void *logCbData)
     m_variableTimeYear(""),
     m_logCbData(logCbData),
     TransactionAnchoredVariables(this) {
-    m_id = std::unique_ptr<std::string>( new std::string(
-        std::to_string(m_timeStamp)));
-        //+ std::to_string(modsecurity::utils::generate_transaction_unique_id())));
-        // Wasm VM does not support the random generation that involves a file system operation
+    char id[TRANSACTION_ID_SIZE];
+    UniqueId::transactionId(m_timeStamp, id);
+    m_id = std::unique_ptr<std::string>(new std::string(id,
+        TRANSACTION_ID_SIZE - 1));
 
     m_variableUrlEncodedError.set("0", 0);
 
+    if (m_ms) {
+        m_ms->m_metrics.transaction();
+    }
+    if (m_rules) {
+        m_slowCapture = std::atomic_load(&m_rules->m_slowCapture);
+    }
+    if (m_slowCapture) {
+        m_captureTimings.reset(new CaptureTimings());
+    }
+    if (m_ms && m_ms->m_shadow && m_ms->m_shadow->sample()) {
+        m_shadowMatches.reset(new ShadowMatches());
+    }
+
+    MSC_TRACE1(transaction__begin, m_id->c_str());
+
     ms_dbg(4, "Initializing transaction");
 
     intervention::clean(&m_it);
@@ -190,11 +211,7 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, char *id, void *logCb
     m_requestBodyType(UnknownFormat),
     m_requestBodyProcessor(UnknownFormat),
     m_rules(rules),
-    m_ruleRemoveById(),
-    m_ruleRemoveByIdRange(),
-    m_ruleRemoveByTag(),
-    m_ruleRemoveTargetByTag(),
-    m_ruleRemoveTargetById(),
+    m_ruleExclusions(rules ? &rules->m_ruleIds : nullptr),
     m_requestBodyAccess(RulesSet::PropertyNotSetConfigBoolean),
     m_auditLogModifier(),
     m_ctlAuditEngine(AuditLog::AuditLogStatus::NotSetLogStatus),
@@ -204,6 +221,12 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, char *id, void *logCb
     m_id(std::unique_ptr<std::string>(new std::string(id))),
     m_skip_next(0),
     m_allowType(modsecurity::actions::disruptive::NoneAllowType),
+    m_sliceRules(0),
+    m_sliceTime(0),
+    m_suspendedPhase(-1),
+    m_suspendedRule(0),
+    m_geoLookupAddress(),
+    m_geoLookupResult(-1),
     m_uri_decoded(""),
     m_actions(),
     m_it(),
@@ -227,6 +250,8 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, char *id, void *logCb
     m_variableEnvs(),
     m_variableHighestSeverityAction(""),
     m_variableRemoteUser(""),
+    m_remoteUser(),
+    m_remoteUserResolved(false),
     m_variableTime(""),
     m_variableTimeDay(""),
     m_variableTimeEpoch(""),
@@ -240,6 +265,21 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, char *id, void *logCb
 
     m_variableUrlEncodedError.set("0", 0);
 
+    if (m_ms) {
+        m_ms->m_metrics.transaction();
+    }
+    if (m_rules) {
+        m_slowCapture = std::atomic_load(&m_rules->m_slowCapture);
+    }
+    if (m_slowCapture) {
+        m_captureTimings.reset(new CaptureTimings());
+    }
+    if (m_ms && m_ms->m_shadow && m_ms->m_shadow->sample()) {
+        m_shadowMatches.reset(new ShadowMatches());
+    }
+
+    MSC_TRACE1(transaction__begin, m_id->c_str());
+
     ms_dbg(4, "Initializing transaction");
 
     intervention::clean(&m_it);
@@ -247,6 +287,15 @@ Transaction::Transaction(ModSecurity *ms, RulesSet *rules, char *id, void *logCb
 
 
 Transaction::~Transaction() {
+    MSC_TRACE1(transaction__end, m_id->c_str());
+
+    if (m_captureTimings && m_slowCapture) {
+        m_slowCapture->capture(this);
+    }
+    if (m_shadowMatches && m_ms && m_ms->m_shadow) {
+        m_ms->m_shadow->submit(this);
+    }
+
     m_responseBody.str(std::string());
     m_responseBody.clear();
 
@@ -311,6 +360,10 @@ void Transaction::debug(int level, const std::string& message) const {
  */
 int Transaction::processConnection(const char *client, int cPort,
     const char *server, int sPort) {
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::ConnectionPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::ConnectionPhase);
+
     m_clientIpAddress = std::unique_ptr<std::string>(new std::string(client));
     m_serverIpAddress = std::unique_ptr<std::string>(new std::string(server));
     this->m_clientPort = cPort;
@@ -442,6 +495,10 @@ bool Transaction::addArgument(const std::string& orig, const std::string& key,
  */
 int Transaction::processURI(const char *uri, const char *method,
     const char *http_version) {
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::UriPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::UriPhase);
+
 
     ms_dbg(4, "Starting phase URI. (SecRules 0 + 1/2)");
 
@@ -571,6 +628,13 @@ int Transaction::processURI(const char *uri, const char *method,
  *
  */
 int Transaction::processRequestHeaders() {
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::RequestHeadersPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::RequestHeadersPhase);
+
+    if (m_suspendedPhase == modsecurity::RequestHeadersPhase) {
+        return evaluatePhase(modsecurity::RequestHeadersPhase);
+    }
     ms_dbg(4, "Starting phase REQUEST_HEADERS.  (SecRules 1)");
 
     if (getRuleEngineState() == RulesSet::DisabledRuleEngine) {
@@ -578,9 +642,7 @@ int Transaction::processRequestHeaders() {
         return true;
     }
 
-    this->m_rules->evaluate(modsecurity::RequestHeadersPhase, this);
-
-    return true;
+    return evaluatePhase(modsecurity::RequestHeadersPhase);
 }
 
 
@@ -613,6 +675,7 @@ int Transaction::addRequestHeader(const std::string& key,
     if (keyl == "authorization") {
         std::vector<std::string> type = utils::string::split(value, ' ');
         m_variableAuthType.set(type[0], m_variableOffset);
+        m_remoteUserResolved = false;
     }
 
     if (keyl == "cookie") {
@@ -784,6 +847,17 @@ int Transaction::addRequestHeader(const unsigned char *key, size_t key_n,
  *
  */
 int Transaction::processRequestBody() {
+    if (completeSuspendedPhase(modsecurity::RequestBodyPhase)) {
+        return true;
+    }
+
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::RequestBodyPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::RequestBodyPhase);
+
+    if (m_suspendedPhase == modsecurity::RequestBodyPhase) {
+        return evaluatePhase(modsecurity::RequestBodyPhase);
+    }
     ms_dbg(4, "Starting phase REQUEST_BODY. (SecRules 2)");
 
     if (getRuleEngineState() == RulesSetProperties::DisabledRuleEngine) {
@@ -806,6 +880,10 @@ int Transaction::processRequestBody() {
     std::unique_ptr<std::string> a = m_variableRequestHeaders.resolveFirst(
         "Content-Type");
 
+    int processor = m_requestBodyProcessor != UnknownFormat ?
+        m_requestBodyProcessor : m_requestBodyType;
+    MSC_TRACE2(body__processor__begin, m_id->c_str(), processor);
+
     bool requestBodyNoFilesLimitExceeded = false;
     if ((m_requestBodyType == WWWFormUrlEncoded) ||
         (m_requestBodyProcessor == JSONRequestBody) ||
@@ -934,6 +1012,13 @@ int Transaction::processRequestBody() {
         m_variableReqbodyProcessorError.set("0", m_variableOffset);
     }
 
+    MSC_TRACE3(body__processor__end, m_id->c_str(), processor,
+        m_variableReqbodyError.m_value == "1");
+
+    if (m_ms && m_variableReqbodyError.m_value == "1") {
+        m_ms->m_metrics.bodyParserError();
+    }
+
     if (m_rules->m_secRequestBodyAccess == RulesSetProperties::FalseConfigBoolean) {
         if (m_requestBodyAccess != RulesSetProperties::TrueConfigBoolean) {
             ms_dbg(4, "Request body processing is disabled");
@@ -977,8 +1062,11 @@ int Transaction::processRequestBody() {
             m_variableOffset, m_requestBody.str().size());
     }
 
-    this->m_rules->evaluate(modsecurity::RequestBodyPhase, this);
-    return true;
+    if (m_ms && m_requestBody.tellp() > 0) {
+        m_ms->m_metrics.bodyBytes(false, m_requestBody.tellp());
+    }
+
+    return evaluatePhase(modsecurity::RequestBodyPhase);
 }
 
 
@@ -1100,6 +1188,17 @@ int Transaction::appendRequestBody(const unsigned char *buf, size_t len) {
  *
  */
 int Transaction::processResponseHeaders(int code, const std::string& proto) {
+    if (completeSuspendedPhase(modsecurity::ResponseHeadersPhase)) {
+        return true;
+    }
+
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::ResponseHeadersPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::ResponseHeadersPhase);
+
+    if (m_suspendedPhase == modsecurity::ResponseHeadersPhase) {
+        return evaluatePhase(modsecurity::ResponseHeadersPhase);
+    }
     ms_dbg(4, "Starting phase RESPONSE_HEADERS. (SecRules 3)");
 
     this->m_httpCodeReturned = code;
@@ -1111,8 +1210,7 @@ int Transaction::processResponseHeaders(int code, const std::string& proto) {
         return true;
     }
 
-    this->m_rules->evaluate(modsecurity::ResponseHeadersPhase, this);
-    return true;
+    return evaluatePhase(modsecurity::ResponseHeadersPhase);
 }
 
 
@@ -1225,6 +1323,17 @@ int Transaction::addResponseHeader(const unsigned char *key, size_t key_n,
  *
  */
 int Transaction::processResponseBody() {
+    if (completeSuspendedPhase(modsecurity::ResponseBodyPhase)) {
+        return true;
+    }
+
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::ResponseBodyPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::ResponseBodyPhase);
+
+    if (m_suspendedPhase == modsecurity::ResponseBodyPhase) {
+        return evaluatePhase(modsecurity::ResponseBodyPhase);
+    }
     ms_dbg(4, "Starting phase RESPONSE_BODY. (SecRules 4)");
 
     if (getRuleEngineState() == RulesSet::DisabledRuleEngine) {
@@ -1262,8 +1371,11 @@ int Transaction::processResponseBody() {
     m_variableResponseContentLength.set(std::to_string(
         m_responseBody.str().size()), m_variableOffset);
 
-    m_rules->evaluate(modsecurity::ResponseBodyPhase, this);
-    return true;
+    if (m_ms && m_responseBody.tellp() > 0) {
+        m_ms->m_metrics.bodyBytes(true, m_responseBody.tellp());
+    }
+
+    return evaluatePhase(modsecurity::ResponseBodyPhase);
 }
 
 
@@ -1412,6 +1524,12 @@ size_t Transaction::getRequestBodyLength() {
  *
  */
 int Transaction::processLogging() {
+    completeSuspendedPhase(modsecurity::LoggingPhase);
+
+    utils::PhaseTrace trace(m_id->c_str(), modsecurity::LoggingPhase);
+    CaptureTimings::Clock clock(m_captureTimings.get(),
+        modsecurity::LoggingPhase);
+
     ms_dbg(4, "Starting phase LOGGING. (SecRules 5)");
 
     if (getRuleEngineState() == RulesSet::DisabledRuleEngine) {
@@ -1419,7 +1537,7 @@ int Transaction::processLogging() {
         return true;
     }
 
-    this->m_rules->evaluate(modsecurity::LoggingPhase, this);
+    evaluatePhase(modsecurity::LoggingPhase);
 
     /* If relevant, save this transaction information at the audit_logs */
     if (m_rules != NULL && m_rules->m_auditLog != NULL) {
@@ -1476,6 +1594,13 @@ bool Transaction::intervention(ModSecurityIntervention *it) {
         it->disruptive = m_it.disruptive;
         it->status = m_it.status;
 
+        if (m_ms) {
+            m_ms->m_metrics.intervention(m_it.status);
+        }
+        if (m_captureTimings) {
+            m_captureTimings->m_status = m_it.status;
+        }
+
         if (m_it.log != NULL) {
             std::string log("");
             log.append(m_it.log);
@@ -1860,6 +1985,11 @@ void Transaction::serverLog(std::shared_ptr<RuleMessage> rm) {
 }
 
 
+void Transaction::ruleMatched(int64_t ruleId, int phase) {
+    m_ms->ruleMatched(m_logCbData, ruleId, phase);
+}
+
+
 int Transaction::getRuleEngineState() const {
     if (m_secRuleEngine == RulesSetProperties::PropertyNotSetRuleEngine) {
         return m_rules->m_secRuleEngine;
@@ -1892,6 +2022,59 @@ int Transaction::updateStatusCode(int code) {
 }
 
 
+/**
+ * @name    setEvaluationSlice
+ * @brief   Bounds the work done by a single phase processing call.
+ *
+ * Once `rules' rules were evaluated or `usec' microseconds elapsed,
+ * whatever comes first, the evaluation of the request and response
+ * phases is suspended and MSC_PHASE_SUSPENDED is returned. The phase is
+ * resumed, where it stopped, by calling the same process function again.
+ * Meant for event loop based servers, that can not afford to be blocked
+ * by a single expensive request.
+ *
+ * @param rules Maximum amount of rules per call, 0 for no limit.
+ * @param usec Maximum amount of microseconds per call, 0 for no limit.
+ *
+ */
+void Transaction::setEvaluationSlice(int rules, int usec) {
+    m_sliceRules = rules > 0 ? rules : 0;
+    m_sliceTime = usec > 0 ? usec : 0;
+}
+
+
+/*
+ * A phase left suspended is completed, in one go, before anything of the
+ * next phase is processed: a connector that does not resume it still gets
+ * all the rules evaluated, in order, and what they change for the next
+ * phase (ctl:requestBodyProcessor, ctl:requestBodyAccess, ctl:ruleRemove*
+ * and so on) is in place before that phase starts. Returns true if the
+ * completed phase ended in a disruptive action.
+ */
+bool Transaction::completeSuspendedPhase(int phase) {
+    if (m_suspendedPhase == -1 || m_suspendedPhase == phase) {
+        return false;
+    }
+
+    int rules = m_sliceRules;
+    int usec = m_sliceTime;
+    m_sliceRules = 0;
+    m_sliceTime = 0;
+    m_rules->evaluate(m_suspendedPhase, this);
+    m_sliceRules = rules;
+    m_sliceTime = usec;
+    return m_it.disruptive != 0;
+}
+
+
+int Transaction::evaluatePhase(int phase) {
+    if (m_rules->evaluate(phase, this) == MSC_PHASE_SUSPENDED) {
+        return MSC_PHASE_SUSPENDED;
+    }
+    return true;
+}
+
+
 /**
  * @name    msc_new_transaction
  * @brief   Create a new transaction for a given configuration and ModSecurity core.
@@ -2358,5 +2541,30 @@ extern "C" int msc_update_status_code(Transaction *transaction, int status) {
 }
 
 
+/**
+ * @name    msc_set_evaluation_slice
+ * @brief   Bounds the work done by a single phase processing call.
+ *
+ * Once the limits are reached, msc_process_request_headers,
+ * msc_process_request_body, msc_process_response_headers and
+ * msc_process_response_body return MSC_PHASE_SUSPENDED. Calling the
+ * same function again resumes the evaluation where it stopped.
+ *
+ * @param transaction ModSecurity transaction.
+ * @param rules Maximum amount of rules per call, 0 for no limit.
+ * @param usec Maximum amount of microseconds per call, 0 for no limit.
+ *
+ * @returns If the operation was successful or not.
+ * @retval 1 Operation was successful.
+ * @retval 0 Operation failed.
+ *
+ */
+extern "C" int msc_set_evaluation_slice(Transaction *transaction, int rules,
+    int usec) {
+    transaction->setEvaluationSlice(rules, usec);
+    return true;
+}
+
+
 }  // namespace modsecurity
 
@@ -0,0 +1,161 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "modsecurity/transaction_batch.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/intervention.h"
+#include "src/utils/thread_pool.h"
+
+
+namespace modsecurity {
+
+
+TransactionBatch::TransactionBatch(ModSecurity *ms, RulesSet *rules,
+    int workers)
+    : m_ms(ms),
+    m_rules(rules),
+    m_pool(new utils::ThreadPool(workers < 0 ?
+        utils::ThreadPool::defaultWorkers() : workers)) { }
+
+
+TransactionBatch::~TransactionBatch() { }
+
+
+size_t TransactionBatch::workers() const {
+    return m_pool->size();
+}
+
+
+/**
+ * Drives a single request through all the phases, stopping at the first
+ * disruptive intervention the same way a connector would.
+ */
+void TransactionBatch::evaluate(ModSecurity *ms, RulesSet *rules,
+    const BatchRequest &r, ModSecurityIntervention *it,
+    const std::function<void(Transaction *)> &done) {
+    evaluate(ms, rules, r, it, nullptr, done);
+}
+
+
+void TransactionBatch::evaluate(ModSecurity *ms, RulesSet *rules,
+    const BatchRequest &r, ModSecurityIntervention *it,
+    const std::function<void(Transaction *)> &start,
+    const std::function<void(Transaction *)> &done) {
+    Transaction *t = new Transaction(ms, rules, r.m_logCbData);
+
+    intervention::clean(it);
+    if (start) {
+        start(t);
+    }
+
+    t->processConnection(r.m_clientIp.c_str(), r.m_clientPort,
+        r.m_serverIp.c_str(), r.m_serverPort);
+    if (t->intervention(it)) {
+        goto logging;
+    }
+
+    t->processURI(r.m_uri.c_str(), r.m_method.c_str(),
+        r.m_httpVersion.c_str());
+    if (t->intervention(it)) {
+        goto logging;
+    }
+
+    for (const auto &h : r.m_requestHeaders) {
+        t->addRequestHeader(h.first, h.second);
+    }
+    t->processRequestHeaders();
+    if (t->intervention(it)) {
+        goto logging;
+    }
+
+    if (r.m_requestBodyData != nullptr) {
+        t->appendRequestBody(
+            reinterpret_cast<const unsigned char *>(r.m_requestBodyData),
+            r.m_requestBodySize);
+    } else if (!r.m_requestBody.empty()) {
+        t->appendRequestBody(
+            reinterpret_cast<const unsigned char *>(r.m_requestBody.c_str()),
+            r.m_requestBody.size());
+    }
+    t->processRequestBody();
+    if (t->intervention(it) || r.m_responseStatus == 0) {
+        goto logging;
+    }
+
+    for (const auto &h : r.m_responseHeaders) {
+        t->addResponseHeader(h.first, h.second);
+    }
+    t->processResponseHeaders(r.m_responseStatus, r.m_responseProtocol);
+    if (t->intervention(it)) {
+        goto logging;
+    }
+
+    if (r.m_responseBodyData != nullptr) {
+        t->appendResponseBody(
+            reinterpret_cast<const unsigned char *>(r.m_responseBodyData),
+            r.m_responseBodySize);
+    } else if (!r.m_responseBody.empty()) {
+        t->appendResponseBody(
+            reinterpret_cast<const unsigned char *>(r.m_responseBody.c_str()),
+            r.m_responseBody.size());
+    }
+    t->processResponseBody();
+    t->intervention(it);
+
+logging:
+    t->processLogging();
+    if (done) {
+        done(t);
+    }
+    delete t;
+}
+
+
+size_t TransactionBatch::process(const std::vector<BatchRequest> &requests,
+    CompletionCb cb) {
+    std::atomic<size_t> disruptive(0);
+    utils::WaitGroup wg;
+
+    wg.add(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        m_pool->submit([this, i, &requests, &cb, &disruptive, &wg] () {
+            ModSecurityIntervention it;
+            evaluate(m_ms, m_rules, requests[i], &it,
+                [i, &cb, &it] (Transaction *t) {
+                    if (cb) {
+                        cb(i, t, &it);
+                    }
+                });
+            if (it.disruptive) {
+                disruptive++;
+            }
+            intervention::free(&it);
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    return disruptive;
+}
+
+
+}  // namespace modsecurity
@@ -47,16 +47,117 @@
 #include <sys/utsname.h>
 #endif
 
+#if !defined(WIN32) && !defined(__EMSCRIPTEN__) && !defined(__wasi__)
+#include <pthread.h>
+#endif
+
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
 #include "src/utils/sha1.h"
 
 namespace modsecurity {
 
 std::once_flag UniqueId::onceFlag;
 
+
+namespace {
+
+/* splitmix64 finalizer, a bijection with good avalanche. */
+inline uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+uint64_t hostSeed() {
+    int local = 0;
+    uint64_t seed = mix(std::chrono::system_clock::now()
+        .time_since_epoch().count());
+    seed = mix(seed ^ std::chrono::steady_clock::now()
+        .time_since_epoch().count());
+    seed = mix(seed ^ reinterpret_cast<uintptr_t>(&local));
+    seed = mix(seed ^ reinterpret_cast<uintptr_t>(&hostSeed));
+    seed = mix(seed ^ std::hash<std::thread::id>()(
+        std::this_thread::get_id()));
+#if !defined(WIN32) && !defined(__wasi__)
+    seed = mix(seed ^ static_cast<uint64_t>(getpid()));
+#endif
+    return seed;
+}
+
+
+std::atomic<uint64_t> processSeed(0);
+std::atomic<uint64_t> threadCount(0);
+std::atomic<unsigned int> generation(0);
+std::once_flag seedOnce;
+
+
+void reseed() {
+    processSeed = hostSeed();
+    threadCount = 0;
+    generation++;
+}
+
+
+struct ThreadIds {
+    ThreadIds() : m_generation(0), m_tag(0), m_counter(0) { }
+    unsigned int m_generation;
+    uint64_t m_tag;
+    uint32_t m_counter;
+};
+
+
+thread_local ThreadIds threadIds;
+
+
+inline void toHex(uint64_t v, int digits, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = hex[v & 0xf];
+        v >>= 4;
+    }
+}
+
+}  // namespace
+
+
+void UniqueId::transactionId(time_t timestamp, char *buf) {
+    std::call_once(seedOnce, [] {
+        reseed();
+#if !defined(WIN32) && !defined(__EMSCRIPTEN__) && !defined(__wasi__)
+        pthread_atfork(NULL, NULL, reseed);
+#endif
+    });
+
+    ThreadIds &ids = threadIds;
+    unsigned int g = generation.load(std::memory_order_acquire);
+    if (ids.m_generation != g) {
+        /*
+         * Distinct ordinals give distinct tags: the seed is only offset,
+         * and mix() is a bijection.
+         */
+        ids.m_tag = mix(processSeed.load() + (threadCount.fetch_add(1) + 1)
+            * 0x9e3779b97f4a7c15ULL);
+        ids.m_counter = 0;
+        ids.m_generation = g;
+    }
+
+    toHex(static_cast<uint64_t>(timestamp), 8, buf);
+    toHex(ids.m_tag, 16, buf + 8);
+    toHex(ids.m_counter++, 8, buf + 24);
+    buf[TRANSACTION_ID_SIZE - 1] = '\0';
+}
+
+
 void UniqueId::fillUniqueId() {
     std::string macAddress;
     std::string name;
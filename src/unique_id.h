@@ -14,6 +14,8 @@
  */
 
 #ifdef __cplusplus
+#include <cstdint>
+#include <ctime>
 #include <string>
 #include <mutex>
 #endif
@@ -28,6 +30,7 @@ namespace modsecurity {
 
 #define MAC_ADDRESS_SIZE 19
 #define MAX_MACHINE_NAME_SIZE 256
+#define TRANSACTION_ID_SIZE 33
 
 /** @ingroup ModSecurity_CPP_API */
 class UniqueId {
@@ -45,6 +48,18 @@ class UniqueId {
         return UniqueId::getInstance().uniqueId_str;
     }
 
+    /**
+     * Writes a new transaction id, as 32 hexadecimal digits and a
+     * terminating NUL, into buf (TRANSACTION_ID_SIZE bytes).
+     *
+     * The id is made of the given timestamp, a tag unique to the calling
+     * thread within this process and a per thread counter. Neither a
+     * filesystem nor a random device is needed: the process seed the
+     * thread tags derive from is mixed out of clocks, addresses and the
+     * pid, and taken again in the child after a fork. No lock is taken.
+     */
+    static void transactionId(time_t timestamp, char *buf);
+
     void fillUniqueId();
     static std::string machineName();
     static std::string ethernetMacAddress();
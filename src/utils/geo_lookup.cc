@@ -22,6 +22,7 @@
 #include <fstream>
 #include <iostream>
 
+#include "modsecurity/modsecurity.h"
 #include "src/utils/geo_lookup.h"
 #if WITH_MAXMIND
 #include <maxminddb.h>
@@ -51,6 +52,7 @@ void GeoLookup::cleanUp() {
     }
 #endif
     m_version = NOT_LOADED;
+    m_cache.clear();
 }
 
 
@@ -108,12 +110,14 @@ bool GeoLookup::setDataBase(const std::string& filePath,
         return false;
     }
 
+    m_cache.clear();
     return true;
 }
 
 
 bool GeoLookup::lookup(const std::string& target, Transaction *trans,
     std::function<bool(int, const std::string &)> debug) const {
+    Record record;
 
     if (m_version == NOT_LOADED) {
         if (debug) {
@@ -123,6 +127,41 @@ bool GeoLookup::lookup(const std::string& target, Transaction *trans,
         return false;
     }
 
+    bool hit = m_cache.get(target, &record);
+    if (trans && trans->m_ms) {
+        trans->m_ms->m_metrics.cacheLookup(Metrics::GeoCache, hit);
+    }
+    if (!hit) {
+        if (!resolve(target, &record, debug)) {
+            return false;
+        }
+        m_cache.put(target, record);
+    }
+
+    if (!record.m_found) {
+        return false;
+    }
+
+    if (trans) {
+        for (const auto &field : record.m_fields) {
+            trans->m_variableGeo.set(field.first, field.second, 0);
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Reads the GEO fields of an address from the database. Returns false
+ * when the lookup itself failed; an address the database does not know
+ * is a valid (not found) record.
+ */
+bool GeoLookup::resolve(const std::string& target, Record *record,
+    std::function<bool(int, const std::string &)> debug) const {
+    record->m_found = false;
+    record->m_fields.clear();
+
 #ifdef WITH_MAXMIND
     if (m_version == VERSION_MAXMIND) {
         int gai_error, mmdb_error;
@@ -147,62 +186,63 @@ bool GeoLookup::lookup(const std::string& target, Transaction *trans,
         }
 
         if (!r.found_entry) {
-            return false;
+            return true;
         } else {
+            record->m_found = true;
             MMDB_entry_data_s entry_data;
 
             int status = MMDB_get_value(&r.entry, &entry_data,
                 "country", "iso_code", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("COUNTRY_CODE",
+                record->m_fields.emplace_back("COUNTRY_CODE",
                     std::string(entry_data.utf8_string,
-                        entry_data.data_size), 0);
+                        entry_data.data_size));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "country", "names", "en", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("COUNTRY_NAME",
+                record->m_fields.emplace_back("COUNTRY_NAME",
                     std::string(entry_data.utf8_string,
-                        entry_data.data_size), 0);
+                        entry_data.data_size));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "continent", "names", "en", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("COUNTRY_CONTINENT",
+                record->m_fields.emplace_back("COUNTRY_CONTINENT",
                     std::string(entry_data.utf8_string,
-                        entry_data.data_size), 0);
+                        entry_data.data_size));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "city", "names", "en", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("CITY",
+                record->m_fields.emplace_back("CITY",
                     std::string(entry_data.utf8_string,
-                        entry_data.data_size), 0);
+                        entry_data.data_size));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "postal", "code", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("POSTAL_CODE",
+                record->m_fields.emplace_back("POSTAL_CODE",
                     std::string(entry_data.utf8_string,
-                        entry_data.data_size), 0);
+                        entry_data.data_size));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "location", "latitude", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("LATITUDE",
-                    std::to_string(entry_data.double_value), 0);
+                record->m_fields.emplace_back("LATITUDE",
+                    std::to_string(entry_data.double_value));
             }
 
             status = MMDB_get_value(&r.entry, &entry_data,
                 "location", "longitude", NULL);
             if (status == MMDB_SUCCESS && entry_data.has_data) {
-                trans->m_variableGeo.set("LONGITUDE",
-                    std::to_string(entry_data.double_value), 0);
+                record->m_fields.emplace_back("LONGITUDE",
+                    std::to_string(entry_data.double_value));
             }
 
             /*
@@ -243,54 +283,53 @@ bool GeoLookup::lookup(const std::string& target, Transaction *trans,
         GeoIPRecord *gir;
         gir = GeoIP_record_by_name(m_gi, target.c_str());
         if (gir == NULL) {
-            return false;
+            return true;
         }
 
-        if (trans) {
-            if (gir->country_code) {
-                trans->m_variableGeo.set("COUNTRY_CODE",
-                    std::string(gir->country_code), 0);
-            }
-            if (gir->country_code3) {
-                trans->m_variableGeo.set("COUNTRY_CODE3",
-                    std::string(gir->country_code3), 0);
-            }
-            if (gir->country_name) {
-                trans->m_variableGeo.set("COUNTRY_NAME",
-                    std::string(gir->country_name), 0);
-            }
-            if (gir->continent_code) {
-                trans->m_variableGeo.set("COUNTRY_CONTINENT",
-                    std::string(gir->continent_code), 0);
-            }
-            if (gir->country_code && gir->region) {
-                trans->m_variableGeo.set("REGION",
-                    std::string(GeoIP_region_name_by_code(gir->country_code,
-                        gir->region)), 0);
-            }
-            if (gir->city) {
-                trans->m_variableGeo.set("CITY", std::string(gir->city), 0);
-            }
-            if (gir->postal_code) {
-                trans->m_variableGeo.set("POSTAL_CODE",
-                    std::string(gir->postal_code), 0);
-            }
-            if (gir->latitude) {
-                trans->m_variableGeo.set("LATITUDE",
-                    std::to_string(gir->latitude), 0);
-            }
-            if (gir->longitude) {
-                trans->m_variableGeo.set("LONGITUDE",
-                    std::to_string(gir->longitude), 0);
-            }
-            if (gir->metro_code) {
-                trans->m_variableGeo.set("DMA_CODE",
-                    std::to_string(gir->metro_code), 0);
-            }
-            if (gir->area_code) {
-                trans->m_variableGeo.set("AREA_CODE",
-                    std::to_string(gir->area_code), 0);
-            }
+        record->m_found = true;
+        if (gir->country_code) {
+            record->m_fields.emplace_back("COUNTRY_CODE",
+                std::string(gir->country_code));
+        }
+        if (gir->country_code3) {
+            record->m_fields.emplace_back("COUNTRY_CODE3",
+                std::string(gir->country_code3));
+        }
+        if (gir->country_name) {
+            record->m_fields.emplace_back("COUNTRY_NAME",
+                std::string(gir->country_name));
+        }
+        if (gir->continent_code) {
+            record->m_fields.emplace_back("COUNTRY_CONTINENT",
+                std::string(gir->continent_code));
+        }
+        if (gir->country_code && gir->region) {
+            record->m_fields.emplace_back("REGION",
+                std::string(GeoIP_region_name_by_code(gir->country_code,
+                    gir->region)));
+        }
+        if (gir->city) {
+            record->m_fields.emplace_back("CITY", std::string(gir->city));
+        }
+        if (gir->postal_code) {
+            record->m_fields.emplace_back("POSTAL_CODE",
+                std::string(gir->postal_code));
+        }
+        if (gir->latitude) {
+            record->m_fields.emplace_back("LATITUDE",
+                std::to_string(gir->latitude));
+        }
+        if (gir->longitude) {
+            record->m_fields.emplace_back("LONGITUDE",
+                std::to_string(gir->longitude));
+        }
+        if (gir->metro_code) {
+            record->m_fields.emplace_back("DMA_CODE",
+                std::to_string(gir->metro_code));
+        }
+        if (gir->area_code) {
+            record->m_fields.emplace_back("AREA_CODE",
+                std::to_string(gir->area_code));
         }
 
         GeoIPRecord_delete(gir);
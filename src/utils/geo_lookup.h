@@ -17,6 +17,8 @@
 #include <fstream>
 #include <string>
 #include <functional>
+#include <utility>
+#include <vector>
 
 #if WITH_MAXMIND
 #include <maxminddb.h>
@@ -29,6 +31,7 @@
 #define SRC_UTILS_GEO_LOOKUP_H_
 
 #include "modsecurity/transaction.h"
+#include "src/utils/lru_cache.h"
 
 namespace modsecurity {
 namespace Utils {
@@ -53,16 +56,29 @@ class GeoLookup {
         std::function<bool(int, const std::string &)> debug) const;
 
  private:
+    /**
+     * What the database knows about an address: the GEO collection
+     * entries, in the order they are set.
+     */
+    struct Record {
+        bool m_found;
+        std::vector<std::pair<std::string, std::string>> m_fields;
+    };
+
     GeoLookup() :
         m_version(NOT_LOADED)
 #if WITH_GEOIP
         ,m_gi(NULL)
 #endif
+        ,m_cache(4096, 16)
         { }
     ~GeoLookup();
     GeoLookup(GeoLookup const&);
     void operator=(GeoLookup const&);
 
+    bool resolve(const std::string& target, Record *record,
+        std::function<bool(int, const std::string &)> debug) const;
+
     GeoLookupVersion m_version;
 #if WITH_MAXMIND
     MMDB_s mmdb;
@@ -71,6 +87,11 @@ class GeoLookup {
     GeoIP *m_gi;
 #endif
 
+    /*
+     * Addresses already resolved. Emptied whenever the database is
+     * (re)opened or closed, so it never outlives the data it came from.
+     */
+    mutable utils::LruCache<std::string, Record> m_cache;
 };
 
 
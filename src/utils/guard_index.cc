@@ -0,0 +1,135 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/utils/guard_index.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/transaction.h"
+
+
+namespace modsecurity {
+namespace utils {
+
+
+GuardIndex::GuardIndex(size_t rules)
+    : m_nextUnguarded(rules + 1, 0),
+    m_size(0) { }
+
+
+bool GuardIndex::attribute(const std::string &variable, Attribute *a) {
+    if (variable == "REQUEST_FILENAME") {
+        *a = RequestFilename;
+    } else if (variable == "REQUEST_METHOD") {
+        *a = RequestMethod;
+    } else if (variable == "SERVER_NAME") {
+        *a = ServerName;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+void GuardIndex::add(int rule, Attribute a, const std::string &value,
+    bool prefix) {
+    if (!prefix) {
+        m_exact[a][value].push_back(rule);
+    } else {
+        std::vector<Node> &trie = m_prefixes[a];
+        int node = 0;
+        if (trie.empty()) {
+            trie.emplace_back();
+        }
+        for (unsigned char c : value) {
+            std::vector<std::pair<unsigned char, int>> &next =
+                trie[node].m_next;
+            auto it = std::lower_bound(next.begin(), next.end(),
+                std::make_pair(c, 0));
+            if (it != next.end() && it->first == c) {
+                node = it->second;
+                continue;
+            }
+            next.insert(it, std::make_pair(c,
+                static_cast<int>(trie.size())));
+            node = trie.size();
+            trie.emplace_back();
+        }
+        trie[node].m_rules.push_back(rule);
+    }
+
+    /* Only marks the rule as guarded, see build(). */
+    m_nextUnguarded[rule] = -1;
+    m_size++;
+}
+
+
+void GuardIndex::build() {
+    int next = m_nextUnguarded.size() - 1;
+
+    m_nextUnguarded[next] = next;
+    for (int i = next - 1; i >= 0; i--) {
+        if (m_nextUnguarded[i] != -1) {
+            next = i;
+        }
+        m_nextUnguarded[i] = next;
+    }
+}
+
+
+void GuardIndex::candidates(Transaction *t, std::vector<int> *rules) const {
+    const std::string *values[NumberOfAttributes] = {
+        &t->m_variableRequestFilename.m_value,
+        &t->m_variableRequestMethod.m_value,
+        &t->m_variableServerName.m_value
+    };
+
+    rules->clear();
+    for (int a = 0; a < NumberOfAttributes; a++) {
+        const std::string &value = *values[a];
+
+        auto exact = m_exact[a].find(value);
+        if (exact != m_exact[a].end()) {
+            rules->insert(rules->end(), exact->second.begin(),
+                exact->second.end());
+        }
+
+        const std::vector<Node> &trie = m_prefixes[a];
+        if (trie.empty()) {
+            continue;
+        }
+        int node = 0;
+        for (unsigned char c : value) {
+            const std::vector<std::pair<unsigned char, int>> &next =
+                trie[node].m_next;
+            auto it = std::lower_bound(next.begin(), next.end(),
+                std::make_pair(c, 0));
+            if (it == next.end() || it->first != c) {
+                break;
+            }
+            node = it->second;
+            rules->insert(rules->end(), trie[node].m_rules.begin(),
+                trie[node].m_rules.end());
+        }
+    }
+    std::sort(rules->begin(), rules->end());
+}
+
+
+}  // namespace utils
+}  // namespace modsecurity
@@ -0,0 +1,101 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef SRC_UTILS_GUARD_INDEX_H_
+#define SRC_UTILS_GUARD_INDEX_H_
+
+
+namespace modsecurity {
+class Transaction;
+namespace utils {
+
+
+/**
+ * Rules of a phase that can only match when REQUEST_FILENAME,
+ * REQUEST_METHOD or SERVER_NAME is, or starts with, a given constant
+ * (see RuleWithOperator::getStaticGuard), by that constant.
+ *
+ * Equalities are hashed and prefixes kept in a trie, one of each per
+ * variable, so the guarded rules a request can match are found without
+ * looking at the others; the phase then only visits those and the rules
+ * without a guard.
+ *
+ */
+class GuardIndex {
+ public:
+    enum Attribute {
+        RequestFilename,
+        RequestMethod,
+        ServerName,
+        NumberOfAttributes
+    };
+
+    explicit GuardIndex(size_t rules);
+
+    GuardIndex(const GuardIndex &g) = delete;
+    GuardIndex& operator= (const GuardIndex &g) = delete;
+
+    static bool attribute(const std::string &variable, Attribute *a);
+
+    void add(int rule, Attribute a, const std::string &value, bool prefix);
+
+    /**
+     * To be called once every guarded rule was added.
+     */
+    void build();
+
+    /**
+     * The guarded rules whose guard holds for the transaction, in order.
+     */
+    void candidates(Transaction *t, std::vector<int> *rules) const;
+
+    bool guarded(int rule) const { return m_nextUnguarded[rule] != rule; }
+
+    /**
+     * The first rule, at or after `rule', without a guard; the amount of
+     * rules if there is none.
+     */
+    int nextUnguarded(int rule) const { return m_nextUnguarded[rule]; }
+
+    size_t size() const { return m_size; }
+
+ private:
+    struct Node {
+        /* Children, sorted by the character leading to them. */
+        std::vector<std::pair<unsigned char, int>> m_next;
+        /* Rules whose prefix ends here. */
+        std::vector<int> m_rules;
+    };
+
+    std::unordered_map<std::string, std::vector<int>> m_exact[
+        NumberOfAttributes];
+    /* Root first, when not empty. */
+    std::vector<Node> m_prefixes[NumberOfAttributes];
+    std::vector<int> m_nextUnguarded;
+    size_t m_size;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_GUARD_INDEX_H_
@@ -85,9 +85,10 @@ IpTree::~IpTree() {
     }
 }
 
-bool IpTree::addFromBuffer(std::istream *ss, std::string *error) {
+bool IpTree::addLines(const std::function<bool(std::string *)> &next,
+    std::string *error) {
     char *error_msg = NULL;
-    for (std::string line; std::getline(*ss, line); ) {
+    for (std::string line; next(&line); ) {
         int res = add_ip_from_param(line.c_str(), &m_tree, &error_msg);
         if (res != 0) {
             if (error_msg != NULL) {
@@ -101,6 +102,13 @@ bool IpTree::addFromBuffer(std::istream *ss, std::string *error) {
 }
 
 
+bool IpTree::addFromBuffer(std::istream *ss, std::string *error) {
+    return addLines([ss] (std::string *line) {
+        return static_cast<bool>(std::getline(*ss, *line));
+    }, error);
+}
+
+
 bool IpTree::addFromBuffer(const std::string& buffer, std::string *error) {
     std::stringstream ss;
     ss << buffer;
@@ -108,6 +116,14 @@ bool IpTree::addFromBuffer(const std::string& buffer, std::string *error) {
 }
 
 
+bool IpTree::addFromData(const DataSpan &data, std::string *error) {
+    size_t offset = 0;
+    return addLines([&data, &offset] (std::string *line) {
+        return data.getline(&offset, line);
+    }, error);
+}
+
+
 bool IpTree::addFromFile(const std::string& file, std::string *error) {
     std::ifstream myfile(file, std::ios::in);
 
@@ -21,6 +21,7 @@
 #ifndef SRC_UTILS_IP_TREE_H_
 #define SRC_UTILS_IP_TREE_H_
 
+#include "modsecurity/data_provider.h"
 #include "modsecurity/transaction.h"
 #include "src/utils/msc_tree.h"
 
@@ -37,9 +38,17 @@ class IpTree {
     void postOrderTraversal(TreeNode *node);
     bool addFromBuffer(std::istream *ss, std::string *error);
     bool addFromBuffer(const std::string& buffer, std::string *error);
+    bool addFromData(const DataSpan &data, std::string *error);
     bool addFromFile(const std::string& file, std::string *error);
     bool addFromUrl(const std::string& url, std::string *error);
  private:
+    /*
+     * Adds an address or a network per line, as long as `next' hands
+     * over lines.
+     */
+    bool addLines(const std::function<bool(std::string *)> &next,
+        std::string *error);
+
     TreeRoot *m_tree;
 };
 
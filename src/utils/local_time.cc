@@ -0,0 +1,70 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+
+#include "src/utils/local_time.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <ctime>
+#include <memory>
+#include <string>
+
+
+namespace modsecurity {
+namespace utils {
+
+
+static std::string format(const char *fmt, const struct tm *timeinfo) {
+    char tstr[200];
+
+    memset(tstr, '\0', sizeof(tstr));
+    strftime(tstr, sizeof(tstr), fmt, timeinfo);
+    return std::string(tstr);
+}
+
+
+LocalTime::LocalTime(time_t timer)
+    : m_timer(timer),
+    m_epoch(std::to_string(timer)) {
+    struct tm timeinfo;
+
+    localtime_r(&timer, &timeinfo);
+    m_time = format("%H:%M:%S", &timeinfo);
+    m_day = format("%d", &timeinfo);
+    m_hour = format("%H", &timeinfo);
+    m_min = format("%M", &timeinfo);
+    /* Months count from 0, as in ModSecurity 2. */
+    m_mon = std::to_string(timeinfo.tm_mon);
+    m_sec = format("%S", &timeinfo);
+    m_wday = format("%u", &timeinfo);
+    m_year = format("%Y", &timeinfo);
+}
+
+
+const LocalTime *LocalTime::now() {
+    static thread_local std::unique_ptr<const LocalTime> last;
+    time_t timer = std::time(nullptr);
+
+    if (!last || last->m_timer != timer) {
+        last.reset(new LocalTime(timer));
+    }
+    return last.get();
+}
+
+
+}  // namespace utils
+}  // namespace modsecurity
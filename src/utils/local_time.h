@@ -0,0 +1,62 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+
+#include <ctime>
+#include <string>
+
+#ifndef SRC_UTILS_LOCAL_TIME_H_
+#define SRC_UTILS_LOCAL_TIME_H_
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/**
+ * The current second, already formatted the way the TIME_* variables
+ * expose it.
+ *
+ * Each thread builds the snapshot at most once per second and reads it
+ * without any lock: localtime_r takes the time zone lock and strftime is
+ * not cheap either, while a rule set may read these variables many times
+ * per transaction.
+ */
+class LocalTime {
+ public:
+    explicit LocalTime(time_t timer);
+
+    /**
+     * Valid until the calling thread calls now() again.
+     */
+    static const LocalTime *now();
+
+    time_t m_timer;
+    std::string m_epoch;
+    std::string m_time;
+    std::string m_day;
+    std::string m_hour;
+    std::string m_min;
+    std::string m_mon;
+    std::string m_sec;
+    std::string m_wday;
+    std::string m_year;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+#endif  // SRC_UTILS_LOCAL_TIME_H_
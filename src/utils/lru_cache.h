@@ -0,0 +1,114 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef SRC_UTILS_LRU_CACHE_H_
+#define SRC_UTILS_LRU_CACHE_H_
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/**
+ * Bounded map that, once full, drops the least recently used entry. The
+ * keys are spread over a few shards, each one with its own lock and its
+ * own share of the capacity, so concurrent transactions seldom wait on
+ * each other.
+ *
+ */
+template <typename K, typename V>
+class LruCache {
+ public:
+    LruCache(size_t entries, size_t shards)
+        : m_entriesPerShard(entries / shards > 0 ? entries / shards : 1) {
+        for (size_t i = 0; i < shards; i++) {
+            m_shards.emplace_back(new Shard());
+        }
+    }
+
+    LruCache(const LruCache &c) = delete;
+    LruCache& operator= (const LruCache &c) = delete;
+
+    bool get(const K &key, V *value) {
+        Shard *s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s->m_lock);
+
+        auto it = s->m_index.find(key);
+        if (it == s->m_index.end()) {
+            return false;
+        }
+        s->m_entries.splice(s->m_entries.begin(), s->m_entries, it->second);
+        *value = it->second->second;
+        return true;
+    }
+
+    void put(const K &key, const V &value) {
+        Shard *s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s->m_lock);
+
+        auto it = s->m_index.find(key);
+        if (it != s->m_index.end()) {
+            it->second->second = value;
+            s->m_entries.splice(s->m_entries.begin(), s->m_entries,
+                it->second);
+            return;
+        }
+        if (s->m_index.size() >= m_entriesPerShard) {
+            s->m_index.erase(s->m_entries.back().first);
+            s->m_entries.pop_back();
+        }
+        s->m_entries.emplace_front(key, value);
+        s->m_index[key] = s->m_entries.begin();
+    }
+
+    void clear() {
+        for (auto &s : m_shards) {
+            std::lock_guard<std::mutex> lock(s->m_lock);
+            s->m_index.clear();
+            s->m_entries.clear();
+        }
+    }
+
+ private:
+    struct Shard {
+        std::mutex m_lock;
+        std::list<std::pair<K, V>> m_entries;
+        std::unordered_map<K,
+            typename std::list<std::pair<K, V>>::iterator> m_index;
+    };
+
+    Shard *shardFor(const K &key) {
+        return m_shards[std::hash<K>()(key) % m_shards.size()].get();
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_entriesPerShard;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_LRU_CACHE_H_
@@ -0,0 +1,101 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/utils/negative_cache.h"
+
+#include <functional>
+#include <string>
+
+
+namespace modsecurity {
+namespace utils {
+
+
+static const size_t kShards = 16;
+
+
+NegativeCache::NegativeCache(size_t entries, size_t maxValueLength)
+    : m_entriesPerShard(entries / kShards > 0 ? entries / kShards : 1),
+    m_maxValueLength(maxValueLength),
+    m_hits(0),
+    m_lookups(0) {
+    for (size_t i = 0; i < kShards; i++) {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+
+std::string NegativeCache::key(const void *rule, const std::string &value) {
+    std::string k(reinterpret_cast<const char *>(&rule), sizeof(rule));
+    k.append(value);
+    return k;
+}
+
+
+NegativeCache::Shard *NegativeCache::shardFor(const std::string &key) {
+    return m_shards[std::hash<std::string>()(key) % m_shards.size()].get();
+}
+
+
+bool NegativeCache::contains(const void *rule, const std::string &value) {
+    std::string k = key(rule, value);
+    Shard *s = shardFor(k);
+    bool found;
+
+    {
+        std::lock_guard<std::mutex> lock(s->m_lock);
+        found = s->m_entries.find(k) != s->m_entries.end();
+    }
+
+    m_lookups++;
+    if (found) {
+        m_hits++;
+    }
+    return found;
+}
+
+
+void NegativeCache::insert(const void *rule, const std::string &value) {
+    std::string k = key(rule, value);
+    Shard *s = shardFor(k);
+
+    std::lock_guard<std::mutex> lock(s->m_lock);
+    if (s->m_entries.size() >= m_entriesPerShard) {
+        s->m_entries.erase(s->m_entries.begin());
+    }
+    s->m_entries.insert(std::move(k));
+}
+
+
+void NegativeCache::clear() {
+    for (auto &s : m_shards) {
+        std::lock_guard<std::mutex> lock(s->m_lock);
+        s->m_entries.clear();
+    }
+}
+
+
+size_t NegativeCache::size() {
+    size_t total = 0;
+    for (auto &s : m_shards) {
+        std::lock_guard<std::mutex> lock(s->m_lock);
+        total += s->m_entries.size();
+    }
+    return total;
+}
+
+
+}  // namespace utils
+}  // namespace modsecurity
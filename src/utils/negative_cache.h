@@ -0,0 +1,84 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifndef SRC_UTILS_NEGATIVE_CACHE_H_
+#define SRC_UTILS_NEGATIVE_CACHE_H_
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/**
+ * Remembers the (rule, transformed value) pairs for which the operator of
+ * the rule did not match, so the operator does not need to run again when
+ * the same value shows up in another transaction.
+ *
+ * The whole value is kept as part of the key: a hash collision can not be
+ * turned into a false negative. Values longer than maxValueLength are
+ * never cached. The entries are spread over a few shards, each one with
+ * its own lock; a full shard drops an arbitrary entry to make room.
+ *
+ */
+class NegativeCache {
+ public:
+    NegativeCache(size_t entries, size_t maxValueLength);
+
+    NegativeCache(const NegativeCache &c) = delete;
+    NegativeCache& operator= (const NegativeCache &c) = delete;
+
+    bool accepts(const std::string &value) const {
+        return value.size() <= m_maxValueLength;
+    }
+
+    bool contains(const void *rule, const std::string &value);
+    void insert(const void *rule, const std::string &value);
+    void clear();
+
+    size_t size();
+    uint64_t hits() const { return m_hits; }
+    uint64_t lookups() const { return m_lookups; }
+
+ private:
+    struct Shard {
+        std::mutex m_lock;
+        std::unordered_set<std::string> m_entries;
+    };
+
+    static std::string key(const void *rule, const std::string &value);
+    Shard *shardFor(const std::string &key);
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_entriesPerShard;
+    size_t m_maxValueLength;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_lookups;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_NEGATIVE_CACHE_H_
@@ -0,0 +1,224 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/utils/rbl_resolver.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "src/utils/thread_pool.h"
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/*
+ * Lookups are spread over a few workers only: they spend their time
+ * waiting on the network, and a query is never resolved twice at once.
+ */
+static const int kRblWorkers = 4;
+static const size_t kRblMaxEntries = 65536;
+
+
+RblResolver::Result SystemRblResolver::resolve(const std::string &query,
+    uint32_t *address) {
+#ifdef __EMSCRIPTEN__
+    return Failed;
+#else
+    struct addrinfo hints = {};
+    struct addrinfo *info = NULL;
+
+    hints.ai_family = AF_INET;
+    int rc = getaddrinfo(query.c_str(), NULL, &hints, &info);
+    if (rc != 0) {
+        if (info != NULL) {
+            freeaddrinfo(info);
+        }
+#ifdef EAI_NODATA
+        if (rc == EAI_NODATA) {
+            return NotListed;
+        }
+#endif
+        return rc == EAI_NONAME ? NotListed : Failed;
+    }
+
+    struct sockaddr_in *sin = (struct sockaddr_in *) info->ai_addr;
+    *address = sin->sin_addr.s_addr;
+    freeaddrinfo(info);
+    return Listed;
+#endif
+}
+
+
+void StubRblResolver::add(const std::string &query, uint32_t address) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_records[query] = address;
+}
+
+
+RblResolver::Result StubRblResolver::resolve(const std::string &query,
+    uint32_t *address) {
+    if (m_delayMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMs));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_queries++;
+    auto it = m_records.find(query);
+    if (it == m_records.end()) {
+        return NotListed;
+    }
+    *address = it->second;
+    return Listed;
+}
+
+
+RblCache::RblCache()
+    : m_timeout(1000),
+    m_positiveTtl(300),
+    m_negativeTtl(60),
+    m_unknownMatches(false) {
+#ifndef __EMSCRIPTEN__
+    m_resolver = std::make_shared<SystemRblResolver>();
+#endif
+}
+
+
+RblCache::~RblCache() {
+    /* Joins the workers while the rest of the cache is still around. */
+    m_pool.reset();
+}
+
+
+void RblCache::setResolver(std::shared_ptr<RblResolver> resolver) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_resolver = std::move(resolver);
+    m_entries.clear();
+    m_pending.clear();
+}
+
+
+void RblCache::setTimeout(int ms) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_timeout = std::chrono::milliseconds(ms > 0 ? ms : 0);
+}
+
+
+void RblCache::setTtl(int positiveSeconds, int negativeSeconds) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_positiveTtl = std::chrono::seconds(positiveSeconds > 0 ?
+        positiveSeconds : 0);
+    m_negativeTtl = std::chrono::seconds(negativeSeconds > 0 ?
+        negativeSeconds : 0);
+    m_entries.clear();
+}
+
+
+void RblCache::clear() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_entries.clear();
+}
+
+
+RblCache::Result RblCache::lookup(const std::string &query,
+    uint32_t *address, bool *cached) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    auto now = std::chrono::steady_clock::now();
+
+    auto e = m_entries.find(query);
+    if (e != m_entries.end()) {
+        if (e->second.m_expires > now) {
+            *address = e->second.m_address;
+            if (cached) {
+                *cached = true;
+            }
+            return e->second.m_result;
+        }
+        m_entries.erase(e);
+    }
+    if (cached) {
+        *cached = false;
+    }
+
+    std::shared_ptr<Pending> p;
+    auto it = m_pending.find(query);
+    if (it != m_pending.end()) {
+        p = it->second;
+    } else {
+        if (m_resolver == nullptr) {
+            return Unknown;
+        }
+        if (m_pool == nullptr) {
+            m_pool.reset(new ThreadPool(kRblWorkers));
+        }
+        p = std::make_shared<Pending>();
+        m_pending[query] = p;
+
+        std::shared_ptr<RblResolver> resolver = m_resolver;
+        lock.unlock();
+        m_pool->submit([this, query, p, resolver] {
+            uint32_t a = 0;
+            RblResolver::Result r = resolver->resolve(query, &a);
+            complete(query, p, r, a);
+        });
+        lock.lock();
+    }
+
+    if (!m_cond.wait_for(lock, m_timeout, [&p] { return p->m_done; })) {
+        return Unknown;
+    }
+    *address = p->m_address;
+    return p->m_result;
+}
+
+
+void RblCache::complete(const std::string &query, std::shared_ptr<Pending> p,
+    RblResolver::Result r, uint32_t address) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    p->m_done = true;
+    p->m_address = address;
+    p->m_result = r == RblResolver::Listed ? Listed :
+        r == RblResolver::NotListed ? NotListed : Unknown;
+
+    auto it = m_pending.find(query);
+    if (it != m_pending.end() && it->second == p) {
+        m_pending.erase(it);
+
+        /* Failures are not kept, the next lookup tries again. */
+        if (p->m_result != Unknown) {
+            if (m_entries.size() >= kRblMaxEntries) {
+                m_entries.clear();
+            }
+            Entry &entry = m_entries[query];
+            entry.m_result = p->m_result;
+            entry.m_address = address;
+            entry.m_expires = std::chrono::steady_clock::now() +
+                (p->m_result == Listed ? m_positiveTtl : m_negativeTtl);
+        }
+    }
+    m_cond.notify_all();
+}
+
+
+}  // namespace utils
+}  // namespace modsecurity
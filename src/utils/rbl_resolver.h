@@ -0,0 +1,171 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#ifndef SRC_UTILS_RBL_RESOLVER_H_
+#define SRC_UTILS_RBL_RESOLVER_H_
+
+
+namespace modsecurity {
+namespace utils {
+
+class ThreadPool;
+
+
+/**
+ * Answers a RBL query (the reversed address followed by the zone) with
+ * the IPv4 address of its A record, in network byte order.
+ */
+class RblResolver {
+ public:
+    enum Result {
+        Listed,
+        NotListed,
+        Failed,
+    };
+
+    virtual ~RblResolver() { }
+    virtual Result resolve(const std::string &query, uint32_t *address) = 0;
+};
+
+
+/**
+ * Resolver based on getaddrinfo. Blocking, thus only used from the
+ * workers of RblCache.
+ */
+class SystemRblResolver : public RblResolver {
+ public:
+    Result resolve(const std::string &query, uint32_t *address) override;
+};
+
+
+/**
+ * In process resolver answering from a table, optionally after a delay.
+ * Every query not in the table is not listed. Meant for tests.
+ */
+class StubRblResolver : public RblResolver {
+ public:
+    explicit StubRblResolver(int delayMs = 0)
+        : m_delayMs(delayMs),
+        m_queries(0) { }
+
+    void add(const std::string &query, uint32_t address);
+    Result resolve(const std::string &query, uint32_t *address) override;
+
+    size_t queries() const { return m_queries; }
+
+ private:
+    std::mutex m_lock;
+    std::unordered_map<std::string, uint32_t> m_records;
+    int m_delayMs;
+    size_t m_queries;
+};
+
+
+/**
+ * Process wide front end used by @rbl.
+ *
+ * Answers are kept for a positive or a negative TTL. Concurrent lookups
+ * of the same query wait for a single resolution, which runs on a small
+ * pool of workers; a caller waits at most the timeout budget and then
+ * gets Unknown, while the resolution goes on and fills the cache for the
+ * next lookups.
+ *
+ */
+class RblCache {
+ public:
+    enum Result {
+        Listed,
+        NotListed,
+        Unknown,
+    };
+
+    static RblCache& getInstance() {
+        static RblCache instance;
+        return instance;
+    }
+
+    /**
+     * Replaces the resolver, nullptr leaves @rbl without one. Cached
+     * answers are dropped.
+     */
+    void setResolver(std::shared_ptr<RblResolver> resolver);
+
+    void setTimeout(int ms);
+    void setTtl(int positiveSeconds, int negativeSeconds);
+    void setUnknownMatches(bool matches) {
+        m_unknownMatches.store(matches, std::memory_order_relaxed);
+    }
+    bool unknownMatches() const {
+        return m_unknownMatches.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Answers query; cached, when given, tells whether the answer came
+     * from the cache.
+     */
+    Result lookup(const std::string &query, uint32_t *address,
+        bool *cached = nullptr);
+    void clear();
+
+ private:
+    struct Entry {
+        Result m_result;
+        uint32_t m_address;
+        std::chrono::steady_clock::time_point m_expires;
+    };
+
+    struct Pending {
+        Pending() : m_done(false), m_result(Unknown), m_address(0) { }
+        bool m_done;
+        Result m_result;
+        uint32_t m_address;
+    };
+
+    RblCache();
+    ~RblCache();
+    RblCache(RblCache const&);
+    void operator=(RblCache const&);
+
+    void complete(const std::string &query, std::shared_ptr<Pending> p,
+        RblResolver::Result r, uint32_t address);
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::unordered_map<std::string, std::shared_ptr<Pending>> m_pending;
+    std::shared_ptr<RblResolver> m_resolver;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::chrono::milliseconds m_timeout;
+    std::chrono::seconds m_positiveTtl;
+    std::chrono::seconds m_negativeTtl;
+    /* Read by every @rbl evaluation, without m_lock. */
+    std::atomic<bool> m_unknownMatches;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_RBL_RESOLVER_H_
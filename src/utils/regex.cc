@@ -20,6 +20,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 
 #include "src/utils/geo_lookup.h"
 
@@ -89,6 +93,52 @@ Regex::Regex(const std::string& pattern_, bool ignoreCase)
 }
 
 
+std::shared_ptr<const Regex> Regex::shared(const std::string &pattern,
+    bool ignoreCase) {
+    typedef std::pair<std::string, bool> Key;
+    static std::mutex lock;
+    static std::map<Key, std::weak_ptr<const Regex>> compiled;
+    static size_t prune = 64;
+    Key key(pattern, ignoreCase);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = compiled.find(key);
+        if (it != compiled.end()) {
+            std::shared_ptr<const Regex> re = it->second.lock();
+            if (re) {
+                return re;
+            }
+        }
+    }
+
+    /* Compiled without the lock; whoever inserts first wins. */
+    std::shared_ptr<const Regex> re = std::make_shared<const Regex>(pattern,
+        ignoreCase);
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::weak_ptr<const Regex> &slot = compiled[key];
+    std::shared_ptr<const Regex> other = slot.lock();
+    if (other) {
+        return other;
+    }
+    slot = re;
+
+    if (compiled.size() >= prune) {
+        for (auto it = compiled.begin(); it != compiled.end();) {
+            if (it->second.expired()) {
+                it = compiled.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        prune = std::max(static_cast<size_t>(64), compiled.size() * 2);
+    }
+
+    return re;
+}
+
+
 Regex::~Regex() {
 #if WITH_PCRE2
     pcre2_code_free(m_pc);
@@ -23,6 +23,7 @@
 #include <fstream>
 #include <string>
 #include <list>
+#include <memory>
 #include <vector>
 
 #ifndef SRC_UTILS_REGEX_H_
@@ -81,6 +82,15 @@ class Regex {
     int search(const std::string &s, SMatch *match) const;
     int search(const std::string &s) const;
 
+    /**
+     * The compiled `pattern', shared with every other holder of the same
+     * pattern and flags, e.g. rules with the same @rx or the same
+     * REQUEST_HEADERS:/.../ selector. It is compiled once, and dropped
+     * when the last holder goes away.
+     */
+    static std::shared_ptr<const Regex> shared(const std::string &pattern,
+        bool ignoreCase = false);
+
     const std::string pattern;
  private:
 #if WITH_PCRE2
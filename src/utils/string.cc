@@ -70,7 +70,11 @@ std::string removeWhiteSpacesIfNeeded(std::string a) {
 
 
 std::string ascTime(time_t *t) {
-    std::string ts = std::ctime(t);
+    char buf[32];
+    if (ctime_r(t, buf) == NULL) {
+        return "";
+    }
+    std::string ts(buf);
     ts.pop_back();
     return ts;
 }
@@ -0,0 +1,145 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/utils/thread_pool.h"
+
+#include <utility>
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/*
+ * Identifies the pool (and the worker inside of it) running on the
+ * current thread, so nested submissions land on the local deque.
+ */
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+
+ThreadPool::ThreadPool(int workers)
+    : m_pending(0),
+    m_next(0),
+    m_stop(false) {
+#ifdef MSC_NO_THREADS
+    workers = 0;
+#endif
+    for (int i = 0; i < workers; i++) {
+        m_queues.emplace_back(new WorkQueue());
+    }
+    for (int i = 0; i < workers; i++) {
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (auto &t : m_threads) {
+        t.join();
+    }
+}
+
+
+int ThreadPool::defaultWorkers() {
+#ifdef MSC_NO_THREADS
+    return 0;
+#else
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+#endif
+}
+
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (m_threads.empty()) {
+        task();
+        return;
+    }
+
+    size_t id;
+    if (currentPool == this) {
+        id = currentWorker;
+    } else {
+        id = m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    }
+
+    /*
+     * Counted before it is published: a worker may take the task as soon
+     * as it is in the deque, and m_pending must not drop below zero.
+     */
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pending++;
+        std::lock_guard<std::mutex> queueLock(m_queues[id]->m_lock);
+        m_queues[id]->m_tasks.push_back(std::move(task));
+    }
+    m_cond.notify_one();
+}
+
+
+bool ThreadPool::take(size_t id, std::function<void()> *task) {
+    {
+        WorkQueue *own = m_queues[id].get();
+        std::lock_guard<std::mutex> lock(own->m_lock);
+        if (!own->m_tasks.empty()) {
+            *task = std::move(own->m_tasks.back());
+            own->m_tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < m_queues.size(); i++) {
+        WorkQueue *victim = m_queues[(id + i) % m_queues.size()].get();
+        std::lock_guard<std::mutex> lock(victim->m_lock);
+        if (!victim->m_tasks.empty()) {
+            *task = std::move(victim->m_tasks.front());
+            victim->m_tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ThreadPool::run(size_t id) {
+    currentPool = this;
+    currentWorker = id;
+
+    while (true) {
+        std::function<void()> task;
+        if (take(id, &task)) {
+            m_pending--;
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cond.wait(lock, [this] { return m_stop || m_pending > 0; });
+        if (m_stop && m_pending == 0) {
+            return;
+        }
+    }
+}
+
+
+}  // namespace utils
+}  // namespace modsecurity
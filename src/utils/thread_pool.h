@@ -0,0 +1,127 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef SRC_UTILS_THREAD_POOL_H_
+#define SRC_UTILS_THREAD_POOL_H_
+
+/*
+ * Single threaded WebAssembly builds (emscripten without pthreads) can
+ * not spawn threads at all. There, every pool runs its tasks inline.
+ */
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define MSC_NO_THREADS 1
+#endif
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/**
+ * Small work stealing thread pool.
+ *
+ * Every worker owns a deque: tasks submitted from a worker go to its own
+ * deque (and are taken LIFO, while the data is still hot), tasks submitted
+ * from elsewhere are spread round robin. An idle worker steals from the
+ * front of the other deques before going to sleep.
+ *
+ * A pool created with no workers runs every task inline, on the
+ * submitting thread.
+ *
+ */
+class ThreadPool {
+ public:
+    explicit ThreadPool(int workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &p) = delete;
+    ThreadPool& operator= (const ThreadPool &p) = delete;
+
+    void submit(std::function<void()> task);
+
+    size_t size() const { return m_threads.size(); }
+
+    /**
+     * Amount of workers used when the caller has no preference: one per
+     * hardware thread, or none where threads are not available.
+     */
+    static int defaultWorkers();
+
+ private:
+    struct WorkQueue {
+        std::mutex m_lock;
+        std::deque<std::function<void()>> m_tasks;
+    };
+
+    void run(size_t id);
+    bool take(size_t id, std::function<void()> *task);
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::atomic<size_t> m_pending;
+    std::atomic<size_t> m_next;
+    bool m_stop;
+};
+
+
+/**
+ * Counts outstanding tasks, so a caller can wait for a group of tasks
+ * submitted to a ThreadPool.
+ */
+class WaitGroup {
+ public:
+    WaitGroup() : m_count(0) { }
+
+    void add(size_t n) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_count += n;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (--m_count == 0) {
+            m_cond.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_cond.wait(lock, [this] { return m_count == 0; });
+    }
+
+ private:
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    size_t m_count;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_THREAD_POOL_H_
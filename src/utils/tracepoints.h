@@ -0,0 +1,98 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include "src/config.h"
+
+#ifndef SRC_UTILS_TRACEPOINTS_H_
+#define SRC_UTILS_TRACEPOINTS_H_
+
+/*
+ * Static (USDT) probes, under the "modsecurity" provider, for tools such
+ * as bpftrace, perf or SystemTap. An idle probe is a single nop, so they
+ * are always built when <sys/sdt.h> is available; define
+ * MSC_NO_TRACEPOINTS to leave them out anyway.
+ *
+ * Probes and their arguments:
+ *
+ *  transaction__begin       (id)
+ *  transaction__end         (id)
+ *  phase__begin             (id, phase)
+ *  phase__end               (id, phase)
+ *  rule__begin              (id, rule id)
+ *  rule__end                (id, rule id, matched)
+ *  operator__begin          (id, operator name, input length)
+ *  operator__end            (id, operator name, matched)
+ *  body__processor__begin   (id, processor)
+ *  body__processor__end     (id, processor, error)
+ *
+ * where id is the transaction id, phase the number of the process*
+ * call (see modsecurity::Phases), and processor a RequestBodyType.
+ *
+ * e.g.:
+ *   bpftrace -e 'usdt:libmodsecurity.so:modsecurity:rule__begin
+ *       { @s[tid] = nsecs; }
+ *     usdt:libmodsecurity.so:modsecurity:rule__end /@s[tid]/
+ *       { @us[arg1] = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+ */
+#if defined(HAVE_SYS_SDT_H) && !defined(MSC_NO_TRACEPOINTS)
+#include <sys/sdt.h>
+
+#define MSC_TRACE1(name, a) \
+    DTRACE_PROBE1(modsecurity, name, a)
+#define MSC_TRACE2(name, a, b) \
+    DTRACE_PROBE2(modsecurity, name, a, b)
+#define MSC_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(modsecurity, name, a, b, c)
+#else
+#define MSC_TRACE1(name, a) \
+    do { (void) sizeof(a); } while (0)
+#define MSC_TRACE2(name, a, b) \
+    do { (void) sizeof(a); (void) sizeof(b); } while (0)
+#define MSC_TRACE3(name, a, b, c) \
+    do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); } while (0)
+#endif
+
+
+namespace modsecurity {
+namespace utils {
+
+
+/**
+ * Fires phase__begin when built and phase__end when destroyed, so every
+ * way out of a process* call is covered.
+ */
+class PhaseTrace {
+ public:
+    PhaseTrace(const char *id, int phase)
+        : m_id(id),
+        m_phase(phase) {
+        MSC_TRACE2(phase__begin, m_id, m_phase);
+    }
+
+    ~PhaseTrace() {
+        MSC_TRACE2(phase__end, m_id, m_phase);
+    }
+
+ private:
+    const char *m_id;
+    int m_phase;
+};
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+
+#endif  // SRC_UTILS_TRACEPOINTS_H_
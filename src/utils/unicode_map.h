@@ -0,0 +1,45 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <cstddef>
+#include <memory>
+
+#ifndef SRC_UTILS_UNICODE_MAP_H_
+#define SRC_UTILS_UNICODE_MAP_H_
+
+
+namespace modsecurity {
+class UnicodeMapHolder;
+namespace utils {
+
+
+/**
+ * Returns the map of `codePage' from the contents of a unicode.mapping
+ * file, read in place.
+ *
+ * Maps are interned: every load of the same contents and code page, from
+ * any rules set, gets the same holder for as long as one of them is alive.
+ * Code page 20127 of the unicode.mapping shipped with ModSecurity (the one
+ * modsecurity.conf-recommended loads) is built into the library: when the
+ * contents match it, the file is not parsed at all.
+ */
+std::shared_ptr<UnicodeMapHolder> unicodeMap(const char *data, size_t size,
+    double codePage);
+
+
+}  // namespace utils
+}  // namespace modsecurity
+
+#endif  // SRC_UTILS_UNICODE_MAP_H_
@@ -75,7 +75,7 @@ class Global_DictElementRegexp : public VariableRegex {
         RuleWithActions *rule,
         std::vector<const VariableValue *> *l) override {
         t->m_collections.m_global_collection->resolveRegularExpression(
-            m_dictElement,
+            m_r.get(),
             t->m_collections.m_global_collection_key,
             t->m_rules->m_secWebAppId.m_value, l, m_keyExclusion);
     }
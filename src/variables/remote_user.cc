@@ -39,20 +39,31 @@ namespace variables {
 void RemoteUser::evaluate(Transaction *transaction,
     RuleWithActions *rule,
     std::vector<const VariableValue *> *l) {
+    if (!transaction->m_remoteUserResolved) {
+        resolve(transaction);
+    }
+
+    if (transaction->m_remoteUser) {
+        l->push_back(new VariableValue(transaction->m_remoteUser.get()));
+    }
+}
+
+
+void RemoteUser::resolve(Transaction *transaction) {
     size_t pos;
     std::string base64;
-    VariableValue *var;
     std::string header;
+    std::vector<const VariableValue *> l2;
 
-    std::vector<const VariableValue *> *l2 = \
-	new std::vector<const VariableValue *>();
-    transaction->m_variableRequestHeaders.resolve("authorization", l2);
+    transaction->m_remoteUser.reset();
+    transaction->m_remoteUserResolved = true;
+    transaction->m_variableRequestHeaders.resolve("authorization", &l2);
 
-    if (l2->size() < 1) {
+    if (l2.size() < 1) {
         goto clear;
     }
 
-    header = std::string(l2->at(0)->getValue());
+    header = std::string(l2.at(0)->getValue());
 
     if (header.compare(0, 6, "Basic ") == 0) {
         base64 = std::string(header, 6, header.length());
@@ -66,23 +77,21 @@ void RemoteUser::evaluate(Transaction *transaction,
     }
     transaction->m_variableRemoteUser.assign(std::string(base64, 0, pos));
 
-    var = new VariableValue(&l2->at(0)->getKeyWithCollection(),
-        &transaction->m_variableRemoteUser);
+    transaction->m_remoteUser.reset(new VariableValue(
+        &l2.at(0)->getKeyWithCollection(),
+        &transaction->m_variableRemoteUser));
 
-    for (auto &i : l2->at(0)->getOrigin()) {
+    for (auto &i : l2.at(0)->getOrigin()) {
         std::unique_ptr<VariableOrigin> origin(new VariableOrigin());
         origin->m_offset = i->m_offset;
         origin->m_length = i->m_length;
-        var->addOrigin(std::move(origin));
+        transaction->m_remoteUser->addOrigin(std::move(origin));
     }
-    l->push_back(var);
 
 clear:
-    for (auto &a : *l2) {
+    for (auto &a : l2) {
         delete a;
     }
-    l2->clear();
-    delete l2;
 }
 
 
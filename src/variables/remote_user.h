@@ -39,6 +39,13 @@ class RemoteUser : public Variable {
     void evaluate(Transaction *transaction,
         RuleWithActions *rule,
         std::vector<const VariableValue *> *l) override;
+
+    /**
+     * Decodes the user out of the Authorization header, into the
+     * transaction, where it is kept until the header changes.
+     */
+    static void resolve(Transaction *transaction);
+
     std::string m_retName;
 };
 
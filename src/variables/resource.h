@@ -75,7 +75,7 @@ class Resource_DictElementRegexp : public VariableRegex {
         RuleWithActions *rule,
         std::vector<const VariableValue *> *l) override {
         t->m_collections.m_resource_collection->resolveRegularExpression(
-            m_dictElement, t->m_collections.m_resource_collection_key,
+            m_r.get(), t->m_collections.m_resource_collection_key,
             t->m_rules->m_secWebAppId.m_value, l, m_keyExclusion);
     }
 
@@ -29,6 +29,7 @@
 #include <utility>
 
 #include "modsecurity/transaction.h"
+#include "src/utils/local_time.h"
 
 namespace modsecurity {
 namespace variables {
@@ -36,8 +37,7 @@ namespace variables {
 void TimeEpoch::evaluate(Transaction *transaction,
     RuleWithActions *rule,
     std::vector<const VariableValue *> *l) {
-    transaction->m_variableTimeEpoch.assign(
-        std::to_string(std::time(nullptr)));
+    transaction->m_variableTimeEpoch.assign(utils::LocalTime::now()->m_epoch);
     l->push_back(new VariableValue(&m_retName,
         &transaction->m_variableTimeEpoch));
 }
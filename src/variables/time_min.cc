@@ -29,6 +29,7 @@
 #include <utility>
 
 #include "modsecurity/transaction.h"
+#include "src/utils/local_time.h"
 
 namespace modsecurity {
 namespace variables {
@@ -36,18 +37,7 @@ namespace variables {
 void TimeMin::evaluate(Transaction *transaction,
     RuleWithActions *rule,
     std::vector<const VariableValue *> *l) {
-    char tstr[200];
-    struct tm timeinfo;
-    time_t timer;
-
-    time(&timer);
-    memset(tstr, '\0', 200);
-
-    localtime_r(&timer, &timeinfo);
-    strftime(tstr, 200, "%M", &timeinfo);
-
-    transaction->m_variableTimeMin.assign(tstr);
-
+    transaction->m_variableTimeMin.assign(utils::LocalTime::now()->m_min);
     l->push_back(new VariableValue(&m_retName,
         &transaction->m_variableTimeMin));
 }
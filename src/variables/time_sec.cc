@@ -29,6 +29,7 @@
 #include <utility>
 
 #include "modsecurity/transaction.h"
+#include "src/utils/local_time.h"
 
 namespace modsecurity {
 namespace variables {
@@ -36,18 +37,7 @@ namespace variables {
 void TimeSec::evaluate(Transaction *transaction,
     RuleWithActions *rule,
     std::vector<const VariableValue *> *l) {
-    char tstr[200];
-    struct tm timeinfo;
-    time_t timer;
-
-    time(&timer);
-    memset(tstr, '\0', 200);
-
-    localtime_r(&timer, &timeinfo);
-    strftime(tstr, 200, "%S", &timeinfo);
-
-    transaction->m_variableTimeSec.assign(tstr);
-
+    transaction->m_variableTimeSec.assign(utils::LocalTime::now()->m_sec);
     l->push_back(new VariableValue(&m_retName,
         &transaction->m_variableTimeSec));
 }
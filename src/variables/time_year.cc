@@ -29,6 +29,7 @@
 #include <utility>
 
 #include "modsecurity/transaction.h"
+#include "src/utils/local_time.h"
 
 namespace modsecurity {
 namespace variables {
@@ -36,18 +37,7 @@ namespace variables {
 void TimeYear::evaluate(Transaction *transaction,
     RuleWithActions *rule,
     std::vector<const VariableValue *> *l) {
-    char tstr[200];
-    struct tm timeinfo;
-    time_t timer;
-
-    time(&timer);
-    memset(tstr, '\0', 200);
-
-    localtime_r(&timer, &timeinfo);
-    strftime(tstr, 200, "%Y", &timeinfo);
-
-    transaction->m_variableTimeYear.assign(tstr);
-
+    transaction->m_variableTimeYear.assign(utils::LocalTime::now()->m_year);
     l->push_back(new VariableValue(&m_retName,
         &transaction->m_variableTimeYear));
 }
@@ -73,7 +73,7 @@ class Tx_DictElementRegexp : public VariableRegex {
         RuleWithActions *rule,
         std::vector<const VariableValue *> *l) override {
         t->m_collections.m_tx_collection->resolveRegularExpression(
-            m_dictElement, l, m_keyExclusion);
+            m_r.get(), l, m_keyExclusion);
     }
 
     std::string m_dictElement;
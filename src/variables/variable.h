@@ -51,7 +51,7 @@ class n ## _DictElementRegexp : public VariableRegex { \
     void evaluate(Transaction *transaction, \
         RuleWithActions *rule, \
         std::vector<const VariableValue *> *l) override { \
-        transaction-> e .resolveRegularExpression(&m_r, l, \
+        transaction-> e .resolveRegularExpression(m_r.get(), l, \
             m_keyExclusion); \
     } \
 };
@@ -112,21 +112,20 @@ class KeyExclusion {
 };
 
 
-// FIXME: use pre built regex.
 class KeyExclusionRegex : public KeyExclusion {
  public:
     explicit KeyExclusionRegex(const Utils::Regex &re)
-        : m_re(re.pattern, true) { }
+        : m_re(Utils::Regex::shared(re.pattern, true)) { }
     explicit KeyExclusionRegex(const std::string &re)
-        : m_re(re, true) { }
+        : m_re(Utils::Regex::shared(re, true)) { }
 
     ~KeyExclusionRegex() override { }
 
     bool match(const std::string &a) override {
-        return m_re.searchAll(a).size() > 0;
+        return m_re->searchAll(a).size() > 0;
     }
 
-    Utils::Regex m_re;
+    std::shared_ptr<const Utils::Regex> m_re;
 };
 
 
@@ -595,11 +594,11 @@ class VariableDictElement : public Variable {
 class VariableRegex : public Variable {
  public:
     VariableRegex(const std::string &name, const std::string &regex)
-        :  m_r(regex, true),
+        :  m_r(Utils::Regex::shared(regex, true)),
         m_regex(regex),
         Variable(name + ":" + "regex(" + regex + ")") { }
 
-    Utils::Regex m_r;
+    std::shared_ptr<const Utils::Regex> m_r;
     // FIXME: no need for that.
     std::string m_regex;
 };
@@ -615,7 +614,7 @@ class Variables : public std::vector<Variable *> {
             [v](Variable *m) -> bool {
                 VariableRegex *r = dynamic_cast<VariableRegex *>(m);
                 if (r) {
-                    return r->m_r.searchAll(v->getKey()).size() > 0;
+                    return r->m_r->searchAll(v->getKey()).size() > 0;
                 }
                 return v->getKeyWithCollection() == *m->m_fullName.get();
             }) != end();
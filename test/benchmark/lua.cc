@@ -0,0 +1,117 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <string.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "src/engine/lua.h"
+
+
+/*
+ * Measures what a single run of a Lua script costs, the way @inspectFile
+ * and SecRuleScript run it, first building a new state for every run (as
+ * it used to be) and then reusing the pooled states.
+ */
+
+
+char default_script[] = "../test-cases/data/match-getvar.lua";
+
+const char* const help_message = "Usage: lua_benchmark [script] " \
+    "[num_iterations]";
+
+
+static double measure(modsecurity::engine::Lua *lua,
+    modsecurity::Transaction *t, unsigned long long iterations) {
+    /* Warms up the pool, when there is one. */
+    lua->run(t);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        lua->run(t);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count() / 1000.0 / iterations;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *script = default_script;
+    unsigned long long iterations(100000);
+
+    if (argc > 1) {
+        if (0 == strcmp(argv[1], "-h") ||
+            0 == strcmp(argv[1], "-?") ||
+            0 == strcmp(argv[1], "--help")) {
+            std::cout << help_message << std::endl;
+            return 0;
+        }
+        script = argv[1];
+    }
+    if (argc > 2) {
+        iterations = strtoull(argv[2], 0, 10);
+        if (iterations == 0) {
+            std::cerr << "Failed to convert '" << argv[2] \
+                << "' to integer value" << std::endl << help_message \
+                << std::endl;
+            return -1;
+        }
+    }
+
+#ifndef WITH_LUA
+    std::cerr << "Lua support was not enabled." << std::endl;
+    return -1;
+#else
+    modsecurity::ModSecurity modsec;
+    modsecurity::RulesSet rules;
+    modsecurity::Transaction t(&modsec, &rules, NULL);
+    modsecurity::engine::Lua lua;
+    std::string err;
+
+    rules.load("SecRuleEngine On");
+    t.processConnection("200.249.12.31", 12345, "127.0.0.1", 80);
+    t.processURI("/test.pl?param1=test&param2=test2", "GET", "1.1");
+
+    if (!lua.load(script, &err)) {
+        std::cerr << err << std::endl;
+        return -1;
+    }
+
+    std::cout << "Running " << script << " " << iterations \
+        << " times..." << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    size_t poolSize = modsecurity::engine::Lua::getStatePoolSize();
+
+    modsecurity::engine::Lua::setStatePoolSize(0);
+    std::cout << "new state per run: " << measure(&lua, &t, iterations) \
+        << " us per run" << std::endl;
+
+    modsecurity::engine::Lua::setStatePoolSize(poolSize);
+    std::cout << "pooled states:     " << measure(&lua, &t, iterations) \
+        << " us per run" << std::endl;
+
+    return 0;
+#endif
+}
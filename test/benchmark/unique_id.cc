@@ -0,0 +1,121 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <string.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "src/unique_id.h"
+
+
+/*
+ * Measures how many transaction ids can be made per second, on one and on
+ * several threads, and checks that none of them was handed out twice.
+ */
+
+
+const char* const help_message = "Usage: unique_id_benchmark [threads] " \
+    "[num_iterations]";
+
+
+static void generate(unsigned long long iterations,
+    std::vector<std::string> *ids) {
+    char id[TRANSACTION_ID_SIZE];
+    time_t now = std::time(NULL);
+
+    ids->reserve(iterations);
+    for (unsigned long long i = 0; i < iterations; i++) {
+        modsecurity::UniqueId::transactionId(now, id);
+        ids->emplace_back(id, TRANSACTION_ID_SIZE - 1);
+    }
+}
+
+
+static bool measure(int threads, unsigned long long iterations) {
+    std::vector<std::vector<std::string>> ids(threads);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(generate, iterations, &ids[i]);
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count() / 1e9;
+    std::cout << threads << " thread(s): " \
+        << threads * iterations / seconds / 1e6 << " million ids per second" \
+        << std::endl;
+
+    std::unordered_set<std::string> seen;
+    for (auto &v : ids) {
+        for (auto &id : v) {
+            if (!seen.insert(id).second) {
+                std::cerr << "Duplicated id: " << id << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    int threads = 4;
+    unsigned long long iterations(1000000);
+
+    if (argc > 1) {
+        if (0 == strcmp(argv[1], "-h") ||
+            0 == strcmp(argv[1], "-?") ||
+            0 == strcmp(argv[1], "--help")) {
+            std::cout << help_message << std::endl;
+            return 0;
+        }
+        threads = atoi(argv[1]);
+        if (threads <= 0) {
+            std::cerr << "Failed to convert '" << argv[1] \
+                << "' to a number of threads" << std::endl << help_message \
+                << std::endl;
+            return -1;
+        }
+    }
+    if (argc > 2) {
+        iterations = strtoull(argv[2], 0, 10);
+        if (iterations == 0) {
+            std::cerr << "Failed to convert '" << argv[2] \
+                << "' to integer value" << std::endl << help_message \
+                << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    if (!measure(1, iterations) || !measure(threads, iterations)) {
+        return -1;
+    }
+
+    return 0;
+}
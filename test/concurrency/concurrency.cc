@@ -0,0 +1,894 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/rule_message.h"
+#include "modsecurity/slow_capture.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/transaction_batch.h"
+#include "modsecurity/collection/collection.h"
+#include "src/utils/rbl_resolver.h"
+
+
+/**
+ * Evaluates the same set of requests once on the calling thread, with no
+ * negative result cache, and then, several times, on a pool of workers
+ * sharing the same RulesSet, with and without the parallel evaluation of
+ * side effect free rules, and finally interleaved, one rule at a time, as
+ * an event loop would. Every concurrent run has to produce exactly what
+ * the serial run produced, and the process wide (global) collection has
+ * to hold every key written during the runs.
+ *
+ * The features sharing state between workers (@rbl lookups, slow capture,
+ * shadow evaluation, collection snapshots, @pm, rate limits) are checked
+ * apart, always under concurrent workers. How a single transaction is
+ * evaluated belongs to the regression tests.
+ *
+ */
+
+
+struct Outcome {
+    Outcome() : status(0), disruptive(false) { }
+
+    int status;
+    bool disruptive;
+    std::vector<int> rules;
+    std::string id;
+
+    bool operator==(const Outcome &o) const {
+        return status == o.status && disruptive == o.disruptive
+            && rules == o.rules;
+    }
+
+    std::string print() const {
+        std::stringstream ss;
+        ss << "status " << status << (disruptive ? " (disruptive)" : "");
+        ss << ", rules:";
+        for (int r : rules) {
+            ss << " " << r;
+        }
+        return ss.str();
+    }
+};
+
+
+static void logCb(void *data, const void *msg) {
+    Outcome *o = static_cast<Outcome *>(data);
+    const modsecurity::RuleMessage *rm =
+        static_cast<const modsecurity::RuleMessage *>(msg);
+    if (o && rm) {
+        o->rules.push_back(rm->m_ruleId);
+    }
+}
+
+
+static std::vector<modsecurity::BatchRequest> buildRequests(size_t n) {
+    std::vector<modsecurity::BatchRequest> requests;
+
+    for (size_t i = 0; i < n; i++) {
+        modsecurity::BatchRequest r;
+        std::string id = std::to_string(i);
+
+        r.m_clientIp = "10.0.0." + std::to_string(i % 250);
+        r.m_clientPort = 1024 + i;
+        r.m_requestHeaders.emplace_back("Host", "localhost");
+        r.m_requestHeaders.emplace_back("X-Id", id);
+
+        switch (i % 7) {
+            case 0:
+                r.m_uri = "/index.php?q=1+union+select+pass&i=" + id;
+                break;
+            case 1:
+                r.m_uri = "/Admin/panel?i=" + id;
+                break;
+            case 2:
+                r.m_uri = "/search?q=attack&user=root&i=" + id;
+                break;
+            case 3:
+                r.m_method = "POST";
+                r.m_uri = "/upload?i=" + id;
+                r.m_requestHeaders.emplace_back("Content-Type",
+                    "application/x-www-form-urlencoded");
+                r.m_requestBody = "data=something+evil&i=" + id;
+                r.m_requestHeaders.emplace_back("Content-Length",
+                    std::to_string(r.m_requestBody.size()));
+                break;
+            case 4:
+                r.m_uri = "/page?i=" + id;
+                r.m_responseStatus = 200;
+                r.m_responseHeaders.emplace_back("Content-Type",
+                    "text/html");
+                r.m_responseBody = "<html>the secret is " + id + "</html>";
+                break;
+            default:
+                r.m_uri = "/page?i=" + id;
+                r.m_responseStatus = 200;
+                r.m_responseHeaders.emplace_back("Content-Type",
+                    "text/html");
+                r.m_responseBody = "<html>hello</html>";
+                break;
+        }
+        requests.push_back(std::move(r));
+    }
+
+    return requests;
+}
+
+
+static std::vector<Outcome> run(modsecurity::ModSecurity *ms,
+    modsecurity::RulesSet *rules,
+    std::vector<modsecurity::BatchRequest> *requests, int workers) {
+    std::vector<Outcome> outcomes(requests->size());
+
+    for (size_t i = 0; i < requests->size(); i++) {
+        (*requests)[i].m_logCbData = &outcomes[i];
+    }
+
+    modsecurity::TransactionBatch batch(ms, rules, workers);
+    batch.process(*requests,
+        [&outcomes] (size_t i, modsecurity::Transaction *t,
+            const modsecurity::ModSecurityIntervention *it) {
+            outcomes[i].status = it->status;
+            outcomes[i].disruptive = it->disruptive != 0;
+            outcomes[i].id = *t->m_id;
+            std::sort(outcomes[i].rules.begin(), outcomes[i].rules.end());
+        });
+
+    return outcomes;
+}
+
+
+static int step(modsecurity::Transaction *t,
+    const modsecurity::BatchRequest &r, int stage) {
+    switch (stage) {
+        case 0:
+            return t->processRequestHeaders();
+        case 1:
+            if (!t->isEvaluationSuspended() && !r.m_requestBody.empty()) {
+                t->appendRequestBody(reinterpret_cast<const unsigned char *>(
+                    r.m_requestBody.c_str()), r.m_requestBody.size());
+            }
+            return t->processRequestBody();
+        case 2:
+            if (!t->isEvaluationSuspended()) {
+                for (const auto &h : r.m_responseHeaders) {
+                    t->addResponseHeader(h.first, h.second);
+                }
+            }
+            return t->processResponseHeaders(r.m_responseStatus,
+                r.m_responseProtocol);
+        default:
+            if (!t->isEvaluationSuspended() && !r.m_responseBody.empty()) {
+                t->appendResponseBody(reinterpret_cast<const unsigned char *>(
+                    r.m_responseBody.c_str()), r.m_responseBody.size());
+            }
+            return t->processResponseBody();
+    }
+}
+
+
+/*
+ * Mimics an event loop on a single thread: every request gets, in turn, a
+ * slice of `slice' rules until all of them are completed.
+ */
+static std::vector<Outcome> runSliced(modsecurity::ModSecurity *ms,
+    modsecurity::RulesSet *rules,
+    const std::vector<modsecurity::BatchRequest> &requests, int slice,
+    size_t *suspensions) {
+    std::vector<Outcome> outcomes(requests.size());
+    std::vector<modsecurity::Transaction *> trans(requests.size());
+    std::vector<modsecurity::ModSecurityIntervention> its(requests.size());
+    std::vector<int> stage(requests.size(), 0);
+    size_t pending = requests.size();
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        const modsecurity::BatchRequest &r = requests[i];
+        modsecurity::Transaction *t = new modsecurity::Transaction(ms, rules,
+            &outcomes[i]);
+        modsecurity::intervention::clean(&its[i]);
+        t->setEvaluationSlice(slice, 0);
+        t->processConnection(r.m_clientIp.c_str(), r.m_clientPort,
+            r.m_serverIp.c_str(), r.m_serverPort);
+        t->processURI(r.m_uri.c_str(), r.m_method.c_str(),
+            r.m_httpVersion.c_str());
+        for (const auto &h : r.m_requestHeaders) {
+            t->addRequestHeader(h.first, h.second);
+        }
+        trans[i] = t;
+    }
+
+    *suspensions = 0;
+    while (pending > 0) {
+        for (size_t i = 0; i < requests.size(); i++) {
+            modsecurity::Transaction *t = trans[i];
+            if (t == nullptr) {
+                continue;
+            }
+            if (step(t, requests[i], stage[i]) == MSC_PHASE_SUSPENDED) {
+                (*suspensions)++;
+                continue;
+            }
+            stage[i]++;
+            if (!t->intervention(&its[i])
+                && stage[i] < (requests[i].m_responseStatus ? 4 : 2)) {
+                continue;
+            }
+            t->processLogging();
+            outcomes[i].status = its[i].status;
+            outcomes[i].disruptive = its[i].disruptive != 0;
+            std::sort(outcomes[i].rules.begin(), outcomes[i].rules.end());
+            modsecurity::intervention::free(&its[i]);
+            delete t;
+            trans[i] = nullptr;
+            pending--;
+        }
+    }
+
+    return outcomes;
+}
+
+
+static bool compare(const std::string &name,
+    const std::vector<Outcome> &expected,
+    const std::vector<Outcome> &obtained) {
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (!(expected[i] == obtained[i])) {
+            std::cout << ":test-result: FAIL " << name << ": request " << i \
+                << " expected " << expected[i].print() << ", got " \
+                << obtained[i].print() << std::endl;
+            return false;
+        }
+    }
+    std::cout << ":test-result: PASS " << name << std::endl;
+    return true;
+}
+
+
+static int testRbl(modsecurity::ModSecurity *ms) {
+    using modsecurity::utils::RblCache;
+    using modsecurity::utils::StubRblResolver;
+    const size_t amount = 64;
+    int failed = 0;
+
+    modsecurity::RulesSet rules;
+    if (rules.load("SecRuleEngine On\n" \
+        "SecRule REMOTE_ADDR \"@rbl bl.example\" " \
+        "\"id:1,phase:1,deny,status:403\"") < 0) {
+        std::cout << ":test-result: FAIL rbl: " << rules.getParserError() \
+            << std::endl;
+        return 1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests;
+    for (size_t i = 0; i < amount; i++) {
+        modsecurity::BatchRequest r;
+        r.m_clientIp = i % 2 ? "10.0.0.1" : "10.0.0.2";
+        r.m_clientPort = 1024 + i;
+        r.m_uri = "/";
+        requests.push_back(std::move(r));
+    }
+
+    /* Every transaction of a client waits for one and the same lookup. */
+    std::shared_ptr<StubRblResolver> stub(new StubRblResolver(100));
+    stub->add("1.0.0.10.bl.example", htonl(0x7f000002));
+    RblCache::getInstance().setResolver(stub);
+    ms->setRblLookup(5000, false, 300, 60);
+
+    std::vector<Outcome> outcomes = run(ms, &rules, &requests, 8);
+    size_t wrong = 0;
+    for (size_t i = 0; i < amount; i++) {
+        wrong += outcomes[i].disruptive != (i % 2 == 1) ? 1 : 0;
+    }
+    if (wrong || stub->queries() != 2) {
+        std::cout << ":test-result: FAIL rbl lookups: " << wrong \
+            << " wrong answer(s), " << stub->queries() << " queries" \
+            << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS rbl lookups" << std::endl;
+    }
+
+    /* A resolver slower than the timeout gives the unknown result. */
+    stub.reset(new StubRblResolver(1000));
+    RblCache::getInstance().setResolver(stub);
+    ms->setRblLookup(20, true, 300, 60);
+
+    requests.resize(16);
+    outcomes = run(ms, &rules, &requests, 8);
+    wrong = 0;
+    for (const Outcome &o : outcomes) {
+        wrong += o.disruptive ? 0 : 1;
+    }
+    if (wrong) {
+        std::cout << ":test-result: FAIL rbl timeout: " << wrong \
+            << " transaction(s) not taken as listed" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS rbl timeout" << std::endl;
+    }
+
+    RblCache::getInstance().setResolver(nullptr);
+    return failed;
+}
+
+
+class MemoryCaptureSink : public modsecurity::CaptureSink {
+ public:
+    void write(const std::string &record) override {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_records.push_back(record);
+    }
+
+    std::mutex m_lock;
+    std::vector<std::string> m_records;
+};
+
+
+static int testSlowCapture(modsecurity::ModSecurity *ms) {
+    const size_t amount = 64;
+
+    modsecurity::RulesSet rules;
+    if (rules.load("SecRuleEngine On\n" \
+        "SecRule ARGS:q \"@contains attack\" " \
+        "\"id:7,phase:2,deny,status:403\"") < 0) {
+        std::cout << ":test-result: FAIL slow capture: " \
+            << rules.getParserError() << std::endl;
+        return 1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests;
+    for (size_t i = 0; i < amount; i++) {
+        modsecurity::BatchRequest r;
+        r.m_clientIp = "10.0.0.1";
+        r.m_clientPort = 1024 + i;
+        r.m_uri = i % 2 ? "/?q=attack" : "/?q=benign";
+        requests.push_back(std::move(r));
+    }
+
+    /* Every transaction is slow enough with a threshold of 0. */
+    std::shared_ptr<MemoryCaptureSink> sink(new MemoryCaptureSink());
+    rules.setSlowCapture(0, 1024, sink);
+    std::vector<Outcome> outcomes = run(ms, &rules, &requests, 8);
+
+    size_t wrong = 0;
+    for (const Outcome &o : outcomes) {
+        std::string id = "\"capture\":{\"version\":1,\"id\":\""
+            + o.id + "\"";
+        std::string status = "\"intervention\":"
+            + std::string(o.disruptive ? "403" : "0");
+        size_t found = 0;
+        for (const std::string &record : sink->m_records) {
+            if (record.compare(0, 14, "{\"client_ip\":\"") == 0
+                && record.find(id) != std::string::npos
+                && record.find(status) != std::string::npos
+                && record.find(
+                    "\"rules\":[{\"id\":7,\"phase\":\"request_body\",")
+                    != std::string::npos) {
+                found++;
+            }
+        }
+        wrong += found == 1 ? 0 : 1;
+    }
+    if (sink->m_records.size() != amount || wrong) {
+        std::cout << ":test-result: FAIL slow capture: " \
+            << sink->m_records.size() << " record(s), " << wrong \
+            << " transaction(s) not recorded as expected" << std::endl;
+        return 1;
+    }
+    std::cout << ":test-result: PASS slow capture" << std::endl;
+
+    /* Same through the file sink, written by its own thread. */
+    const char *path = "concurrency-slow-capture.log";
+    std::remove(path);
+    std::shared_ptr<modsecurity::FileCaptureSink> file(
+        new modsecurity::FileCaptureSink(path));
+    rules.setSlowCapture(0, 1024, file);
+    run(ms, &rules, &requests, 8);
+    rules.setSlowCapture(0, 0, nullptr);
+    file->flush();
+    size_t lines = 0;
+    {
+        std::ifstream f(path);
+        std::string line;
+        while (std::getline(f, line)) {
+            lines++;
+        }
+    }
+    std::remove(path);
+    bool refused = modsecurity::msc_rules_set_slow_capture(&rules, 0, 0,
+        "/nonexistent/directory/capture.log") == 0;
+    if (!file->good() || lines != amount || file->errors() != 0
+        || file->dropped() != 0 || !refused) {
+        std::cout << ":test-result: FAIL slow capture file: " << lines \
+            << " record(s) written, " << file->errors() << " error(s)" \
+            << (refused ? "" : ", bad path accepted") << std::endl;
+        return 1;
+    }
+    std::cout << ":test-result: PASS slow capture file" << std::endl;
+    return 0;
+}
+
+
+struct ShadowDiffs {
+    std::mutex m_lock;
+    std::vector<std::string> m_diffs;
+};
+
+
+static void shadowCb(void *data, const modsecurity::ModSecurityShadowDiff *d) {
+    ShadowDiffs *diffs = static_cast<ShadowDiffs *>(data);
+    std::string diff;
+    for (size_t i = 0; i < d->primaryCount; i++) {
+        diff += "-" + std::to_string(d->primary[i]);
+    }
+    for (size_t i = 0; i < d->shadowCount; i++) {
+        diff += "+" + std::to_string(d->shadow[i]);
+    }
+    std::lock_guard<std::mutex> lock(diffs->m_lock);
+    diffs->m_diffs.push_back(diff);
+}
+
+
+static int testShadow() {
+    const size_t amount = 64;
+    int failed = 0;
+
+    modsecurity::ModSecurity ms;
+    ms.setServerLogCb(logCb, modsecurity::RuleMessageLogProperty);
+    modsecurity::RulesSet primary;
+    modsecurity::RulesSet shadow;
+    if (primary.load("SecRuleEngine On\n" \
+        "SecRule ARGS:q \"@contains attack\" " \
+        "\"id:7,phase:2,deny,status:403\"") < 0
+        || shadow.load("SecRuleEngine On\n" \
+        "SecRule ARGS:q \"@contains attack\" " \
+        "\"id:7,phase:2,deny,status:403\"\n" \
+        "SecRule ARGS:q \"@contains benign\" " \
+        "\"id:8,phase:2,deny,status:403\"") < 0) {
+        std::cout << ":test-result: FAIL shadow: " \
+            << primary.getParserError() << shadow.getParserError() \
+            << std::endl;
+        return 1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests;
+    for (size_t i = 0; i < amount; i++) {
+        modsecurity::BatchRequest r;
+        r.m_clientIp = "10.0.0.1";
+        r.m_clientPort = 1024 + i;
+        r.m_uri = i % 2 ? "/?q=attack" : "/?q=benign";
+        requests.push_back(std::move(r));
+    }
+
+    /*
+     * Only the benign requests differ: the shadow set would have blocked
+     * them, and never blocks anything itself.
+     */
+    ShadowDiffs diffs;
+    if (!ms.setShadowRules(&shadow, 1, 2, amount, shadowCb, &diffs)) {
+        std::cout << ":test-result: PASS shadow (not supported)" \
+            << std::endl;
+        return 0;
+    }
+    std::vector<Outcome> outcomes = run(&ms, &primary, &requests, 8);
+    ms.m_shadow->drain();
+
+    modsecurity::ModSecurityShadowStats stats;
+    modsecurity::msc_shadow_stats(&ms, &stats);
+    size_t wrong = 0;
+    for (size_t i = 0; i < amount; i++) {
+        wrong += outcomes[i].disruptive != (i % 2 == 1) ? 1 : 0;
+    }
+    for (const std::string &d : diffs.m_diffs) {
+        wrong += d != "+8" ? 1 : 0;
+    }
+    if (wrong || stats.sampled != amount || stats.dropped != 0
+        || stats.evaluated != amount || stats.different != amount / 2
+        || diffs.m_diffs.size() != amount / 2) {
+        std::cout << ":test-result: FAIL shadow: " << stats.sampled \
+            << " sampled, " << stats.evaluated << " evaluated, " \
+            << stats.different << " different, " << wrong \
+            << " wrong outcome(s) or diff(s)" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS shadow" << std::endl;
+    }
+
+    /* A sample is dropped rather than waited for. */
+    ms.setShadowRules(&shadow, 0.25, 1, 0, shadowCb, &diffs);
+    run(&ms, &primary, &requests, 8);
+    ms.m_shadow->drain();
+    ms.getShadowStats(&stats);
+    if (stats.sampled != amount / 4 || stats.dropped != amount / 4
+        || stats.evaluated != 0) {
+        std::cout << ":test-result: FAIL shadow queue: " << stats.sampled \
+            << " sampled, " << stats.dropped << " dropped" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS shadow queue" << std::endl;
+    }
+
+    /*
+     * Identical sets, the primary blocking mid-phase: the rules after the
+     * one that blocked are not a difference.
+     */
+    const char *same = "SecRuleEngine On\n" \
+        "SecRule ARGS:q \"@rx .\" \"id:20,phase:2,pass,log\"\n" \
+        "SecRule ARGS:q \"@contains attack\" " \
+        "\"id:21,phase:2,deny,status:403\"\n" \
+        "SecRule ARGS:q \"@rx .\" \"id:22,phase:2,pass,log\"\n" \
+        "SecRule ARGS:q \"@rx .\" \"id:23,phase:5,pass,log\"";
+    modsecurity::RulesSet primarySame;
+    modsecurity::RulesSet shadowSame;
+    if (primarySame.load(same) < 0 || shadowSame.load(same) < 0) {
+        std::cout << ":test-result: FAIL shadow identical: " \
+            << primarySame.getParserError() << std::endl;
+        return failed + 1;
+    }
+    diffs.m_diffs.clear();
+    ms.setShadowRules(&shadowSame, 1, 2, amount, shadowCb, &diffs);
+    outcomes = run(&ms, &primarySame, &requests, 8);
+    ms.m_shadow->drain();
+    ms.getShadowStats(&stats);
+    if (stats.evaluated != amount || stats.different != 0
+        || !outcomes[1].disruptive) {
+        std::cout << ":test-result: FAIL shadow identical: " \
+            << stats.different << " of " << stats.evaluated \
+            << " different" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS shadow identical" << std::endl;
+    }
+
+    ms.setShadowRules(NULL, 0, 0, 0, NULL, NULL);
+    return failed;
+}
+
+
+/*
+ * Workers write to the same collection while a snapshot is due; the one
+ * taken as the instance goes away holds every key they wrote.
+ */
+static int testSnapshots() {
+    const char *path = "concurrency-collections.snapshot";
+    const size_t amount = 64;
+    const size_t clients = 4;
+    int failed = 0;
+
+    modsecurity::RulesSet rules;
+    if (rules.load("SecRuleEngine On\n" \
+        "SecAction \"id:1,phase:1,nolog,pass," \
+        "initcol:ip=%{REMOTE_ADDR}\"\n" \
+        "SecAction \"id:2,phase:1,nolog,pass," \
+        "setvar:ip.req_%{ARGS.i}=1\"") < 0) {
+        std::cout << ":test-result: FAIL snapshots: " \
+            << rules.getParserError() << std::endl;
+        return 1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests;
+    for (size_t i = 0; i < amount; i++) {
+        modsecurity::BatchRequest r;
+        r.m_clientIp = "10.0.1." + std::to_string(i % clients);
+        r.m_uri = "/?i=" + std::to_string(i);
+        requests.push_back(std::move(r));
+    }
+
+    std::remove(path);
+    std::unique_ptr<modsecurity::ModSecurity> ms(
+        new modsecurity::ModSecurity());
+    ms->setCollectionSnapshots(path, 0, 3600);
+    run(ms.get(), &rules, &requests, 8);
+    ms.reset(new modsecurity::ModSecurity());
+    int loaded = ms->setCollectionSnapshots(path, 0, 3600);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < amount; i++) {
+        std::unique_ptr<std::string> v = ms->m_ip_collection->resolveFirst(
+            "req_" + std::to_string(i), "10.0.1." + std::to_string(i % clients),
+            rules.m_secWebAppId.m_value);
+        if (v == nullptr || *v != "1") {
+            wrong++;
+        }
+    }
+    if (loaded <= 0 || wrong) {
+        std::cout << ":test-result: FAIL snapshots: " << loaded \
+            << " entries loaded, " << wrong << " key(s) not restored" \
+            << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS snapshots" << std::endl;
+    }
+
+    /* A truncated file is refused as a whole. */
+    ms.reset();
+    std::string data;
+    {
+        std::ifstream f(path, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(f),
+            std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        f.write(data.data(), data.size() - 3);
+    }
+    ms.reset(new modsecurity::ModSecurity());
+    loaded = ms->setCollectionSnapshots(path, 0, 0);
+    std::unique_ptr<std::string> v = ms->m_ip_collection->resolveFirst(
+        "req_0", "10.0.1.0", rules.m_secWebAppId.m_value);
+    if (loaded != -1 || v != nullptr) {
+        std::cout << ":test-result: FAIL snapshots: truncated file gave " \
+            << loaded << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS snapshots truncated" << std::endl;
+    }
+
+    ms->setCollectionSnapshots(NULL, 0, 0);
+    std::remove(path);
+    return failed;
+}
+
+
+/*
+ * Workers search the same @pm tree at once, each from its own position:
+ * every request finds the phrase it carries, as it does on its own.
+ */
+static int testPm(modsecurity::ModSecurity *ms) {
+    const char *phrases[] = { "alpha", "bravo", "charlie", "delta", "echo" };
+    const size_t amount = 256;
+
+    modsecurity::RulesSet rules;
+    if (rules.load("SecRuleEngine On\n" \
+        "SecRule ARGS:q \"@pm alpha bravo charlie delta echo\" " \
+        "\"id:30,phase:2,pass,nolog,capture\"\n" \
+        "SecRule TX:0 \"@streq alpha\" \"id:31,phase:2,pass,log\"\n" \
+        "SecRule TX:0 \"@streq bravo\" \"id:32,phase:2,pass,log\"\n" \
+        "SecRule TX:0 \"@streq charlie\" \"id:33,phase:2,pass,log\"\n" \
+        "SecRule TX:0 \"@streq delta\" \"id:34,phase:2,pass,log\"\n" \
+        "SecRule TX:0 \"@streq echo\" \"id:35,phase:2,pass,log\"") < 0) {
+        std::cout << ":test-result: FAIL pm: " << rules.getParserError() \
+            << std::endl;
+        return 1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests;
+    for (size_t i = 0; i < amount; i++) {
+        modsecurity::BatchRequest r;
+        r.m_uri = "/?q=" + std::string(i % 13, 'x') + phrases[i % 5] \
+            + std::string(i % 7, 'y');
+        requests.push_back(std::move(r));
+    }
+
+    std::vector<Outcome> serial = run(ms, &rules, &requests, 0);
+    for (size_t i = 0; i < amount; i++) {
+        if (serial[i].rules != std::vector<int>(1, 31 + i % 5)) {
+            std::cout << ":test-result: FAIL pm: request " << i \
+                << " got " << serial[i].print() << std::endl;
+            return 1;
+        }
+    }
+    std::vector<Outcome> parallel = run(ms, &rules, &requests, 8);
+    return compare("pm with 8 workers", serial, parallel) ? 0 : 1;
+}
+
+
+/*
+ * Concurrent events from one client are counted once each: exactly the
+ * limit gets through, whatever the interleaving.
+ */
+static int testRateLimit() {
+    const int threads = 8;
+    const int events = 8;
+    const int limit = 10;
+    const int64_t now = 1000000000;
+    const int64_t period = 60 * 1000000LL;
+    std::atomic<int> passed(0);
+
+    modsecurity::ModSecurity ms;
+    modsecurity::collection::Collection *c = ms.m_ip_collection;
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++) {
+        pool.emplace_back([c, &passed, now, period] {
+            for (int j = 0; j < events; j++) {
+                if (c->rateLimit("RATELIMIT_1", "10.0.2.1", "", now, period,
+                    limit)) {
+                    passed++;
+                }
+            }
+        });
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+
+    if (passed != limit
+        || !c->rateLimit("RATELIMIT_1", "10.0.2.2", "", now, period,
+            limit)) {
+        std::cout << ":test-result: FAIL rate limit: " << passed \
+            << " of " << threads * events << " event(s) let through" \
+            << std::endl;
+        return 1;
+    }
+    std::cout << ":test-result: PASS rate limit" << std::endl;
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    const size_t amount = 512;
+    const int rounds = 10;
+    const int workers = 8;
+    int failed = 0;
+
+    if (argc < 2) {
+        std::cout << "Use: " << argv[0] << " <rules file>" << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<modsecurity::ModSecurity> ms(
+        new modsecurity::ModSecurity());
+    ms->setServerLogCb(logCb, modsecurity::RuleMessageLogProperty);
+
+    std::unique_ptr<modsecurity::RulesSet> rules(
+        new modsecurity::RulesSet());
+    if (rules->loadFromUri(argv[1]) < 0) {
+        std::cout << ":test-result: FAIL failed to load " << argv[1] << ": " \
+            << rules->getParserError() << std::endl;
+        return -1;
+    }
+
+    std::vector<modsecurity::BatchRequest> requests = buildRequests(amount);
+    rules->setNegativeCache(0, 0);
+    std::vector<Outcome> serial = run(ms.get(), rules.get(), &requests, 0);
+    rules->setNegativeCache(4096, 256);
+
+    size_t disruptive = 0;
+    for (const Outcome &o : serial) {
+        disruptive += o.disruptive ? 1 : 0;
+    }
+    if (disruptive == 0 || disruptive == serial.size()) {
+        std::cout << ":test-result: FAIL serial run: unexpected amount of " \
+            "disruptive interventions: " << disruptive << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS serial run" << std::endl;
+    }
+
+    std::set<std::string> ids;
+    for (int r = 0; r < rounds; r++) {
+        std::vector<Outcome> parallel = run(ms.get(), rules.get(),
+            &requests, workers);
+        if (!compare("batch round " + std::to_string(r) + " with " \
+            + std::to_string(workers) + " workers", serial, parallel)) {
+            failed++;
+        }
+        for (const Outcome &o : parallel) {
+            ids.insert(o.id);
+        }
+    }
+    if (ids.size() != amount * rounds) {
+        std::cout << ":test-result: FAIL unique ids: " \
+            << amount * rounds - ids.size() << " duplicate(s)" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS unique ids" << std::endl;
+    }
+
+    if (rules->getNegativeCacheHits() == 0) {
+        std::cout << ":test-result: FAIL negative cache: no hits after " \
+            << rules->getNegativeCacheLookups() << " lookup(s)" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS negative cache" << std::endl;
+    }
+
+    rules->setParallelEvaluation(4);
+    for (int w : {0, workers}) {
+        std::vector<Outcome> parallel = run(ms.get(), rules.get(),
+            &requests, w);
+        if (!compare("parallel rule evaluation with " + std::to_string(w) \
+            + " batch workers", serial, parallel)) {
+            failed++;
+        }
+    }
+    rules->setParallelEvaluation(0);
+
+    size_t suspensions = 0;
+    std::vector<Outcome> sliced = runSliced(ms.get(), rules.get(), requests,
+        1, &suspensions);
+    if (suspensions == 0) {
+        std::cout << ":test-result: FAIL sliced evaluation: the " \
+            "evaluation was never suspended" << std::endl;
+        failed++;
+    } else if (!compare("sliced evaluation", serial, sliced)) {
+        failed++;
+    }
+
+    size_t missing = 0;
+    for (size_t i = 0; i < amount; i++) {
+        std::unique_ptr<std::string> v = ms->m_global_collection->resolveFirst(
+            "req_" + std::to_string(i), "concurrency",
+            rules->m_secWebAppId.m_value);
+        if (v == nullptr || *v != "1") {
+            missing++;
+        }
+    }
+    if (missing) {
+        std::cout << ":test-result: FAIL global collection: " << missing \
+            << " key(s) missing" << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS global collection" << std::endl;
+    }
+
+    /*
+     * Every transaction went through the same instance: serial, batch
+     * rounds, two parallel evaluations and the sliced one.
+     */
+    size_t runs = 1 + rounds + 2 + 1;
+    char *dump = modsecurity::msc_metrics_dump(ms.get(),
+        modsecurity::MetricsPrometheusFormat);
+    std::stringstream metrics(dump);
+    free(dump);
+    size_t transactions = 0;
+    size_t interventions = 0;
+    std::string line;
+    while (std::getline(metrics, line)) {
+        if (line.compare(0, 31, "modsecurity_transactions_total ") == 0) {
+            transactions = std::stoul(line.substr(31));
+        } else if (line.compare(0, 32,
+            "modsecurity_interventions_total{") == 0) {
+            interventions += std::stoul(line.substr(line.rfind(' ') + 1));
+        }
+    }
+    if (transactions != amount * runs
+        || interventions != disruptive * runs) {
+        std::cout << ":test-result: FAIL metrics: " << transactions \
+            << " transaction(s) and " << interventions \
+            << " intervention(s) counted, expected " << amount * runs \
+            << " and " << disruptive * runs << std::endl;
+        failed++;
+    } else {
+        std::cout << ":test-result: PASS metrics" << std::endl;
+    }
+
+    failed += testRbl(ms.get());
+    failed += testSlowCapture(ms.get());
+    failed += testShadow();
+    failed += testSnapshots();
+    failed += testPm(ms.get());
+    failed += testRateLimit();
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,435 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "modsecurity/rules_set.h"
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/intervention.h"
+
+
+/**
+ * Latency guided fuzzing.
+ *
+ * Instead of looking for crashes, this harness looks for inputs that make
+ * a real rule set slow: every input is turned into a request, evaluated
+ * against the loaded rules and timed. Inputs exceeding the threshold are
+ * minimized (while keeping them above the threshold) once the fuzzing loop
+ * is over, and stored into the corpus directory twice: as the raw input,
+ * to be checked again with this harness, and as a regression test case
+ * (.json) to be added under test/test-cases/regression.
+ *
+ * The input is mapped into a request as follows: everything up to the
+ * first new line becomes the query string, the remaining bytes become an
+ * urlencoded request body.
+ *
+ * Usage:
+ *
+ *   # under afl, slow inputs are reported as crashes (-a).
+ *   afl-fuzz -i in -o out -- ./latency_fuzzer -r rules.conf -a
+ *
+ *   # minimize the findings, or re-check an existing corpus.
+ *   ./latency_fuzzer -r rules.conf -t 2000 -c slow out/crashes/id*
+ *
+ */
+
+
+using modsecurity::ModSecurity;
+using modsecurity::RulesSet;
+using modsecurity::Transaction;
+
+
+const char* const help_message = "Usage: latency_fuzzer -r <rules> " \
+    "[-t threshold_us] [-c corpus_dir] [-n repetitions] [-a] [inputs...]";
+
+
+struct LatencyOptions {
+    LatencyOptions()
+        : threshold(10000),
+        repetitions(1),
+        abortOnSlow(false) { }
+
+    std::string rules;
+    std::string corpus;
+    long threshold;
+    int repetitions;
+    bool abortOnSlow;
+    std::vector<std::string> inputs;
+};
+
+
+struct SlowInput {
+    std::string label;
+    std::string input;
+    long us;
+};
+
+
+static void split_input(const std::string &input, std::string *uri,
+    std::string *body) {
+    size_t nl = input.find('\n');
+    uri->assign("/fuzz?");
+    uri->append(input, 0, nl);
+    body->clear();
+    if (nl != std::string::npos) {
+        body->assign(input, nl + 1, std::string::npos);
+    }
+}
+
+
+/**
+ * Evaluates the input as a request, returning the status code a connector
+ * would have answered with.
+ */
+static int run_transaction(ModSecurity *ms, RulesSet *rules,
+    const std::string &input) {
+    modsecurity::ModSecurityIntervention it;
+    modsecurity::intervention::clean(&it);
+
+    std::string uri;
+    std::string body;
+    split_input(input, &uri, &body);
+
+    Transaction *t = new Transaction(ms, rules, NULL);
+    t->processConnection("127.0.0.1", 12345, "127.0.0.1", 80);
+    t->processURI(uri.c_str(), "POST", "1.1");
+    t->addRequestHeader("Host", "localhost");
+    t->addRequestHeader("Content-Type", "application/x-www-form-urlencoded");
+    t->addRequestHeader("Content-Length", std::to_string(body.size()));
+    t->processRequestHeaders();
+    t->appendRequestBody(
+        reinterpret_cast<const unsigned char *>(body.c_str()), body.size());
+    t->processRequestBody();
+    t->addResponseHeader("Content-Type", "text/html");
+    t->processResponseHeaders(200, "HTTP 1.1");
+    t->processResponseBody();
+    t->processLogging();
+    t->intervention(&it);
+    int status = it.disruptive ? it.status : 200;
+    modsecurity::intervention::free(&it);
+    delete t;
+    return status;
+}
+
+
+/**
+ * Best of `repetitions' runs, in microseconds. Taking the minimum filters
+ * out scheduling noise that would otherwise produce false findings.
+ */
+static long measure(ModSecurity *ms, RulesSet *rules,
+    const std::string &input, int repetitions) {
+    long best = -1;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run_transaction(ms, rules, input);
+        auto end = std::chrono::steady_clock::now();
+        long us = std::chrono::duration_cast<std::chrono::microseconds>(
+            end - start).count();
+        if (best < 0 || us < best) {
+            best = us;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Chunk removal minimization: tries to drop progressively smaller chunks
+ * of the input, keeping every removal that leaves the input slow.
+ */
+static std::string minimize(ModSecurity *ms, RulesSet *rules,
+    const std::string &input, const LatencyOptions &opts) {
+    std::string current(input);
+    int repetitions = std::max(opts.repetitions, 3);
+    size_t chunk = current.size() / 2;
+
+    while (chunk > 0) {
+        bool reduced = false;
+        size_t pos = 0;
+        while (pos < current.size()) {
+            std::string candidate(current);
+            candidate.erase(pos, chunk);
+            if (measure(ms, rules, candidate, repetitions) >= opts.threshold) {
+                current.swap(candidate);
+                reduced = true;
+            } else {
+                pos += chunk;
+            }
+        }
+        if (!reduced) {
+            chunk = chunk / 2;
+        }
+    }
+
+    return current;
+}
+
+
+/**
+ * JSON string literal. JSON has no room for raw bytes: the ones outside
+ * ASCII are written as the code point of the same value, which the test
+ * driver hands over as UTF-8.
+ */
+static std::string json_string(const std::string &s) {
+    std::string out("\"");
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out.append(esc);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+
+
+/**
+ * The input as a test case for test/regression, carrying the lines of the
+ * rules file. The driver terminates every body line with a new line, so
+ * does the Content-Length here.
+ */
+static std::string to_regression(const std::string &input,
+    const std::string &name, int status, const LatencyOptions &opts) {
+    std::string uri;
+    std::string body;
+    split_input(input, &uri, &body);
+
+    std::vector<std::string> lines;
+    size_t length = 0;
+    size_t pos = 0;
+    while (pos < body.size()) {
+        size_t nl = body.find('\n', pos);
+        if (nl == std::string::npos) {
+            nl = body.size();
+        }
+        lines.push_back(body.substr(pos, nl - pos));
+        length += nl - pos + 1;
+        pos = nl + 1;
+    }
+
+    std::stringstream ss;
+    ss << "[\n";
+    ss << "  {\n";
+    ss << "    \"enabled\":1,\n";
+    ss << "    \"version_min\":300000,\n";
+    ss << "    \"version_max\":0,\n";
+    ss << "    \"title\":" << json_string("Latency fuzzer :: " + name) \
+        << ",\n";
+    ss << "    \"client\":{\n";
+    ss << "      \"ip\":\"127.0.0.1\",\n";
+    ss << "      \"port\":12345\n";
+    ss << "    },\n";
+    ss << "    \"server\":{\n";
+    ss << "      \"ip\":\"127.0.0.1\",\n";
+    ss << "      \"port\":80\n";
+    ss << "    },\n";
+    ss << "    \"request\":{\n";
+    ss << "      \"headers\":{\n";
+    ss << "        \"Host\":\"localhost\",\n";
+    ss << "        \"Content-Type\":" \
+        "\"application/x-www-form-urlencoded\",\n";
+    ss << "        \"Content-Length\":\"" << length << "\"\n";
+    ss << "      },\n";
+    ss << "      \"uri\":" << json_string(uri) << ",\n";
+    ss << "      \"method\":\"POST\",\n";
+    ss << "      \"http_version\":1.1,\n";
+    ss << "      \"body\":[";
+    for (size_t i = 0; i < lines.size(); i++) {
+        ss << (i ? ",\n" : "\n") << "        " << json_string(lines[i]);
+    }
+    ss << (lines.empty() ? "]" : "\n      ]") << "\n";
+    ss << "    },\n";
+    ss << "    \"response\":{\n";
+    ss << "      \"headers\":{\n";
+    ss << "        \"Content-Type\":\"text/html\"\n";
+    ss << "      },\n";
+    ss << "      \"body\":[]\n";
+    ss << "    },\n";
+    ss << "    \"expected\":{\n";
+    ss << "      \"http_code\":" << status << "\n";
+    ss << "    },\n";
+    ss << "    \"rules\":[";
+    std::ifstream in(opts.rules);
+    std::string line;
+    bool first = true;
+    while (std::getline(in, line)) {
+        ss << (first ? "\n" : ",\n") << "      " << json_string(line);
+        first = false;
+    }
+    ss << (first ? "]" : "\n    ]") << "\n";
+    ss << "  }\n";
+    ss << "]\n";
+    return ss.str();
+}
+
+
+static std::string store(const std::string &dir, const std::string &input,
+    int status, long us, const LatencyOptions &opts) {
+    /* FNV-1a, only to have stable and distinct file names. */
+    unsigned long long h = 14695981039346656037ULL;
+    for (unsigned char c : input) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "slow-%016llx-%ldus", h, us);
+
+    std::string path = dir + "/" + name;
+    std::ofstream out(path, std::ios::binary);
+    out.write(input.c_str(), input.size());
+
+    std::ofstream json(path + ".json", std::ios::binary);
+    json << to_regression(input, name, status, opts);
+    return path;
+}
+
+
+static void report(ModSecurity *ms, RulesSet *rules, const SlowInput &slow,
+    const LatencyOptions &opts) {
+    std::string min = minimize(ms, rules, slow.input, opts);
+    long minUs = measure(ms, rules, min, std::max(opts.repetitions, 3));
+
+    std::cerr << slow.label << ": " << slow.us << "us (threshold " \
+        << opts.threshold << "us), minimized from " << slow.input.size() \
+        << " to " << min.size() << " bytes (" << minUs << "us)";
+    if (!opts.corpus.empty()) {
+        int status = run_transaction(ms, rules, min);
+        std::cerr << ", saved as " \
+            << store(opts.corpus, min, status, minUs, opts);
+    }
+    std::cerr << std::endl;
+}
+
+
+static std::string read_all(int fd) {
+    std::string input;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        input.append(buf, n);
+    }
+    return input;
+}
+
+
+int main(int argc, char **argv) {
+    LatencyOptions opts;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:t:c:n:ah")) != -1) {
+        switch (c) {
+            case 'r':
+                opts.rules = optarg;
+                break;
+            case 't':
+                opts.threshold = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                opts.corpus = optarg;
+                break;
+            case 'n':
+                opts.repetitions = std::max(1, atoi(optarg));
+                break;
+            case 'a':
+                opts.abortOnSlow = true;
+                break;
+            default:
+                std::cout << help_message << std::endl;
+                return c == 'h' ? 0 : -1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        opts.inputs.push_back(argv[i]);
+    }
+
+    if (opts.rules.empty() || opts.threshold <= 0) {
+        std::cout << help_message << std::endl;
+        return -1;
+    }
+
+    ModSecurity *ms = new ModSecurity();
+    RulesSet *rules = new RulesSet();
+    if (rules->loadFromUri(opts.rules.c_str()) < 0) {
+        std::cerr << "Problems loading the rules..." << std::endl;
+        std::cerr << rules->m_parserError.str() << std::endl;
+        return -1;
+    }
+
+    std::vector<SlowInput> slow;
+    if (!opts.inputs.empty()) {
+        for (const std::string &file : opts.inputs) {
+            std::ifstream in(file, std::ios::binary);
+            std::stringstream ss;
+            ss << in.rdbuf();
+            long us = measure(ms, rules, ss.str(), opts.repetitions);
+            if (us >= opts.threshold) {
+                slow.push_back({file, ss.str(), us});
+            }
+        }
+    } else {
+#ifdef __AFL_LOOP
+        while (__AFL_LOOP(1000)) {
+#else
+        do {
+#endif
+            std::string input = read_all(STDIN_FILENO);
+            long us = measure(ms, rules, input, opts.repetitions);
+            if (us >= opts.threshold) {
+                if (opts.abortOnSlow) {
+                    abort();
+                }
+                slow.push_back({"stdin", input, us});
+            }
+#ifdef __AFL_LOOP
+        }
+#else
+        } while (0);
+#endif
+    }
+
+    /*
+     * Minimizing takes far more runs than spotting, it is kept out of the
+     * fuzzing loop.
+     */
+    for (const SlowInput &s : slow) {
+        report(ms, rules, s, opts);
+    }
+    if (!opts.inputs.empty()) {
+        std::cout << slow.size() << " of " << opts.inputs.size() \
+            << " input(s) above " << opts.threshold << "us." << std::endl;
+    }
+
+    delete rules;
+    delete ms;
+
+    return slow.empty() ? 0 : 1;
+}
@@ -23,6 +23,7 @@
 #include <list>
 #include <algorithm>
 
+#include "modsecurity/data_provider.h"
 #include "modsecurity/rules_set.h"
 #include "modsecurity/modsecurity.h"
 #include "test/common/modsecurity_test.h"
@@ -201,8 +202,16 @@ void perform_unit_test(ModSecurityTest<RegressionTest> *test,
             continue;
         }
 
+        for (const auto &d : t->data) {
+            modsecurity::msc_data_register(d.first.c_str(), d.second.c_str(),
+                d.second.size(), NULL, NULL);
+        }
         modsec_rules->load("SecDebugLogLevel 9");
-        if (modsec_rules->load(t->rules.c_str(), filename) < 0) {
+        int loaded = modsec_rules->load(t->rules.c_str(), filename);
+        if (t->data.empty() == false) {
+            modsecurity::msc_data_release();
+        }
+        if (loaded < 0) {
             /* Parser error */
             if (t->parser_error.empty() == true) {
                 /*
@@ -304,6 +313,12 @@ void perform_unit_test(ModSecurityTest<RegressionTest> *test,
 
         clearAuditLog(modsec_transaction->m_rules->m_auditLog->m_path1);
 
+        /*
+         * A suspended phase is completed by the next process call, the
+         * last one by processLogging().
+         */
+        modsec_transaction->setEvaluationSlice(t->evaluation_slice, 0);
+
         modsec_transaction->processConnection(t->clientIp.c_str(),
             t->clientPort, t->serverIp.c_str(), t->serverPort);
 
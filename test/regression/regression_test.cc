@@ -84,6 +84,7 @@ RegressionTest *RegressionTest::from_yajl_node(const yajl_val &node) {
     size_t nelem = node->u.object.len;
     RegressionTest *u = new RegressionTest();
     u->http_code = 200;
+    u->evaluation_slice = 0;
 
     for (int i = 0; i < nelem; i++) {
         const char *key = node->u.object.keys[ i ];
@@ -110,6 +111,12 @@ RegressionTest *RegressionTest::from_yajl_node(const yajl_val &node) {
         if (strcmp(key, "github_issue") == 0) {
             u->github_issue = YAJL_GET_INTEGER(val);
         }
+        if (strcmp(key, "evaluation_slice") == 0) {
+            u->evaluation_slice = YAJL_GET_INTEGER(val);
+        }
+        if (strcmp(key, "data") == 0) {
+            u->data = yajl_array_to_map(val);
+        }
         if (strcmp(key, "client") == 0) {
             for (int j = 0; j < val->u.object.len; j++) {
                 const char *key2 = val->u.object.keys[j];
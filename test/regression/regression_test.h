@@ -75,6 +75,12 @@ class RegressionTest {
 
     int http_code;
     std::string redirect_url;
+
+    /* Rules per call to the process functions, never resumed. */
+    int evaluation_slice;
+
+    /* Data files handed to the rules through msc_data_register. */
+    std::vector<std::pair<std::string, std::string>> data;
 };
 
 
@@ -0,0 +1,792 @@
+/*
+ * ModSecurity, http://www.modsecurity.org/
+ * Copyright (c) 2015 - 2021 Trustwave Holdings, Inc. (http://www.trustwave.com/)
+ *
+ * You may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * If any of the files related to licensing are missing or if you have any
+ * other questions related to licensing please contact Trustwave Holdings, Inc.
+ * directly using the email address security@modsecurity.org.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef WITH_YAJL
+#include <yajl/yajl_tree.h>
+#endif
+
+#include "modsecurity/modsecurity.h"
+#include "modsecurity/rules_set.h"
+#include "modsecurity/transaction.h"
+#include "modsecurity/intervention.h"
+#include "src/utils/base64.h"
+
+
+/*
+ * modsec-replay feeds recorded traffic through the complete Transaction
+ * API and reports what the engine decided for every request, together
+ * with the achieved throughput.
+ *
+ * Two input formats are understood:
+ *
+ *  - HAR (HTTP Archive) files, as exported by browsers and proxies;
+ *  - JSONL, one exchange per line:
+ *
+ *    {"client_ip": "200.249.12.31", "client_port": 12345,
+ *     "server_ip": "127.0.0.1", "server_port": 80,
+ *     "method": "POST", "uri": "/login.php?a=b", "http_version": "1.1",
+ *     "headers": [["Host", "example.com"], ["Content-Type", "..."]],
+ *     "body": "user=admin",
+ *     "response": {"status": 200, "protocol": "HTTP 1.1",
+ *                  "headers": [["Content-Type", "text/html"]],
+ *                  "body": "..."}}
+ *
+ *    Headers may also be given as an object ({"Host": "example.com"}).
+ *    A body next to "encoding": "base64" is decoded first, as in HAR.
+ *    Only "uri" is mandatory. The records written by the slow capture
+ *    (RulesSet::setSlowCapture) are in this format.
+ *
+ * Results are written (-o) as JSONL, one line per input record, and the
+ * very same file can be used later on as a baseline (-b): any change in
+ * the intervention status or in the set of matched rules is reported.
+ */
+
+
+struct ReplayRequest {
+    ReplayRequest()
+        : clientIp("127.0.0.1"),
+        clientPort(12345),
+        serverIp("127.0.0.1"),
+        serverPort(80),
+        method("GET"),
+        httpVersion("1.1"),
+        responseStatus(0),
+        responseProtocol("HTTP 1.1") { }
+
+    std::string clientIp;
+    int clientPort;
+    std::string serverIp;
+    int serverPort;
+    std::string method;
+    std::string uri;
+    std::string httpVersion;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    int responseStatus;
+    std::string responseProtocol;
+    std::vector<std::pair<std::string, std::string>> responseHeaders;
+    std::string responseBody;
+};
+
+
+struct ReplayResult {
+    ReplayResult()
+        : status(200),
+        disruptive(false),
+        recorded(false) { }
+
+    int status;
+    bool disruptive;
+    bool recorded;
+    std::string uri;
+    std::vector<long long> rules;
+};
+
+
+struct ReplayOptions {
+    ReplayOptions()
+        : format("auto"),
+        threads(1),
+        iterations(1),
+        quiet(false) { }
+
+    std::vector<std::string> rulesFiles;
+    std::string input;
+    std::string format;
+    std::string output;
+    std::string baseline;
+    int threads;
+    int iterations;
+    bool quiet;
+};
+
+
+static void print_help(const char *name) {
+    std::cout << "Use: " << name << " [options] <input.har|input.jsonl>";
+    std::cout << std::endl << std::endl;
+    std::cout << "  -r <file>   Rules file to load (may be repeated)." \
+        << std::endl;
+    std::cout << "  -f <fmt>    Input format: auto, har or jsonl " \
+        "(default: auto)." << std::endl;
+    std::cout << "  -j <n>      Number of concurrent workers (default: 1)." \
+        << std::endl;
+    std::cout << "  -n <n>      Replay the input n times (default: 1)." \
+        << std::endl;
+    std::cout << "  -o <file>   Write per request results (JSONL)." \
+        << std::endl;
+    std::cout << "  -b <file>   Compare the results against a baseline " \
+        "produced by -o." << std::endl;
+    std::cout << "  -q          Only print the summary." << std::endl;
+    std::cout << std::endl;
+}
+
+
+static std::string json_escape(const std::string &s) {
+    std::string ret;
+    ret.reserve(s.size() + 2);
+    for (char c : s) {
+        switch (c) {
+            case '"': ret.append("\\\""); break;
+            case '\\': ret.append("\\\\"); break;
+            case '\n': ret.append("\\n"); break;
+            case '\r': ret.append("\\r"); break;
+            case '\t': ret.append("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    ret.append(buf);
+                } else {
+                    ret.push_back(c);
+                }
+        }
+    }
+    return ret;
+}
+
+
+#ifdef WITH_YAJL
+static yajl_val json_get(yajl_val node, const char *key) {
+    if (!YAJL_IS_OBJECT(node)) {
+        return NULL;
+    }
+    for (size_t i = 0; i < node->u.object.len; i++) {
+        if (strcmp(node->u.object.keys[i], key) == 0) {
+            return node->u.object.values[i];
+        }
+    }
+    return NULL;
+}
+
+
+static std::string json_get_string(yajl_val node, const char *key,
+    const std::string &def = "") {
+    yajl_val v = json_get(node, key);
+    if (YAJL_IS_STRING(v)) {
+        return std::string(YAJL_GET_STRING(v));
+    }
+    return def;
+}
+
+
+static int json_get_int(yajl_val node, const char *key, int def) {
+    yajl_val v = json_get(node, key);
+    if (YAJL_IS_INTEGER(v)) {
+        return YAJL_GET_INTEGER(v);
+    }
+    if (YAJL_IS_STRING(v)) {
+        return atoi(YAJL_GET_STRING(v));
+    }
+    return def;
+}
+
+
+/*
+ * The "body" of a request or of a response, base64 encoded or not.
+ */
+static std::string json_get_body(yajl_val node) {
+    std::string body = json_get_string(node, "body");
+    if (json_get_string(node, "encoding") == "base64") {
+        return modsecurity::Utils::Base64::decode(body);
+    }
+    return body;
+}
+
+
+/*
+ * Accepts [["name", "value"], ...], [{"name": .., "value": ..}, ...] (HAR)
+ * or {"name": "value", ...}.
+ */
+static void json_get_headers(yajl_val node,
+    std::vector<std::pair<std::string, std::string>> *headers) {
+    if (YAJL_IS_OBJECT(node)) {
+        for (size_t i = 0; i < node->u.object.len; i++) {
+            yajl_val v = node->u.object.values[i];
+            if (YAJL_IS_STRING(v)) {
+                headers->emplace_back(node->u.object.keys[i],
+                    YAJL_GET_STRING(v));
+            }
+        }
+        return;
+    }
+
+    if (!YAJL_IS_ARRAY(node)) {
+        return;
+    }
+
+    for (size_t i = 0; i < node->u.array.len; i++) {
+        yajl_val h = node->u.array.values[i];
+        if (YAJL_IS_ARRAY(h) && h->u.array.len == 2
+            && YAJL_IS_STRING(h->u.array.values[0])
+            && YAJL_IS_STRING(h->u.array.values[1])) {
+            headers->emplace_back(YAJL_GET_STRING(h->u.array.values[0]),
+                YAJL_GET_STRING(h->u.array.values[1]));
+        } else if (YAJL_IS_OBJECT(h)) {
+            headers->emplace_back(json_get_string(h, "name"),
+                json_get_string(h, "value"));
+        }
+    }
+}
+
+
+static bool has_header(
+    const std::vector<std::pair<std::string, std::string>> &headers,
+    const std::string &name) {
+    for (const auto &h : headers) {
+        if (strcasecmp(h.first.c_str(), name.c_str()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static bool parse_jsonl_record(yajl_val node, ReplayRequest *r) {
+    r->uri = json_get_string(node, "uri");
+    if (r->uri.empty()) {
+        return false;
+    }
+    r->clientIp = json_get_string(node, "client_ip", r->clientIp);
+    r->clientPort = json_get_int(node, "client_port", r->clientPort);
+    r->serverIp = json_get_string(node, "server_ip", r->serverIp);
+    r->serverPort = json_get_int(node, "server_port", r->serverPort);
+    r->method = json_get_string(node, "method", r->method);
+    r->httpVersion = json_get_string(node, "http_version", r->httpVersion);
+    r->body = json_get_body(node);
+    json_get_headers(json_get(node, "headers"), &r->headers);
+
+    yajl_val response = json_get(node, "response");
+    if (YAJL_IS_OBJECT(response)) {
+        r->responseStatus = json_get_int(response, "status", 200);
+        r->responseProtocol = json_get_string(response, "protocol",
+            r->responseProtocol);
+        r->responseBody = json_get_body(response);
+        json_get_headers(json_get(response, "headers"), &r->responseHeaders);
+    }
+
+    return true;
+}
+
+
+/*
+ * HAR keeps absolute URLs; split them into the Host header and the
+ * request-target that a connector would hand over to processURI.
+ */
+static bool parse_har_entry(yajl_val entry, ReplayRequest *r) {
+    yajl_val request = json_get(entry, "request");
+    if (!YAJL_IS_OBJECT(request)) {
+        return false;
+    }
+
+    std::string url = json_get_string(request, "url");
+    if (url.empty()) {
+        return false;
+    }
+
+    std::string host;
+    size_t scheme = url.find("://");
+    if (scheme != std::string::npos) {
+        size_t path = url.find('/', scheme + 3);
+        host = url.substr(scheme + 3, path == std::string::npos ?
+            std::string::npos : path - scheme - 3);
+        r->uri = path == std::string::npos ? "/" : url.substr(path);
+        if (url.compare(0, scheme, "https") == 0) {
+            r->serverPort = 443;
+        }
+    } else {
+        r->uri = url;
+    }
+
+    r->method = json_get_string(request, "method", r->method);
+    std::string version = json_get_string(request, "httpVersion");
+    if (version.compare(0, 5, "HTTP/") == 0) {
+        r->httpVersion = version.substr(5);
+    }
+    json_get_headers(json_get(request, "headers"), &r->headers);
+    if (!host.empty() && !has_header(r->headers, "Host")) {
+        r->headers.emplace_back("Host", host);
+    }
+
+    yajl_val postData = json_get(request, "postData");
+    if (YAJL_IS_OBJECT(postData)) {
+        r->body = json_get_string(postData, "text");
+    }
+
+    r->serverIp = json_get_string(entry, "serverIPAddress", r->serverIp);
+
+    yajl_val response = json_get(entry, "response");
+    if (YAJL_IS_OBJECT(response)) {
+        r->responseStatus = json_get_int(response, "status", 200);
+        json_get_headers(json_get(response, "headers"),
+            &r->responseHeaders);
+        yajl_val content = json_get(response, "content");
+        /* base64 encoded (binary) content is not worth inspecting. */
+        if (YAJL_IS_OBJECT(content)
+            && json_get_string(content, "encoding").empty()) {
+            r->responseBody = json_get_string(content, "text");
+        }
+    }
+
+    return true;
+}
+
+
+static bool load_jsonl(const std::string &file,
+    std::vector<ReplayRequest> *requests, std::string *err) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        err->assign("Failed to open: " + file);
+        return false;
+    }
+
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(in, line)) {
+        char errbuf[1024];
+        lineno++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        yajl_val node = yajl_tree_parse(line.c_str(), errbuf, sizeof(errbuf));
+        if (node == NULL) {
+            err->assign(file + ":" + std::to_string(lineno) + ": " + errbuf);
+            return false;
+        }
+        ReplayRequest r;
+        if (parse_jsonl_record(node, &r)) {
+            requests->push_back(std::move(r));
+        } else {
+            std::cerr << file << ":" << lineno << ": record without an " \
+                "uri, ignoring." << std::endl;
+        }
+        yajl_tree_free(node);
+    }
+
+    return true;
+}
+
+
+static bool load_har(const std::string &file,
+    std::vector<ReplayRequest> *requests, std::string *err) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        err->assign("Failed to open: " + file);
+        return false;
+    }
+    std::stringstream content;
+    content << in.rdbuf();
+
+    char errbuf[1024];
+    yajl_val node = yajl_tree_parse(content.str().c_str(), errbuf,
+        sizeof(errbuf));
+    if (node == NULL) {
+        err->assign(file + ": " + errbuf);
+        return false;
+    }
+
+    yajl_val entries = json_get(json_get(node, "log"), "entries");
+    if (!YAJL_IS_ARRAY(entries)) {
+        err->assign(file + ": not a HAR file (missing log.entries).");
+        yajl_tree_free(node);
+        return false;
+    }
+
+    for (size_t i = 0; i < entries->u.array.len; i++) {
+        ReplayRequest r;
+        if (parse_har_entry(entries->u.array.values[i], &r)) {
+            requests->push_back(std::move(r));
+        }
+    }
+
+    yajl_tree_free(node);
+    return true;
+}
+
+
+static bool load_baseline(const std::string &file,
+    std::vector<ReplayResult> *results, std::string *err) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        err->assign("Failed to open: " + file);
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        char errbuf[1024];
+        if (line.empty()) {
+            continue;
+        }
+        yajl_val node = yajl_tree_parse(line.c_str(), errbuf, sizeof(errbuf));
+        if (node == NULL) {
+            err->assign(file + ": " + errbuf);
+            return false;
+        }
+        int index = json_get_int(node, "index", -1);
+        if (index >= 0) {
+            if (results->size() <= static_cast<size_t>(index)) {
+                results->resize(index + 1);
+            }
+            ReplayResult &res = (*results)[index];
+            res.recorded = true;
+            res.status = json_get_int(node, "status", 200);
+            res.disruptive = YAJL_IS_TRUE(json_get(node, "disruptive"));
+            res.uri = json_get_string(node, "uri");
+            yajl_val rules = json_get(node, "rules");
+            if (YAJL_IS_ARRAY(rules)) {
+                for (size_t i = 0; i < rules->u.array.len; i++) {
+                    if (YAJL_IS_INTEGER(rules->u.array.values[i])) {
+                        res.rules.push_back(
+                            YAJL_GET_INTEGER(rules->u.array.values[i]));
+                    }
+                }
+            }
+        }
+        yajl_tree_free(node);
+    }
+
+    return true;
+}
+#endif
+
+
+/*
+ * Collects the id of every rule that matched, including the rules that do
+ * not log (nolog, or no msg). Only the recorded pass hands a list over.
+ */
+static void collect_match(void *data, long long ruleId, int phase) {
+    if (data != NULL) {
+        static_cast<std::vector<long long> *>(data)->push_back(ruleId);
+    }
+}
+
+
+/*
+ * Drives a single exchange through every phase, stopping at the first
+ * disruptive intervention exactly like a connector would.
+ */
+static void replay(modsecurity::ModSecurity *modsec,
+    modsecurity::RulesSet *rules, const ReplayRequest &r,
+    ReplayResult *res) {
+    modsecurity::ModSecurityIntervention it;
+    modsecurity::intervention::clean(&it);
+    modsecurity::Transaction *t = new modsecurity::Transaction(modsec, rules,
+        res ? &res->rules : NULL);
+
+    t->processConnection(r.clientIp.c_str(), r.clientPort,
+        r.serverIp.c_str(), r.serverPort);
+    if (t->intervention(&it)) {
+        goto done;
+    }
+
+    t->processURI(r.uri.c_str(), r.method.c_str(), r.httpVersion.c_str());
+    if (t->intervention(&it)) {
+        goto done;
+    }
+
+    for (const auto &h : r.headers) {
+        t->addRequestHeader(h.first, h.second);
+    }
+    t->processRequestHeaders();
+    if (t->intervention(&it)) {
+        goto done;
+    }
+
+    if (!r.body.empty()) {
+        t->appendRequestBody(
+            reinterpret_cast<const unsigned char *>(r.body.c_str()),
+            r.body.size());
+    }
+    t->processRequestBody();
+    if (t->intervention(&it)) {
+        goto done;
+    }
+
+    if (r.responseStatus == 0) {
+        goto done;
+    }
+
+    for (const auto &h : r.responseHeaders) {
+        t->addResponseHeader(h.first, h.second);
+    }
+    t->processResponseHeaders(r.responseStatus, r.responseProtocol);
+    if (t->intervention(&it)) {
+        goto done;
+    }
+
+    if (!r.responseBody.empty()) {
+        t->appendResponseBody(
+            reinterpret_cast<const unsigned char *>(r.responseBody.c_str()),
+            r.responseBody.size());
+    }
+    t->processResponseBody();
+    t->intervention(&it);
+
+done:
+    t->processLogging();
+    delete t;
+
+    if (res) {
+        res->recorded = true;
+        res->status = it.status;
+        res->disruptive = it.disruptive != 0;
+        res->uri = r.uri;
+        std::sort(res->rules.begin(), res->rules.end());
+        res->rules.erase(std::unique(res->rules.begin(), res->rules.end()),
+            res->rules.end());
+    }
+    modsecurity::intervention::free(&it);
+}
+
+
+static std::string result_to_json(size_t index, const ReplayResult &res) {
+    std::stringstream ss;
+    ss << "{\"index\": " << index;
+    ss << ", \"status\": " << res.status;
+    ss << ", \"disruptive\": " << (res.disruptive ? "true" : "false");
+    ss << ", \"uri\": \"" << json_escape(res.uri) << "\"";
+    ss << ", \"rules\": [";
+    for (size_t i = 0; i < res.rules.size(); i++) {
+        ss << (i ? ", " : "") << res.rules[i];
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+
+static bool parse_int_arg(const char *arg, int *v) {
+    char *end = NULL;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || n <= 0) {
+        return false;
+    }
+    *v = static_cast<int>(n);
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+    ReplayOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-h" || arg == "--help") {
+            print_help(argv[0]);
+            return 0;
+        } else if (arg == "-q") {
+            opts.quiet = true;
+        } else if (arg == "-r" && hasValue) {
+            opts.rulesFiles.push_back(argv[++i]);
+        } else if (arg == "-f" && hasValue) {
+            opts.format = argv[++i];
+        } else if (arg == "-o" && hasValue) {
+            opts.output = argv[++i];
+        } else if (arg == "-b" && hasValue) {
+            opts.baseline = argv[++i];
+        } else if (arg == "-j" && hasValue) {
+            if (!parse_int_arg(argv[++i], &opts.threads)) {
+                std::cerr << "Invalid number of workers: " << argv[i] \
+                    << std::endl;
+                return -1;
+            }
+        } else if (arg == "-n" && hasValue) {
+            if (!parse_int_arg(argv[++i], &opts.iterations)) {
+                std::cerr << "Invalid number of iterations: " << argv[i] \
+                    << std::endl;
+                return -1;
+            }
+        } else if (arg[0] != '-' && opts.input.empty()) {
+            opts.input = arg;
+        } else {
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+
+    if (opts.input.empty() || opts.rulesFiles.empty()) {
+        print_help(argv[0]);
+        return -1;
+    }
+
+#ifndef WITH_YAJL
+    std::cerr << "modsec-replay needs ModSecurity to be built with " \
+        "YAJL support." << std::endl;
+    return -1;
+#else
+    std::vector<ReplayRequest> requests;
+    std::string err;
+
+    if (opts.format == "auto") {
+        const std::string har(".har");
+        opts.format = (opts.input.size() >= har.size()
+            && opts.input.compare(opts.input.size() - har.size(),
+                har.size(), har) == 0) ? "har" : "jsonl";
+    }
+
+    bool loaded = false;
+    if (opts.format == "har") {
+        loaded = load_har(opts.input, &requests, &err);
+    } else if (opts.format == "jsonl") {
+        loaded = load_jsonl(opts.input, &requests, &err);
+    } else {
+        err.assign("Unknown input format: " + opts.format);
+    }
+    if (!loaded) {
+        std::cerr << err << std::endl;
+        return -1;
+    }
+    if (requests.empty()) {
+        std::cerr << "No requests found in: " << opts.input << std::endl;
+        return -1;
+    }
+
+    modsecurity::ModSecurity *modsec = new modsecurity::ModSecurity();
+    modsec->setConnectorInformation("ModSecurity-replay v0.0.1-alpha" \
+        " (ModSecurity traffic replay utility)");
+    modsec->setRuleMatchCb(collect_match);
+
+    modsecurity::RulesSet *rules = new modsecurity::RulesSet();
+    for (const auto &file : opts.rulesFiles) {
+        if (rules->loadFromUri(file.c_str()) < 0) {
+            std::cerr << "Problems loading the rules: " << file << std::endl;
+            std::cerr << rules->m_parserError.str() << std::endl;
+            delete rules;
+            delete modsec;
+            return -1;
+        }
+    }
+
+    /*
+     * Only the first pass over the input is recorded, further iterations
+     * are there to produce a meaningful throughput figure.
+     */
+    std::vector<ReplayResult> results(requests.size());
+    size_t total = requests.size() * opts.iterations;
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t job;
+        while ((job = next.fetch_add(1)) < total) {
+            size_t idx = job % requests.size();
+            replay(modsec, rules, requests[idx],
+                job < requests.size() ? &results[idx] : NULL);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 1; i < opts.threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto &w : workers) {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    int ret = 0;
+    size_t disrupted = 0;
+    for (const auto &res : results) {
+        disrupted += res.disruptive ? 1 : 0;
+    }
+
+    if (!opts.output.empty()) {
+        std::ofstream out(opts.output);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open: " << opts.output << std::endl;
+            delete rules;
+            delete modsec;
+            return -1;
+        }
+        for (size_t i = 0; i < results.size(); i++) {
+            out << result_to_json(i, results[i]) << std::endl;
+        }
+    }
+
+    size_t mismatches = 0;
+    if (!opts.baseline.empty()) {
+        std::vector<ReplayResult> baseline;
+        if (!load_baseline(opts.baseline, &baseline, &err)) {
+            std::cerr << err << std::endl;
+            delete rules;
+            delete modsec;
+            return -1;
+        }
+        for (size_t i = 0; i < results.size(); i++) {
+            const ReplayResult &cur = results[i];
+            bool known = i < baseline.size() && baseline[i].recorded;
+            if (known && baseline[i].status == cur.status
+                && baseline[i].disruptive == cur.disruptive
+                && baseline[i].rules == cur.rules) {
+                continue;
+            }
+            mismatches++;
+            if (!opts.quiet) {
+                std::cout << "Mismatch on request " << i << " (" \
+                    << cur.uri << ")" << std::endl;
+                if (known) {
+                    std::cout << "  baseline: " \
+                        << result_to_json(i, baseline[i]) << std::endl;
+                } else {
+                    std::cout << "  baseline: <missing>" << std::endl;
+                }
+                std::cout << "  current:  " << result_to_json(i, cur) \
+                    << std::endl;
+            }
+        }
+        if (baseline.size() > results.size()) {
+            mismatches += baseline.size() - results.size();
+        }
+    }
+
+    double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "Requests:      " << requests.size() << " x " \
+        << opts.iterations << " iteration(s), " << opts.threads \
+        << " worker(s)" << std::endl;
+    std::cout << "Interventions: " << disrupted << std::endl;
+    std::cout << "Elapsed:       " << secs << " s" << std::endl;
+    std::cout << "Throughput:    " << (secs > 0 ? total / secs : 0) \
+        << " req/s" << std::endl;
+    if (!opts.baseline.empty()) {
+        std::cout << "Mismatches:    " << mismatches << std::endl;
+        if (mismatches) {
+            ret = 1;
+        }
+    }
+
+    delete rules;
+    delete modsec;
+
+    return ret;
+#endif
+}